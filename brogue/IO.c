@@ -32,6 +32,58 @@
 #include "Display.h"
 #include "DisplayEffect.h"
 
+/*  terrainRandomValues are fractions of 1000.  They are kept alongside
+	as fixed point scales with this many fraction bits, rounded up, so
+	that scaling by them takes no division yet truncates exactly as
+	dividing by 1000 would for any short amount.  */
+#define TERRAIN_SCALE_SHIFT 32
+
+/*  Cell flags written while computing the appearance of a cell or its
+	neighbors, which don't change how the cell looks.  They are left
+	out of the copy of the cell kept with its cached appearance, or
+	baking a corner shared with a neighbor would dirty the neighbor.  */
+#define CELL_APPEARANCE_IGNORED_FLAGS	(TERRAIN_COLORS_DANCING | STABLE_MEMORY)
+
+/*  The appearance of a dungeon cell as last computed by
+	getCellAppearance, along with the parts of the cell which went into
+	it.  When the cell or any of its neighbors no longer match, the
+	cells which depend on them are marked dirty.  */
+typedef struct CELL_APPEARANCE CELL_APPEARANCE;
+struct CELL_APPEARANCE
+{
+	unsigned long flags;
+	enum tileType layers[NUMBER_TERRAIN_LAYERS];
+	unsigned short volume;
+	cellDisplayBuffer rememberedAppearance;
+
+	uchar cellChar;
+	boolean blended;
+	color foreColor[4];
+	color backColor[4];
+};
+
+/*  The light at a corner of the dungeon cells, which is shared by the
+	up to four cells meeting there  */
+typedef struct VERTEX_LIGHT VERTEX_LIGHT;
+struct VERTEX_LIGHT
+{
+	color multiplier;
+	color augment;
+};
+
+/*  The game state outside of pmap which colors every cell  */
+typedef struct CELL_APPEARANCE_GLOBALS CELL_APPEARANCE_GLOBALS;
+struct CELL_APPEARANCE_GLOBALS
+{
+	short depthLevel;
+	boolean trueColorMode;
+	boolean inWater;
+	boolean playbackOmniscience;
+	short hallucinating;
+	short cursorPathIntensity;
+	short cursorLoc[2];
+};
+
 /*  We'll maintain some windows and draw contexts for drawing to regions
 	of the display  */
 typedef struct IO_STATE IO_STATE;
@@ -57,6 +109,35 @@ struct IO_STATE
 	BROGUE_EFFECT *progress_bar_effect;
 
 	BROGUE_WINDOW *alert_window;
+
+	/*  Cells which have had TERRAIN_COLORS_DANCING set, so that idle
+		animation needn't visit the whole map.  Cells are added as their
+		colors are baked, and dropped lazily once the flag is gone.  
+		dancing_index holds each cell's position in the list plus one,
+		or zero if the cell isn't listed.  */
+	short dancing_count;
+	unsigned char dancing_x[DCOLS * DROWS];
+	unsigned char dancing_y[DCOLS * DROWS];
+	short dancing_index[DCOLS][DROWS];
+
+	/*  Cached cell appearances, which are recomputed only when marked
+		dirty.  cell_light holds the light of each corner as of the
+		last check, as the lightmap is rewritten wholesale each turn.  */
+	CELL_APPEARANCE cell_appearance[DCOLS][DROWS];
+	boolean cell_dirty[DCOLS][DROWS];
+	lightcorner cell_light[DCOLS][DROWS];
+	CELL_APPEARANCE_GLOBALS cell_globals;
+
+	/*  The light at each cell corner, indexed by the cell to the lower
+		right, computed once and reused by every cell meeting there.
+		Corners are recomputed when their light or the visibility of
+		the cells around them changes.  */
+	VERTEX_LIGHT vertex_light[DCOLS][DROWS];
+	boolean vertex_dirty[DCOLS][DROWS];
+
+	/*  terrainRandomValues as fixed point scales, updated as the values
+		are shuffled  */
+	unsigned long long terrain_scales[DCOLS][DROWS][8];
 };
 
 IO_STATE io_state;
@@ -107,6 +188,8 @@ int ioInitialize(void)
 		return -1;
 	}
 
+	invalidateCellAppearances();
+
 	io_state.progress_bar_effect = 
 		BrogueEffect_open(io_state.sidebar_context, PROGRESS_BAR_EFFECT_NAME);
 	io_state.button_effect =
@@ -824,16 +907,19 @@ void displayLevel() {
 	short i, j;
 	
 	if (!rogue.playbackFastForward) {
+		BrogueProfile_begin(BROGUE_PROFILE_DISPLAY_LEVEL);
 		if (io_state.alert_window) {
 			BrogueWindow_close(io_state.alert_window);
 			io_state.alert_window = NULL;
 		}
 
+		prepareCellAppearances();
 		for( i=0; i<DCOLS; i++ ) {
 			for( j=0; j<DROWS; j++ ) {
 				refreshDungeonCell(i, j);
 			}
 		}
+		BrogueProfile_end(BROGUE_PROFILE_DISPLAY_LEVEL);
 	}
 }
 
@@ -844,33 +930,111 @@ void storeColorComponents(char components[3], const color *theColor) {
 	components[2] = theColor->blue;
 }
 
+static void addDancingCell(short x, short y) {
+	if (!io_state.dancing_index[x][y]) {
+		io_state.dancing_x[io_state.dancing_count] = x;
+		io_state.dancing_y[io_state.dancing_count] = y;
+		io_state.dancing_count++;
+		io_state.dancing_index[x][y] = io_state.dancing_count;
+	}
+}
+
+// Removes the i'th listed cell by moving the last one into its place.
+static void removeDancingCell(short i) {
+	short last = io_state.dancing_count - 1;
+	
+	io_state.dancing_index[io_state.dancing_x[i]][io_state.dancing_y[i]] = 0;
+	if (i != last) {
+		io_state.dancing_x[i] = io_state.dancing_x[last];
+		io_state.dancing_y[i] = io_state.dancing_y[last];
+		io_state.dancing_index[io_state.dancing_x[i]][io_state.dancing_y[i]] = i + 1;
+	}
+	io_state.dancing_count--;
+}
+
+// Whether idle animation should reroll the colors of a cell.
+static boolean cellColorsDance(short i, short j) {
+	return (playerCanSeeOrSense(i, j)
+			&& (!rogue.automationActive || !(rogue.playerTurnNumber % 5))
+			&& ((pmap[i][j].flags & TERRAIN_COLORS_DANCING)
+				|| (player.status[STATUS_HALLUCINATING] && playerCanDirectlySee(i, j)))
+			&& (i != rogue.cursorLoc[0] || j != rogue.cursorLoc[1]));
+}
+
+static unsigned long long terrainScale(short value) {
+	unsigned long long scaled = (unsigned long long) value << TERRAIN_SCALE_SHIFT;
+	
+	return scaled / 1000 + (scaled % 1000 != 0);
+}
+
+// Scales an amount by a terrain random value, as amount * value / 1000.
+static int scaleByTerrain(int amount, unsigned long long scale) {
+	if (amount < 0) {
+		return -(int) (((unsigned long long) -amount * scale) >> TERRAIN_SCALE_SHIFT);
+	}
+	return (int) (((unsigned long long) amount * scale) >> TERRAIN_SCALE_SHIFT);
+}
+
+static void updateCellTerrainScales(short i, short j) {
+	short k;
+	
+	for (k=0; k<8; k++) {
+		io_state.terrain_scales[i][j][k] = terrainScale(terrainRandomValues[i][j][k]);
+	}
+}
+
+// Must follow any change to terrainRandomValues other than by shuffling.
+void updateTerrainScales() {
+	short i, j;
+	
+	for (i=0; i<DCOLS; i++) {
+		for (j=0; j<DROWS; j++) {
+			updateCellTerrainScales(i, j);
+		}
+	}
+}
+
+static void shuffleCellColors(short i, short j) {
+	short k;
+	
+	for (k=0; k<8; k++) {
+		terrainRandomValues[i][j][k] += rand_range(-600, 600);
+		terrainRandomValues[i][j][k] = clamp(terrainRandomValues[i][j][k], 0, 1000);
+	}
+	updateCellTerrainScales(i, j);
+	
+	// The values are read at the corners of the cells above and left, too.
+	markCellAppearancesDirty(i - 1, j - 1, i, j);
+}
+
 void bakeTerrainColors(color *foreColor, color *backColor, short x, short y) {
-    const short *vals;
-    const short nf = 1000;
-    const short nb = 0;
-    const short neutralColors[8] = {nf, nf, nf, nf, nb, nb, nb, nb};
+    const unsigned long long *scales;
+    const unsigned long long nf = 1ULL << TERRAIN_SCALE_SHIFT;
+    const unsigned long long nb = 0;
+    const unsigned long long neutralScales[8] = {nf, nf, nf, nf, nb, nb, nb, nb};
 
     if (rogue.trueColorMode) {
-        vals = neutralColors;
+        scales = neutralScales;
     } else {
-        vals = &(terrainRandomValues[x][y][0]);
+        scales = &(io_state.terrain_scales[x][y][0]);
     }
     
-	const short foreRand = foreColor->rand * vals[6] / 1000;
-	const short backRand = backColor->rand * vals[7] / 1000;
+	const short foreRand = scaleByTerrain(foreColor->rand, scales[6]);
+	const short backRand = scaleByTerrain(backColor->rand, scales[7]);
 	
-	foreColor->red += foreColor->redRand * vals[0] / 1000 + foreRand;
-	foreColor->green += foreColor->greenRand * vals[1] / 1000 + foreRand;
-	foreColor->blue += foreColor->blueRand * vals[2] / 1000 + foreRand;
+	foreColor->red += scaleByTerrain(foreColor->redRand, scales[0]) + foreRand;
+	foreColor->green += scaleByTerrain(foreColor->greenRand, scales[1]) + foreRand;
+	foreColor->blue += scaleByTerrain(foreColor->blueRand, scales[2]) + foreRand;
 	foreColor->redRand = foreColor->greenRand = foreColor->blueRand = foreColor->rand = 0;
 	
-	backColor->red += backColor->redRand * vals[3] / 1000 + backRand;
-	backColor->green += backColor->greenRand * vals[4] / 1000 + backRand;
-	backColor->blue += backColor->blueRand * vals[5] / 1000 + backRand;
+	backColor->red += scaleByTerrain(backColor->redRand, scales[3]) + backRand;
+	backColor->green += scaleByTerrain(backColor->greenRand, scales[4]) + backRand;
+	backColor->blue += scaleByTerrain(backColor->blueRand, scales[5]) + backRand;
 	backColor->redRand = backColor->greenRand = backColor->blueRand = backColor->rand = 0;
 	
 	if (foreColor->colorDances || backColor->colorDances) {
 		pmap[x][y].flags |= TERRAIN_COLORS_DANCING;
+		addDancingCell(x, y);
 	} else {
 		pmap[x][y].flags &= ~TERRAIN_COLORS_DANCING;
 	}
@@ -886,38 +1050,88 @@ void bakeColor(color *theColor) {
 }
 
 void shuffleTerrainColors(short percentOfCells, boolean refreshCells) {
-	short i, j, k;
+	short i, j, n;
 	
 	assureCosmeticRNG;
 	
-	for (i=0; i<DCOLS; i++) {
-		for(j=0; j<DROWS; j++) {
-			if (playerCanSeeOrSense(i, j)
-				&& (!rogue.automationActive || !(rogue.playerTurnNumber % 5))
-				&& ((pmap[i][j].flags & TERRAIN_COLORS_DANCING)
-					|| (player.status[STATUS_HALLUCINATING] && playerCanDirectlySee(i, j)))
-				&& (i != rogue.cursorLoc[0] || j != rogue.cursorLoc[1])
-				&& (percentOfCells >= 100 || rand_range(1, 100) <= percentOfCells)) {
+	if (refreshCells && io_state.alert_window) {
+		BrogueWindow_close(io_state.alert_window);
+		io_state.alert_window = NULL;
+	}
+	
+	if (player.status[STATUS_HALLUCINATING]) {
+		// Every visible cell dances, so there's nothing to gain from the list.
+		for (i=0; i<DCOLS; i++) {
+			for(j=0; j<DROWS; j++) {
+				if (cellColorsDance(i, j)
+					&& (percentOfCells >= 100 || rand_range(1, 100) <= percentOfCells)) {
 					
-					for (k=0; k<8; k++) {
-						terrainRandomValues[i][j][k] += rand_range(-600, 600);
-						terrainRandomValues[i][j][k] = clamp(terrainRandomValues[i][j][k], 0, 1000);
+					shuffleCellColors(i, j);
+					if (refreshCells) {
+						refreshDungeonCell(i, j);
 					}
 				}
+			}
+		}
+	} else {
+		n = 0;
+		while (n < io_state.dancing_count) {
+			i = io_state.dancing_x[n];
+			j = io_state.dancing_y[n];
+			
+			if (!(pmap[i][j].flags & TERRAIN_COLORS_DANCING)) {
+				removeDancingCell(n);
+				continue;
+			}
+			
+			if (cellColorsDance(i, j)
+				&& (percentOfCells >= 100 || rand_range(1, 100) <= percentOfCells)) {
+				
+				shuffleCellColors(i, j);
+				if (refreshCells) {
+					refreshDungeonCell(i, j);
+				}
+			}
+			n++;
 		}
 	}
+	
+	restoreRNG;
+}
 
-	if (refreshCells)
-	{
-		displayLevel();
+// Returns true if anything visible in the dungeon changes appearance as
+// time passes, so that the platform must keep drawing frames while
+// waiting for input.
+boolean dungeonIsAnimating() {
+	short i, j, n;
+	
+	if (rogue.flareCount > 0) {
+		return true;
 	}
-	restoreRNG;
+	
+	if (player.status[STATUS_HALLUCINATING]) {
+		for (i=0; i<DCOLS; i++) {
+			for(j=0; j<DROWS; j++) {
+				if (cellColorsDance(i, j)) {
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+	
+	for (n = 0; n < io_state.dancing_count; n++) {
+		if (cellColorsDance(io_state.dancing_x[n], io_state.dancing_y[n])) {
+			return true;
+		}
+	}
+	return false;
 }
 
 /*  Pick a random value, as seeded by the terrain values for the cell  */
 int rand_range_cell(int x, int y, int min, int max)
 {
-	return min + (max - min) * terrainRandomValues[x][y][0] / 1000;
+	return min + scaleByTerrain(max - min, io_state.terrain_scales[x][y][0]);
 }
 
 // if forecolor is too similar to back, darken or lighten it and return true.
@@ -1010,15 +1224,36 @@ void applyLighting(
 	}
 }
 
+// Marks the light at every corner in the rectangle, clipped to the map,
+// for recomputing.
+static void markVertexLightsDirty(short x1, short y1, short x2, short y2) {
+	short i, j;
+	
+	for (i = max(x1, 0); i <= min(x2, DCOLS - 1); i++) {
+		for (j = max(y1, 0); j <= min(y2, DROWS - 1); j++) {
+			io_state.vertex_dirty[i][j] = true;
+		}
+	}
+}
+
+static void getVertexLight(short x, short y, color *multiplier, color *augment) {
+	VERTEX_LIGHT *vertex = &io_state.vertex_light[x][y];
+	
+	if (io_state.vertex_dirty[x][y]) {
+		colorMultiplierFromDungeonLight(x, y, &vertex->multiplier, &vertex->augment);
+		io_state.vertex_dirty[x][y] = false;
+	}
+	*multiplier = vertex->multiplier;
+	*augment = vertex->augment;
+}
+
 // okay, this is kind of a beast...
-void getCellAppearance(
-	BROGUE_DRAW_CONTEXT *context, short x, short y, color *foreColor,
-	uchar *returnChar) {
+static void computeCellAppearance(short x, short y, color *foreColor,
+								  CELL_APPEARANCE *appearance) {
 
 	short bestBCPriority, bestFCPriority, bestCharPriority;
 	uchar cellChar = 0;
 	color cellForeColor, cellBackColor, gasAugmentColor;
-	color cornerBackColor[4], cornerForeColor[4];
 	boolean monsterWithDetectedItem = false, needDistinctness = false;
 	boolean bypassLighting = false;
 	short gasAugmentWeight = 0;
@@ -1031,10 +1266,6 @@ void getCellAppearance(
 	int i;
 	
 	assureCosmeticRNG;
-
-#ifdef BROGUE_ASSERTS
-	assert(coordinatesAreInMap(x, y));
-#endif
 	
 	if (pmap[x][y].flags & HAS_MONSTER) {
 		monst = monsterAtLoc(x, y);
@@ -1188,12 +1419,10 @@ void getCellAppearance(
 		} else if (playerCanSeeOrSense(x, y) || (pmap[x][y].flags & (DISCOVERED | MAGIC_MAPPED))) {
 			// just don't want these to be plotted as black
 		} else {
-			*returnChar = ' ';
-			
-			BrogueDrawContext_setForeground(context, 
-											colorForDisplay(black));
-			BrogueDrawContext_setBackground(context, 
-											colorForDisplay(undiscoveredColor));
+			appearance->cellChar = ' ';
+			appearance->blended = false;
+			appearance->foreColor[0] = black;
+			appearance->backColor[0] = undiscoveredColor;
 
 			restoreRNG;
 			return;
@@ -1257,8 +1486,7 @@ void getCellAppearance(
 		}
 
 		if (!bypassLighting) {
-			colorMultiplierFromDungeonLight(lx, ly, 
-											&lightMultiplier, &lightAugment);
+			getVertexLight(lx, ly, &lightMultiplier, &lightAugment);
 		} else {
 			lightMultiplier = white;
 			lightAugment = black;
@@ -1296,27 +1524,232 @@ void getCellAppearance(
 			separateColors(&cornerFore, &cornerBack);
 		} 
 
-		cornerBackColor[i] = cornerBack;
-		cornerForeColor[i] = cornerFore;
+		appearance->backColor[i] = cornerBack;
+		appearance->foreColor[i] = cornerFore;
 	}
 
-	*returnChar = cellChar;
-	BrogueDrawContext_blendForeground(
-		context, 
-		colorForDisplay(cornerForeColor[0]),
-		colorForDisplay(cornerForeColor[1]),
-		colorForDisplay(cornerForeColor[2]),
-		colorForDisplay(cornerForeColor[3]));
-	BrogueDrawContext_blendBackground(
-		context, 
-		colorForDisplay(cornerBackColor[0]),
-		colorForDisplay(cornerBackColor[1]),
-		colorForDisplay(cornerBackColor[2]),
-		colorForDisplay(cornerBackColor[3]));
+	appearance->cellChar = cellChar;
+	appearance->blended = true;
 
 	restoreRNG;
 }
 
+// Marks every cell in the rectangle, clipped to the map, for recomputing.
+void markCellAppearancesDirty(short x1, short y1, short x2, short y2) {
+	short i, j;
+	
+	for (i = max(x1, 0); i <= min(x2, DCOLS - 1); i++) {
+		for (j = max(y1, 0); j <= min(y2, DROWS - 1); j++) {
+			io_state.cell_dirty[i][j] = true;
+		}
+	}
+}
+
+void invalidateCellAppearances() {
+	markCellAppearancesDirty(0, 0, DCOLS - 1, DROWS - 1);
+	markVertexLightsDirty(0, 0, DCOLS - 1, DROWS - 1);
+}
+
+static boolean cellAppearanceInputsMatch(short x, short y) {
+	const CELL_APPEARANCE *appearance = &io_state.cell_appearance[x][y];
+	const cellDisplayBuffer *remembered = &pmap[x][y].rememberedAppearance;
+	enum dungeonLayers layer;
+	
+	if (appearance->flags != (pmap[x][y].flags & ~CELL_APPEARANCE_IGNORED_FLAGS)
+		|| appearance->volume != pmap[x][y].volume
+		|| appearance->rememberedAppearance.character != remembered->character
+		|| memcmp(appearance->rememberedAppearance.foreColorComponents,
+				  remembered->foreColorComponents, 3)
+		|| memcmp(appearance->rememberedAppearance.backColorComponents,
+				  remembered->backColorComponents, 3)) {
+		return false;
+	}
+	for (layer = 0; layer < NUMBER_TERRAIN_LAYERS; layer++) {
+		if (appearance->layers[layer] != pmap[x][y].layers[layer]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void storeCellAppearanceInputs(short x, short y) {
+	CELL_APPEARANCE *appearance = &io_state.cell_appearance[x][y];
+	enum dungeonLayers layer;
+	
+	appearance->flags = pmap[x][y].flags & ~CELL_APPEARANCE_IGNORED_FLAGS;
+	appearance->volume = pmap[x][y].volume;
+	appearance->rememberedAppearance = pmap[x][y].rememberedAppearance;
+	for (layer = 0; layer < NUMBER_TERRAIN_LAYERS; layer++) {
+		appearance->layers[layer] = pmap[x][y].layers[layer];
+	}
+}
+
+// Dirties everything when state coloring the whole map has changed,
+// and the old and new cursor cells when the cursor has moved.
+static void checkCellAppearanceGlobals() {
+	CELL_APPEARANCE_GLOBALS *globals = &io_state.cell_globals;
+	
+	if (globals->depthLevel != rogue.depthLevel
+		|| globals->trueColorMode != rogue.trueColorMode
+		|| globals->inWater != rogue.inWater
+		|| globals->playbackOmniscience != rogue.playbackOmniscience
+		|| globals->hallucinating != player.status[STATUS_HALLUCINATING]
+		|| globals->cursorPathIntensity != rogue.cursorPathIntensity) {
+		
+		globals->depthLevel = rogue.depthLevel;
+		globals->trueColorMode = rogue.trueColorMode;
+		globals->inWater = rogue.inWater;
+		globals->playbackOmniscience = rogue.playbackOmniscience;
+		globals->hallucinating = player.status[STATUS_HALLUCINATING];
+		globals->cursorPathIntensity = rogue.cursorPathIntensity;
+		invalidateCellAppearances();
+	}
+	
+	if (globals->cursorLoc[0] != rogue.cursorLoc[0]
+		|| globals->cursorLoc[1] != rogue.cursorLoc[1]) {
+		
+		markCellAppearancesDirty(globals->cursorLoc[0], globals->cursorLoc[1],
+								 globals->cursorLoc[0], globals->cursorLoc[1]);
+		markCellAppearancesDirty(rogue.cursorLoc[0], rogue.cursorLoc[1],
+								 rogue.cursorLoc[0], rogue.cursorLoc[1]);
+		globals->cursorLoc[0] = rogue.cursorLoc[0];
+		globals->cursorLoc[1] = rogue.cursorLoc[1];
+	}
+}
+
+// A cell's appearance depends on its neighbors' visibility, so a change
+// to a cell dirties all the cells around it, and the corners they share.
+static void checkCellAppearanceInputs(short x, short y) {
+	if (!cellAppearanceInputsMatch(x, y)) {
+		storeCellAppearanceInputs(x, y);
+		markCellAppearancesDirty(x - 1, y - 1, x + 1, y + 1);
+		markVertexLightsDirty(x, y, x + 1, y + 1);
+	}
+}
+
+// A change to the light at a corner dirties the cells meeting there.
+static void checkCornerLight(short x, short y) {
+	short k;
+	
+	for (k = 0; k < 3; k++) {
+		if (io_state.cell_light[x][y].light[k] != lightmap[x][y].light[k]) {
+			io_state.cell_light[x][y] = lightmap[x][y];
+			markCellAppearancesDirty(x - 1, y - 1, x, y);
+			markVertexLightsDirty(x, y, x, y);
+			return;
+		}
+	}
+}
+
+// Whether a cell's cached appearance must be recomputed, after checking
+// the neighbors and corners it depends on for changes.  Cells holding a
+// creature or an item are always recomputed, as their appearance
+// changes with no change to the map.
+static boolean cellAppearanceIsDirty(short x, short y) {
+	short i, j;
+	
+	checkCellAppearanceGlobals();
+	
+	for (i = max(x - 1, 0); i <= min(x + 1, DCOLS - 1); i++) {
+		for (j = max(y - 1, 0); j <= min(y + 1, DROWS - 1); j++) {
+			checkCellAppearanceInputs(i, j);
+		}
+	}
+	
+	for (i = x; i <= min(x + 1, DCOLS - 1); i++) {
+		for (j = y; j <= min(y + 1, DROWS - 1); j++) {
+			checkCornerLight(i, j);
+		}
+	}
+	
+	return (io_state.cell_dirty[x][y]
+			|| (pmap[x][y].flags & (HAS_PLAYER | HAS_MONSTER | HAS_DORMANT_MONSTER | HAS_ITEM)));
+}
+
+static boolean cellAppearancesMatch(const CELL_APPEARANCE *a, const CELL_APPEARANCE *b) {
+	short i, corners = a->blended ? 4 : 1;
+	
+	if (a->cellChar != b->cellChar || a->blended != b->blended) {
+		return false;
+	}
+	for (i = 0; i < corners; i++) {
+		if (a->foreColor[i].red != b->foreColor[i].red
+			|| a->foreColor[i].green != b->foreColor[i].green
+			|| a->foreColor[i].blue != b->foreColor[i].blue
+			|| a->backColor[i].red != b->backColor[i].red
+			|| a->backColor[i].green != b->backColor[i].green
+			|| a->backColor[i].blue != b->backColor[i].blue) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Sets the colors of the context for drawing a cell, and returns its
+// character.  Appearances are cached between calls, and only cells
+// marked dirty are recomputed.
+void getCellAppearance(
+	BROGUE_DRAW_CONTEXT *context, short x, short y, color *foreColor,
+	uchar *returnChar) {
+	
+	CELL_APPEARANCE computed, *appearance;
+	boolean dirty;
+	
+	BrogueProfile_begin(BROGUE_PROFILE_CELL_APPEARANCE);
+
+#ifdef BROGUE_ASSERTS
+	assert(coordinatesAreInMap(x, y));
+#endif
+	
+	// Checked even when not using the cache, to bring the corner lights up to date.
+	dirty = cellAppearanceIsDirty(x, y);
+	
+	if (foreColor != NULL) {
+		// Overridden fore colors are drawn once for effect, so aren't cached.
+		computeCellAppearance(x, y, foreColor, &computed);
+		appearance = &computed;
+	} else {
+		appearance = &io_state.cell_appearance[x][y];
+		if (dirty) {
+			computeCellAppearance(x, y, NULL, appearance);
+			io_state.cell_dirty[x][y] = false;
+			
+			// Storing a memory of the cell changes nothing its neighbors use.
+			storeCellAppearanceInputs(x, y);
+		} else if (D_VERIFY_CELL_APPEARANCE) {
+			computeCellAppearance(x, y, NULL, &computed);
+			storeCellAppearanceInputs(x, y);
+			if (!cellAppearancesMatch(appearance, &computed)) {
+				printf("\nDepth %i: Stale cell appearance at (%i, %i).", rogue.depthLevel, x, y);
+				*appearance = computed;
+			}
+		}
+	}
+	
+	*returnChar = appearance->cellChar;
+	if (appearance->blended) {
+		BrogueDrawContext_blendForeground(
+			context, 
+			colorForDisplay(appearance->foreColor[0]),
+			colorForDisplay(appearance->foreColor[1]),
+			colorForDisplay(appearance->foreColor[2]),
+			colorForDisplay(appearance->foreColor[3]));
+		BrogueDrawContext_blendBackground(
+			context, 
+			colorForDisplay(appearance->backColor[0]),
+			colorForDisplay(appearance->backColor[1]),
+			colorForDisplay(appearance->backColor[2]),
+			colorForDisplay(appearance->backColor[3]));
+	} else {
+		BrogueDrawContext_setForeground(context, 
+										colorForDisplay(appearance->foreColor[0]));
+		BrogueDrawContext_setBackground(context, 
+										colorForDisplay(appearance->backColor[0]));
+	}
+	
+	BrogueProfile_end(BROGUE_PROFILE_CELL_APPEARANCE);
+}
+
 void refreshDungeonCell(short x, short y) {
 	uchar cellChar;
 #ifdef BROGUE_ASSERTS
@@ -1515,9 +1948,54 @@ short adjustedLightValue(short x) {
     }
 }
 
-/*  Generate the color value for the corner of a dungeon cell, taking
-	into account the visibility of neighbor cells  */
-void colorMultiplierFromDungeonLight(
+// adjustedLightValue for every light value a short can hold, filled in
+// on first use, so that converting lights is a branch-free load.  Held
+// as ints, so that the compiler knows stores to the short light arrays
+// can't change it, and gathers from it.
+static int adjustedLightTable[32768];
+static boolean adjustedLightTableReady = false;
+
+static void fillAdjustedLightTable() {
+	int i;
+	
+	for (i = 0; i < 32768; i++) {
+		adjustedLightTable[i] = adjustedLightValue(i);
+	}
+	adjustedLightTableReady = true;
+}
+
+// Converts a run of corner lights, as separate arrays of red, green and
+// blue, into light multipliers in place, with the random component of
+// each multiplier in rand.  Matches the lit case of
+// colorMultiplierFromDungeonLight, but each component is a clamp and a
+// table load in a plain loop, so that whole rows of corners vectorize.
+void lightMultipliersPlanar(colorPlanes *light, short *rand, short count) {
+	short *red = light->red, *green = light->green, *blue = light->blue;
+	short i;
+	
+	if (!adjustedLightTableReady) {
+		fillAdjustedLightTable();
+	}
+	
+	for (i = 0; i < count; i++) {
+		int sum = red[i] + green[i] + blue[i];
+		rand[i] = adjustedLightTable[(sum > 0 ? sum : 0) / 6];
+	}
+	for (i = 0; i < count; i++) {
+		red[i] = adjustedLightTable[red[i] > 0 ? red[i] : 0];
+	}
+	for (i = 0; i < count; i++) {
+		green[i] = adjustedLightTable[green[i] > 0 ? green[i] : 0];
+	}
+	for (i = 0; i < count; i++) {
+		blue[i] = adjustedLightTable[blue[i] > 0 ? blue[i] : 0];
+	}
+}
+
+/*  Generate the color value for the corner of a dungeon cell from the
+	visibility of the neighbor cells.  Returns false if the corner is
+	fully seen, in which case the color comes from the light there.  */
+static boolean lightFromVisibility(
 	short x, short y, color *editColor, color *augment) {
 
 	short x1 = x - 1;
@@ -1572,19 +2050,19 @@ void colorMultiplierFromDungeonLight(
 	*augment = black;
 
 	if (!ul_vis || !ur_vis || !bl_vis || !br_vis) {
-		return;
+		return true;
 	}
 
 	if (rogue.playbackOmniscience 
 		&& (!ul_anyvis || !ur_anyvis || !bl_anyvis || !br_anyvis)) {
 
 		*editColor = omniscienceColor;
-		return;
+		return true;
 	}
 
 	if (ul_map && ur_map && bl_map && br_map) {
 		*editColor = magicMapColor;
-		return;
+		return true;
 	}
 
 	if (!ul_see || !ur_see || !bl_see || !br_see)
@@ -1593,17 +2071,29 @@ void colorMultiplierFromDungeonLight(
 		*augment = memoryOverlay;
 		applyColorScalar(augment, 25);
 
-		return;
+		return true;
 	}
 
 	if (ul_clair || ur_clair || bl_clair || br_clair) {
 		*editColor = clairvoyanceColor;
-		return;
+		return true;
 	}
 
 	if (ul_tele || ur_tele || bl_tele || br_tele)
 	{
 		*editColor = telepathyMultiplier;
+		return true;
+	}
+
+	return false;
+}
+
+/*  Generate the color value for the corner of a dungeon cell, taking
+	into account the visibility of neighbor cells  */
+void colorMultiplierFromDungeonLight(
+	short x, short y, color *editColor, color *augment) {
+
+	if (lightFromVisibility(x, y, editColor, augment)) {
 		return;
 	}
 
@@ -1615,6 +2105,83 @@ void colorMultiplierFromDungeonLight(
 	editColor->colorDances = false;
 }
 
+// When set, corner lights are left for colorMultiplierFromDungeonLight
+// to compute one at a time as cells are drawn, as they were before the
+// planar conversion, so that frames drawn each way can be compared.
+static boolean referenceLighting = false;
+
+// Brings the whole map's cached appearances up to date with the game
+// state, and computes the light at every dirty cell corner a row at a
+// time, so that the cells drawn next find their corners ready.
+void prepareCellAppearances() {
+	short lightRed[DCOLS], lightGreen[DCOLS], lightBlue[DCOLS], lightRand[DCOLS];
+	short column[DCOLS];
+	colorPlanes light = {lightRed, lightGreen, lightBlue};
+	VERTEX_LIGHT *vertex;
+	color check, checkAugment;
+	short i, j, n;
+	
+	checkCellAppearanceGlobals();
+	for (i = 0; i < DCOLS; i++) {
+		for (j = 0; j < DROWS; j++) {
+			checkCellAppearanceInputs(i, j);
+			checkCornerLight(i, j);
+		}
+	}
+	
+	if (referenceLighting) {
+		return;
+	}
+	
+	for (j = 0; j < DROWS; j++) {
+		// Corners whose light depends only on visibility are settled
+		// here; the rest are gathered for converting together.
+		n = 0;
+		for (i = 0; i < DCOLS; i++) {
+			if (!io_state.vertex_dirty[i][j]) {
+				continue;
+			}
+			vertex = &io_state.vertex_light[i][j];
+			if (!lightFromVisibility(i, j, &vertex->multiplier, &vertex->augment)) {
+				column[n] = i;
+				lightRed[n] = lightmap[i][j].light[0];
+				lightGreen[n] = lightmap[i][j].light[1];
+				lightBlue[n] = lightmap[i][j].light[2];
+				n++;
+			}
+			io_state.vertex_dirty[i][j] = false;
+		}
+		
+		lightMultipliersPlanar(&light, lightRand, n);
+		
+		for (i = 0; i < n; i++) {
+			vertex = &io_state.vertex_light[column[i]][j];
+			vertex->multiplier.red = lightRed[i];
+			vertex->multiplier.green = lightGreen[i];
+			vertex->multiplier.blue = lightBlue[i];
+			vertex->multiplier.rand = lightRand[i];
+			vertex->multiplier.colorDances = false;
+			
+			if (D_VERIFY_CELL_APPEARANCE) {
+				colorMultiplierFromDungeonLight(column[i], j, &check, &checkAugment);
+				if (check.red != lightRed[i] || check.green != lightGreen[i]
+					|| check.blue != lightBlue[i] || check.rand != lightRand[i]) {
+					printf("\nDepth %i: Planar light differs at (%i, %i).", rogue.depthLevel, column[i], j);
+				}
+			}
+		}
+	}
+}
+
+// Switches between the planar and per-corner light conversions, and
+// redraws the whole level with the one chosen.
+void setReferenceLighting(boolean enable) {
+	referenceLighting = enable;
+	markCellAppearancesDirty(0, 0, DCOLS - 1, DROWS - 1);
+	markVertexLightsDirty(0, 0, DCOLS - 1, DROWS - 1);
+	displayLevel();
+}
+
 void blackOutScreen() {
 	BrogueWindow_clear(io_state.root);
 	BrogueWindow_clear(io_state.dungeon_window);
@@ -2506,6 +3073,35 @@ void messageWithoutCaps(char *msg, boolean requireAcknowledgment) {
 }
 
 
+// Like wrapText, but breaks lines where the text would overflow the message
+// window as measured in the window's proportional font, so that Chinese text
+// fills the full width of the window rather than being counted as double-wide.
+static short wrapMessageText(char *to, const char *sourceText) {
+	short lineCount, w;
+	int i, fit;
+	
+	lineCount = 1;
+	i = w = 0;
+	while (sourceText[i]) {
+		fit = BrogueDrawContext_fitAsciiString(
+			io_state.message_context, 0, sourceText + i, DCOLS);
+		memcpy(to + w, sourceText + i, fit);
+		w += fit;
+		i += fit;
+		
+		if (sourceText[i] == '\n') {
+			to[w++] = sourceText[i++];
+			++lineCount;
+		} else if (sourceText[i]) {
+			to[w++] = '\n';
+			++lineCount;
+		}
+	}
+	to[w] = '\0';
+	
+	return lineCount;
+}
+
 void message(const char *msg, boolean requireAcknowledgment) {
 	char text[COLS*20], *msgPtr;
 	short i, lines;
@@ -2518,7 +3114,7 @@ void message(const char *msg, boolean requireAcknowledgment) {
 	}
 	displayCombatText();
 	
-	lines = wrapText(text, msg, DCOLS+15);// hack to get longer breaks of line
+	lines = wrapMessageText(text, msg);
 	msgPtr = &(text[0]);
 	
 	// for(i=0; text[i] == COLOR_ESCAPE; i+=4);
@@ -2738,6 +3334,7 @@ void refreshSideBar(short focusX, short focusY, boolean focusedEntityMustGoFirst
 		return;
 	}
 	
+	BrogueProfile_begin(BROGUE_PROFILE_SIDEBAR);
 	assureCosmeticRNG;
 	
 	if (focusX < 0) {
@@ -2949,6 +3546,7 @@ void refreshSideBar(short focusX, short focusY, boolean focusedEntityMustGoFirst
 	}
 	
 	restoreRNG;
+	BrogueProfile_end(BROGUE_PROFILE_SIDEBAR);
 }
 
 // Inserts line breaks into really long words. Optionally adds a hyphen, but doesn't do anything
@@ -299,6 +299,8 @@ void updateLighting() {
 	enum tileType tile;
 	creature *monst;
 
+	BrogueProfile_begin(BROGUE_PROFILE_LIGHTING);
+
 	// Copy Light over oldLight
     recordOldLights();
     
@@ -366,6 +368,8 @@ void updateLighting() {
 	} else {
 		player.info.foreColor = &playerInLightColor;
 	}
+
+	BrogueProfile_end(BROGUE_PROFILE_LIGHTING);
 }
 
 boolean playerInDarkness() {
@@ -31,164 +31,60 @@
 #include "IncludeGlobals.h"
 #include "DisplayEffect.h"
 
-#define MENU_FLAME_PRECISION_FACTOR		10
-#define MENU_FLAME_RISE_SPEED			50
-#define MENU_FLAME_SPREAD_SPEED			20
-#define MENU_FLAME_COLOR_DRIFT_SPEED	500
-#define MENU_FLAME_FADE_SPEED			20
 #define MENU_FLAME_UPDATE_DELAY			50
 #define MENU_FLAME_ROW_PADDING			2
 #define MENU_TITLE_OFFSET_X				(-4)
 #define MENU_TITLE_OFFSET_Y				(-1)
 
-#define MENU_FLAME_COLOR_SOURCE_COUNT	1136
-
-#define MENU_FLAME_DENOMINATOR			(100 + MENU_FLAME_RISE_SPEED + MENU_FLAME_SPREAD_SPEED)
-
-void drawMenuFlames(
-	BROGUE_DRAW_CONTEXT *context, 
-	signed short flames[COLS][(ROWS + MENU_FLAME_ROW_PADDING)][3]) {
-
-	short i, j, versionStringLength;
-    char dchar;
-    
-    versionStringLength = strLenWithoutEscapes(BROGUE_VERSION_STRING);
+// Convert a game color to a flame source for the display's flame effect.
+static MENU_FLAME_SOURCE flameSourceForColor(const color *theColor) {
+	MENU_FLAME_SOURCE source;
 	
-	for (j=0; j<ROWS; j++) {
-		for (i=0; i<COLS; i++) {
-            if (j == ROWS - 1 && i >= COLS - versionStringLength) {
-                dchar = BROGUE_VERSION_STRING[i - (COLS - versionStringLength)];
-            } else {
-                dchar = ' ';
-            }
-            
-			BrogueDrawContext_setForeground(
-				context, colorForDisplay(darkGray));
-
-			if (i < COLS - 1)
-			{
-				color ul, ur, bl, br;
-				memset(&ul, 0, sizeof(color));
-				memset(&ur, 0, sizeof(color));
-				memset(&bl, 0, sizeof(color));
-				memset(&br, 0, sizeof(color));
-
-				ul.red = flames[i][j][0] / MENU_FLAME_PRECISION_FACTOR;
-				ul.green = flames[i][j][1] / MENU_FLAME_PRECISION_FACTOR;
-				ul.blue = flames[i][j][2] / MENU_FLAME_PRECISION_FACTOR;
-
-				ur.red = flames[i + 1][j][0] / MENU_FLAME_PRECISION_FACTOR;
-				ur.green = flames[i + 1][j][1] / MENU_FLAME_PRECISION_FACTOR;
-				ur.blue = flames[i + 1][j][2] / MENU_FLAME_PRECISION_FACTOR;
-
-				bl.red = flames[i][j + 1][0] / MENU_FLAME_PRECISION_FACTOR;
-				bl.green = flames[i][j + 1][1] / MENU_FLAME_PRECISION_FACTOR;
-				bl.blue = flames[i][j + 1][2] / MENU_FLAME_PRECISION_FACTOR;
-
-				br.red = flames[i + 1][j + 1][0] / MENU_FLAME_PRECISION_FACTOR;
-				br.green = flames[i + 1][j + 1][1] / MENU_FLAME_PRECISION_FACTOR;
-				br.blue = flames[i + 1][j + 1][2] / MENU_FLAME_PRECISION_FACTOR;
-
-				BrogueDrawContext_blendBackground(
-					context, colorForDisplay(ul), colorForDisplay(ur),
-					colorForDisplay(bl), colorForDisplay(br));
-			}
-			else
-			{
-				color upper, lower;
-
-				upper.red = flames[i][j][0] / MENU_FLAME_PRECISION_FACTOR;
-				upper.green = flames[i][j][1] / MENU_FLAME_PRECISION_FACTOR;
-				upper.blue = flames[i][j][2] / MENU_FLAME_PRECISION_FACTOR;
-
-				lower.red = flames[i][j + 1][0] / MENU_FLAME_PRECISION_FACTOR;
-				lower.green = flames[i][j + 1][1] / MENU_FLAME_PRECISION_FACTOR;
-				lower.blue = flames[i][j + 1][2] / MENU_FLAME_PRECISION_FACTOR;
-
-				BrogueDrawContext_blendBackground(
-					context, colorForDisplay(upper), colorForDisplay(upper),
-					colorForDisplay(lower), colorForDisplay(lower));
-			}
-
-			BrogueDrawContext_drawChar(context, i, j, dchar);
-		}
-	}
+	source.red = theColor->red;
+	source.green = theColor->green;
+	source.blue = theColor->blue;
+	source.red_rand = theColor->redRand;
+	source.green_rand = theColor->greenRand;
+	source.blue_rand = theColor->blueRand;
+	source.rand = theColor->rand;
+	
+	return source;
 }
 
-void updateMenuFlames(color *colors[COLS][(ROWS + MENU_FLAME_ROW_PADDING)],
-					  signed short colorSources[MENU_FLAME_COLOR_SOURCE_COUNT][4],
-					  signed short flames[COLS][(ROWS + MENU_FLAME_ROW_PADDING)][3]) {
+// Set the flames burning across the window of the given context. The display
+// simulates and draws them from then on, animating without further drawing.
+void drawMenuFlames(BROGUE_DRAW_CONTEXT *context, BROGUE_EFFECT *effect,
+					color *colors[COLS][(ROWS + MENU_FLAME_ROW_PADDING)]) {
+	const MENU_FLAME_SOURCE *sources[(ROWS + MENU_FLAME_ROW_PADDING) * COLS];
+	MENU_FLAME_SOURCE bottomSource, titleSource;
+	MENU_FLAMES_EFFECT_PARAM param;
+	short i, j;
 	
-	short i, j, k, l, x, y;
-	signed short tempFlames[COLS][3];
-	short colorSourceNumber, rand;
+	bottomSource = flameSourceForColor(&flameSourceColor);
+	titleSource = flameSourceForColor(&flameTitleColor);
 	
-	colorSourceNumber = 0;
 	for (j=0; j<(ROWS + MENU_FLAME_ROW_PADDING); j++) {
-		// Make a temp copy of the current row.
 		for (i=0; i<COLS; i++) {
-			for (k=0; k<3; k++) {
-				tempFlames[i][k] = flames[i][j][k];
-			}
-		}
-		
-		for (i=0; i<COLS; i++) {
-			// Each cell is the weighted average of the three color values below and itself.
-			// Weight of itself: 100
-			// Weight of left and right neighbors: MENU_FLAME_SPREAD_SPEED / 2 each
-			// Weight of below cell: MENU_FLAME_RISE_SPEED
-			// Divisor: 100 + MENU_FLAME_SPREAD_SPEED + MENU_FLAME_RISE_SPEED
-			
-			// Itself:
-			for (k=0; k<3; k++) {
-				flames[i][j][k] = 100 * flames[i][j][k] / MENU_FLAME_DENOMINATOR;
-			}
-			
-			// Left and right neighbors:
-			for (l = -1; l <= 1; l += 2) {
-				x = i + l;
-				if (x == -1) {
-					x = COLS - 1;
-				} else if (x == COLS) {
-					x = 0;
-				}
-				for (k=0; k<3; k++) {
-					flames[i][j][k] += MENU_FLAME_SPREAD_SPEED * tempFlames[x][k] / 2 / MENU_FLAME_DENOMINATOR;
-				}
-			}
-			
-			// Below:
-			y = j + 1;
-			if (y < (ROWS + MENU_FLAME_ROW_PADDING)) {
-				for (k=0; k<3; k++) {
-					flames[i][j][k] += MENU_FLAME_RISE_SPEED * flames[i][y][k] / MENU_FLAME_DENOMINATOR;
-				}
-			}
-			
-			// Fade a little:
-			for (k=0; k<3; k++) {
-				flames[i][j][k] = (1000 - MENU_FLAME_FADE_SPEED) * flames[i][j][k] / 1000;
-			}
-			
-			if (colors[i][j]) {
-				// If it's a color source tile:
-				
-				// First, cause the color to drift a little.
-				for (k=0; k<4; k++) {
-					colorSources[colorSourceNumber][k] += rand_range(-MENU_FLAME_COLOR_DRIFT_SPEED, MENU_FLAME_COLOR_DRIFT_SPEED);
-					colorSources[colorSourceNumber][k] = clamp(colorSources[colorSourceNumber][k], 0, 1000);
-				}
-				
-				// Then, add the color to this tile's flames.
-				rand = colors[i][j]->rand * colorSources[colorSourceNumber][0] / 1000;
-				flames[i][j][0] += (colors[i][j]->red	+ (colors[i][j]->redRand	* colorSources[colorSourceNumber][1] / 1000) + rand) * MENU_FLAME_PRECISION_FACTOR;
-				flames[i][j][1] += (colors[i][j]->green	+ (colors[i][j]->greenRand	* colorSources[colorSourceNumber][2] / 1000) + rand) * MENU_FLAME_PRECISION_FACTOR;
-				flames[i][j][2] += (colors[i][j]->blue	+ (colors[i][j]->blueRand	* colorSources[colorSourceNumber][3] / 1000) + rand) * MENU_FLAME_PRECISION_FACTOR;
-				
-				colorSourceNumber++;
+			if (colors[i][j] == &flameSourceColor) {
+				sources[j * COLS + i] = &bottomSource;
+			} else if (colors[i][j] == &flameTitleColor) {
+				sources[j * COLS + i] = &titleSource;
+			} else {
+				sources[j * COLS + i] = NULL;
 			}
 		}
 	}
+	
+	param.width = COLS;
+	param.height = ROWS + MENU_FLAME_ROW_PADDING;
+	param.seed = rand_range(1, 30000);
+	param.sources = sources;
+	
+	BrogueDrawContext_push(context);
+	BrogueDrawContext_setEffect(context, effect);
+	BrogueEffect_setParameters(effect, &param);
+	BrogueDrawContext_drawAsciiString(context, 0, 0, "");
+	BrogueDrawContext_pop(context);
 }
 
 // Takes a grid of values, each of which is 0 or 100, and fills in some middle values in the interstices.
@@ -218,10 +114,8 @@ void antiAlias(unsigned char mask[COLS][ROWS]) {
 
 void initializeMenuFlames(boolean includeTitle,
 						  color *colors[COLS][(ROWS + MENU_FLAME_ROW_PADDING)],
-						  signed short colorSources[MENU_FLAME_COLOR_SOURCE_COUNT][4],
-						  signed short flames[COLS][(ROWS + MENU_FLAME_ROW_PADDING)][3],
 						  unsigned char mask[COLS][ROWS]) {
-	short i, j, k, colorSourceCount;
+	short i, j;
 	const char title[MENU_TITLE_HEIGHT][MENU_TITLE_WIDTH+1] = {
 		"########   ########       ######         #######   ####     ###  #########",
 		" ##   ###   ##   ###    ##     ###     ##      ##   ##       #    ##     #",
@@ -253,24 +147,12 @@ void initializeMenuFlames(boolean includeTitle,
 	for (i=0; i<COLS; i++) {
 		for (j=0; j<(ROWS + MENU_FLAME_ROW_PADDING); j++) {
 			colors[i][j] = NULL;
-			for (k=0; k<3; k++) {
-				flames[i][j][k] = 0;
-			}
-		}
-	}
-	
-	// Seed source color random components.
-	for (i=0; i<MENU_FLAME_COLOR_SOURCE_COUNT; i++) {
-		for (k=0; k<4; k++) {
-			colorSources[i][k] = rand_range(0, 1000);
 		}
 	}
 	
 	// Put some flame source along the bottom row.
-	colorSourceCount = 0;
 	for (i=0; i<COLS; i++) {
 		colors[i][(ROWS + MENU_FLAME_ROW_PADDING)-1] = &flameSourceColor;
-		colorSourceCount++;
 	}
 	
 	if (includeTitle) {
@@ -279,7 +161,6 @@ void initializeMenuFlames(boolean includeTitle,
 			for (j=0; j<MENU_TITLE_HEIGHT; j++) {
 				if (title[j][i] != ' ') {
 					colors[(COLS - MENU_TITLE_WIDTH)/2 + i + MENU_TITLE_OFFSET_X][(ROWS - MENU_TITLE_HEIGHT)/2 + j + MENU_TITLE_OFFSET_Y] = &flameTitleColor;
-					colorSourceCount++;
 					mask[(COLS - MENU_TITLE_WIDTH)/2 + i + MENU_TITLE_OFFSET_X][(ROWS - MENU_TITLE_HEIGHT)/2 + j + MENU_TITLE_OFFSET_Y] = 100;
 				}
 			}
@@ -288,21 +169,9 @@ void initializeMenuFlames(boolean includeTitle,
 		// Anti-alias the mask.
 		antiAlias(mask);
 	}
-	
-#ifdef BROGUE_ASSERTS
-	assert(colorSourceCount <= MENU_FLAME_COLOR_SOURCE_COUNT);
-#endif
-	
-	// Simulate the background flames for a while
-	for (i=0; i<100; i++) {
-		updateMenuFlames(colors, colorSources, flames);
-	}
-	
 }
 
 void titleMenu() {
-	signed short flames[COLS][(ROWS + MENU_FLAME_ROW_PADDING)][3]; // red, green and blue
-	signed short colorSources[MENU_FLAME_COLOR_SOURCE_COUNT][4]; // red, green, blue, and rand, one for each color source (no more than MENU_FLAME_COLOR_SOURCE_COUNT).
 	color *colors[COLS][(ROWS + MENU_FLAME_ROW_PADDING)];
 	unsigned char mask[COLS][ROWS];
 	boolean controlKeyWasDown = false;
@@ -317,7 +186,7 @@ void titleMenu() {
 	enum NGCommands buttonCommands[6] = {NG_NEW_GAME, NG_OPEN_GAME, NG_VIEW_RECORDING, NG_HIGH_SCORES, NG_QUIT};
 	BROGUE_WINDOW *root, *window, *title_window, *button_window;
 	BROGUE_DRAW_CONTEXT *context, *title_context, *button_context;
-	BROGUE_EFFECT *button_effect;
+	BROGUE_EFFECT *button_effect, *flame_effect;
 	BROGUE_GRAPHIC *title_graphic;
 	
 	// Initialize the RNG so the flames aren't always the same.
@@ -382,6 +251,7 @@ void titleMenu() {
 	root = ioGetRoot();
 	window = BrogueWindow_open(root, 0, 0, COLS, ROWS);
 	context = BrogueDrawContext_open(window);
+	flame_effect = BrogueEffect_open(context, MENU_FLAMES_EFFECT_NAME);
 
 	title_window = BrogueWindow_open(window, 0, 0, COLS, ROWS);
 	title_context = BrogueDrawContext_open(title_window);
@@ -390,6 +260,10 @@ void titleMenu() {
 		BrogueDrawContext_drawGraphic(title_context, 0, 0, COLS, ROWS, 
 									  title_graphic);
 	}
+	BrogueDrawContext_setForeground(title_context, colorForDisplay(darkGray));
+	BrogueDrawContext_drawAsciiString(
+		title_context, COLS - strLenWithoutEscapes(BROGUE_VERSION_STRING), ROWS - 1,
+		BROGUE_VERSION_STRING);
 
 	button_window = BrogueWindow_open(window, x, y, 22, b * 2 + 1);
 	BrogueWindow_setColor(button_window, windowColor);
@@ -401,7 +275,8 @@ void titleMenu() {
 						  x, y, 20, b*2-1);
 	drawButtonsInState(button_context, button_effect, &state);
 
-	initializeMenuFlames(true, colors, colorSources, flames, mask);
+	initializeMenuFlames(true, colors, mask);
+	drawMenuFlames(context, flame_effect, colors);
     rogue.creaturesWillFlashThisTurn = false; // total unconscionable hack
 	
 	do {
@@ -417,11 +292,7 @@ void titleMenu() {
 			controlKeyWasDown = false;
 		}
 		
-		// Update the display.
-		updateMenuFlames(colors, colorSources, flames);
-		drawMenuFlames(context, flames);
-		
-		// Pause briefly.
+		// Pause briefly while the flames burn.
 		if (pauseBrogue(MENU_FLAME_UPDATE_DELAY)) {
 			// There was input during the pause! Get the input.
 			nextBrogueEvent(&theEvent, true, false, true);
@@ -431,7 +302,6 @@ void titleMenu() {
 										&state, NULL, &theEvent);
 		}
 	} while (button == -1 && rogue.nextGame == NG_NOTHING);
-	drawMenuFlames(context, flames);
 	if (button != -1) {
 		rogue.nextGame = buttonCommands[button];
 	}
@@ -2360,6 +2360,7 @@ void updateVision(boolean refreshDisplay) {
 	item *theItem;
 	creature *monst;
 	
+	BrogueProfile_begin(BROGUE_PROFILE_VISION);
     demoteVisibility();
 	for (i=0; i<DCOLS; i++) {
 		for (j=0; j<DROWS; j++) {
@@ -2416,6 +2417,7 @@ void updateVision(boolean refreshDisplay) {
 			}
 		}
 	}
+	BrogueProfile_end(BROGUE_PROFILE_VISION);
 }
 
 void checkNutrition() {
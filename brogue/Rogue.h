@@ -52,6 +52,7 @@
 #define D_IMMORTAL						(DEBUGGING && 1)
 #define D_INSPECT_LEVELGEN				(DEBUGGING && 0)
 #define D_INSPECT_MACHINES				(DEBUGGING && 0)
+#define D_VERIFY_CELL_APPEARANCE		(DEBUGGING && 0)
 
 // set to false to allow multiple loads from the same saved file:
 #define DELETE_SAVE_FILE_AFTER_LOADING	true
@@ -1204,6 +1205,14 @@ typedef struct color {
 	
 } color;
 
+// A run of baked colors, held as separate arrays of each component so
+// that the same operation on every color can be vectorized.
+typedef struct colorPlanes {
+	short *red;
+	short *green;
+	short *blue;
+} colorPlanes;
+
 enum itemFlags {
 	ITEM_IDENTIFIED			= Fl(0),
 	ITEM_EQUIPPED			= Fl(1),
@@ -2360,9 +2369,13 @@ extern "C" {
 	boolean separateColors(color *fore, color *back);
 	void bakeColor(color *theColor);
 	void shuffleTerrainColors(short percentOfCells, boolean refreshCells);
+	void updateTerrainScales();
+	boolean dungeonIsAnimating();
 	void getCellAppearance(
 		BROGUE_DRAW_CONTEXT *context, short x, short y, color *foreColor,
 		uchar *returnChar);
+	void markCellAppearancesDirty(short x1, short y1, short x2, short y2);
+	void invalidateCellAppearances();
 	void logBuffer(char array[DCOLS][DROWS]);
 	//void logBuffer(short **array);
 	boolean search(short searchStrength);
@@ -2456,6 +2469,9 @@ extern "C" {
 	void hiliteCell(short x, short y, const color *hiliteColor, short hiliteStrength, boolean distinctColors);
 	void colorMultiplierFromDungeonLight(
 		short x, short y, color *editColor, color *augment);
+	void lightMultipliersPlanar(colorPlanes *light, short *rand, short count);
+	void prepareCellAppearances();
+	void setReferenceLighting(boolean enable);
 	void dumpLevelToScreen();
 	void hiliteCharGrid(char hiliteCharGrid[DCOLS][DROWS], color *hiliteColor, short hiliteStrength);
 	void blackOutScreen();
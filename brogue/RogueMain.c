@@ -272,6 +272,8 @@ void initializeRogue(unsigned long seed) {
 		}
 	}
 	restoreRNG;
+	updateTerrainScales();
+	invalidateCellAppearances();
 	
 	zeroOutGrid(displayDetail);
 	
@@ -28,6 +28,24 @@
 #define BROGUE_JUSTIFY_CENTER 1
 #define BROGUE_JUSTIFY_RIGHT 2
 
+/*  Stages of frame generation timed by BrogueProfile_begin  */
+#define BROGUE_PROFILE_DISPLAY_LEVEL 0
+#define BROGUE_PROFILE_CELL_APPEARANCE 1
+#define BROGUE_PROFILE_LIGHTING 2
+#define BROGUE_PROFILE_VISION 3
+#define BROGUE_PROFILE_SIDEBAR 4
+#define BROGUE_PROFILE_PREPARE_FRAME 5
+#define BROGUE_PROFILE_WINDOW_DRAW 6
+#define BROGUE_PROFILE_DRAW_CHAR 7
+#define BROGUE_PROFILE_DRAW_STRING 8
+#define BROGUE_PROFILE_BLUR 9
+#define BROGUE_PROFILE_FLIP 10
+#define BROGUE_PROFILE_STAGE_COUNT 11
+
+/*  Image formats written by BrogueExport_open  */
+#define BROGUE_EXPORT_PNG 0
+#define BROGUE_EXPORT_PPM 1
+
 /*  Some opaque structures used as parameters to display methods  */
 typedef struct BROGUE_DISPLAY BROGUE_DISPLAY;
 typedef struct BROGUE_WINDOW BROGUE_WINDOW;
@@ -125,6 +143,8 @@ BROGUE_TEXT_SIZE BrogueDrawContext_measureString(
     BROGUE_DRAW_CONTEXT *context, int x, const wchar_t *str);
 BROGUE_TEXT_SIZE BrogueDrawContext_measureAsciiString(
     BROGUE_DRAW_CONTEXT *context, int x, const char *str);
+int BrogueDrawContext_fitAsciiString(
+    BROGUE_DRAW_CONTEXT *context, int x, const char *str, int width);
 
 /*  Methods for display "effects" used to render in a non-standard way  */
 BROGUE_EFFECT *BrogueEffect_open(
@@ -132,6 +152,11 @@ BROGUE_EFFECT *BrogueEffect_open(
 void BrogueEffect_close(BROGUE_EFFECT *effect);
 int BrogueEffect_setParameters(BROGUE_EFFECT *effect, void *param);
 
+/*  Methods for timing stages of frame generation, which cost nothing
+    but a test unless profiling is enabled.  Stages may nest.  */
+void BrogueProfile_begin(int stage);
+void BrogueProfile_end(int stage);
+
 /*  Methods for external graphics which can be drawn.  
     (i.e. loaded from SVG)  */
 BROGUE_GRAPHIC *BrogueGraphic_open(const char *filename);
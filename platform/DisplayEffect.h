@@ -25,6 +25,8 @@
 
 typedef struct PROGRESS_BAR_EFFECT_PARAM PROGRESS_BAR_EFFECT_PARAM;
 typedef struct BUTTON_EFFECT_PARAM BUTTON_EFFECT_PARAM;
+typedef struct MENU_FLAME_SOURCE MENU_FLAME_SOURCE;
+typedef struct MENU_FLAMES_EFFECT_PARAM MENU_FLAMES_EFFECT_PARAM;
 
 /*  Parameter structure for progress bar drawing  */
 #define PROGRESS_BAR_EFFECT_NAME L"ProgressBar"
@@ -51,4 +53,28 @@ struct BUTTON_EFFECT_PARAM
     int *symbol_flags;
 };
 
+/*  A color feeding the title screen flames, on the game's 0 to 100
+    scale, with random components which drift over time  */
+struct MENU_FLAME_SOURCE
+{
+    short red, green, blue;
+    short red_rand, green_rand, blue_rand;
+    short rand;
+};
+
+/*  Parameter structure for the title screen flames.  The flames are 
+    simulated on a grid of cells which may extend below the drawn area,
+    and are drawn by interpolating between cell corners at the display's
+    native resolution.  */
+#define MENU_FLAMES_EFFECT_NAME L"MenuFlames"
+struct MENU_FLAMES_EFFECT_PARAM
+{
+    int width, height;
+    unsigned seed;
+
+    /*  For each cell of the grid, in row-major order, the color source
+	feeding it, or NULL  */
+    const MENU_FLAME_SOURCE **sources;
+};
+
 #endif
@@ -9,8 +9,19 @@ boolean serverMode = false;
 boolean noMenu = false;
 unsigned long int firstSeed = 0;
 short brogueFontSize = -1;
+int brogueTextCacheKilobytes = -1;
+int brogueRasterThreads = 0;
+char *brogueProfileCsvPath = NULL;
+char *brogueExportDirectory = NULL;
+int brogueExportInterval = 1;
+int brogueExportFormat = BROGUE_EXPORT_PNG;
+int brogueIdleCheckSeconds = 0;
+int brogueCheckLighting = 0;
 
 void dumpScores();
+#ifdef BROGUE_SDL
+int BrogueDisplay_benchmarkBlend(void);
+#endif
 
 static boolean endswith(const char *str, const char *ending)
 {
@@ -36,6 +47,27 @@ static void printCommandlineHelp() {
 	"-o filename[.broguesave]   open a save file (extension optional)\n"
 	"-v recording[.broguerec]   view a recording (extension optional)\n"
 	"--size N                   starts the game at font size N\n"
+	"--text-cache N             use up to N kilobytes to cache rendered text\n"
+#ifdef BROGUE_SDL
+	"--threads N                rasterize the display using N worker threads\n"
+	"--benchmark-blend          measure the speed of the color blending kernels\n"
+	"--profile-csv filename     write the time spent in each stage of each frame\n"
+	"                           to a CSV file at exit\n"
+	"--headless-replay recording[.broguerec]\n"
+	"                           replay a recording offscreen, printing a hash\n"
+	"                           of each rendered frame\n"
+	"--export-frames recording[.broguerec] directory\n"
+	"                           replay a recording offscreen, writing each frame\n"
+	"                           to a numbered PNG in the directory\n"
+	"--export-every N           with --export-frames, keep only every Nth frame\n"
+	"--export-ppm               with --export-frames, write PPM instead of PNG\n"
+	"--check-lighting           draw the first levels of a fixed set of seeds\n"
+	"                           offscreen with the planar and per-corner light\n"
+	"                           conversions, and compare the frames' hashes\n"
+	"--idle-check N             with --headless-replay, leave the game waiting at\n"
+	"                           the replay's first prompt for N seconds, and fail\n"
+	"                           if it uses over 5% of a CPU core meanwhile\n"
+#endif
 #ifdef BROGUE_TCOD
 	"--noteye-hack              ignore SDL-specific application state checks\n"
 #endif
@@ -159,10 +191,82 @@ int main(int argc, char *argv[])
 		}
 
 #ifdef BROGUE_SDL
+		if (strcmp(argv[i], "--benchmark-blend") == 0) {
+			return BrogueDisplay_benchmarkBlend();
+		}
+
 		if (strcmp(argv[i], "--SDL") == 0) {
 			currentConsole = sdlConsole;
 			continue;
 		}
+
+		if (strcmp(argv[i], "--profile-csv") == 0 && i + 1 < argc) {
+			brogueProfileCsvPath = argv[i + 1];
+			i++;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--headless-replay") == 0 && i + 1 < argc) {
+			// replay a recording without a window, for comparing frames between builds
+			strncpy(rogue.nextGamePath, argv[i + 1], 4096);
+			rogue.nextGamePath[4095] = '\0';
+			rogue.nextGame = NG_VIEW_RECORDING;
+			currentConsole = sdlHeadlessConsole;
+
+			if (!endswith(rogue.nextGamePath, RECORDING_SUFFIX)) {
+				append(rogue.nextGamePath, RECORDING_SUFFIX, 4096);
+			}
+
+			i++;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--export-frames") == 0 && i + 2 < argc) {
+			// replay a recording without a window, saving its frames as images
+			strncpy(rogue.nextGamePath, argv[i + 1], 4096);
+			rogue.nextGamePath[4095] = '\0';
+			rogue.nextGame = NG_VIEW_RECORDING;
+			currentConsole = sdlHeadlessConsole;
+
+			if (!endswith(rogue.nextGamePath, RECORDING_SUFFIX)) {
+				append(rogue.nextGamePath, RECORDING_SUFFIX, 4096);
+			}
+
+			brogueExportDirectory = argv[i + 2];
+			i += 2;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--export-every") == 0 && i + 1 < argc) {
+			int interval = atoi(argv[i + 1]);
+			if (interval > 0) {
+				brogueExportInterval = interval;
+				i++;
+				continue;
+			}
+		}
+
+		if (strcmp(argv[i], "--export-ppm") == 0) {
+			brogueExportFormat = BROGUE_EXPORT_PPM;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--check-lighting") == 0) {
+			// compare frames drawn by each light conversion, for a fixed set of seeds
+			brogueCheckLighting = 1;
+			currentConsole = sdlHeadlessConsole;
+			continue;
+		}
+
+		if (strcmp(argv[i], "--idle-check") == 0 && i + 1 < argc) {
+			// measure the CPU used by a game which is waiting for input
+			int seconds = atoi(argv[i + 1]);
+			if (seconds > 0) {
+				brogueIdleCheckSeconds = seconds;
+				i++;
+				continue;
+			}
+		}
 #endif
 		if (strcmp(argv[i], "--size") == 0) {
 			// pick a font size
@@ -173,6 +277,26 @@ int main(int argc, char *argv[])
 				continue;
 			}
 		}
+
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			// pick the number of rasterization worker threads
+			int threads = atoi(argv[i + 1]);
+			if (threads > 0 || strcmp(argv[i + 1], "0") == 0) {
+				i++;
+				brogueRasterThreads = threads;
+				continue;
+			}
+		}
+
+		if (strcmp(argv[i], "--text-cache") == 0 && i + 1 < argc) {
+			// pick the memory budget for rendered text
+			int kilobytes = atoi(argv[i + 1]);
+			if (kilobytes > 0 || strcmp(argv[i + 1], "0") == 0) {
+				i++;
+				brogueTextCacheKilobytes = kilobytes;
+				continue;
+			}
+		}
 #ifdef BROGUE_CURSES
 		if (strcmp(argv[i], "--term") == 0 || strcmp(argv[i], "-t") == 0) {
 			currentConsole = cursesConsole;
@@ -14,6 +14,7 @@ void loadKeymap();
 
 #ifdef BROGUE_SDL
 extern struct brogueConsole sdlConsole;
+extern struct brogueConsole sdlHeadlessConsole;
 #endif
 
 #ifdef BROGUE_CURSES
@@ -29,6 +29,36 @@
 
 #include "sdl-display.h"
 
+/*  The SSE2 blur kernels are compiled for x86 with per-function target
+    attributes, and used when SDL reports SSE2 at runtime  */
+#if (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define BLUR_X86_KERNELS
+#include <emmintrin.h>
+#endif
+
+/*  The widest blur for which the SSE2 kernels' 16-bit running sums and
+    reciprocal division are exact  */
+#define MAX_SIMD_BLUR_AMOUNT 16
+
+typedef struct BROGUE_TEXT_RUN BROGUE_TEXT_RUN;
+
+/*  A run of text which has been rendered or measured.  Runs which have
+    only been measured have no color and no surface.  */
+struct BROGUE_TEXT_RUN
+{
+    guint hash;
+    Uint16 *text;
+    int proportional;
+    int has_color;
+    SDL_Color color;
+
+    int width, height;
+    SDL_Surface *surface;
+    size_t bytes;
+    GList *link;
+};
+
 /*  wide-character-string equivalence for glib's hashes  */
 static gboolean wcs_equal(gconstpointer a, gconstpointer b)
 {
@@ -54,6 +84,103 @@ static guint wcs_hash(gconstpointer key)
     return value;
 }
 
+/*  Free a glyph stored in the display's glyph atlas  */
+static void glyphFree(gpointer data)
+{
+    BROGUE_GLYPH *glyph = (BROGUE_GLYPH *)data;
+
+    if (glyph->coverage != NULL)
+    {
+	SDL_FreeSurface(glyph->coverage);
+    }
+    free(glyph);
+}
+
+/*  Hash the text and appearance of a text run  */
+static guint textRunHash(gconstpointer key)
+{
+    BROGUE_TEXT_RUN *run = (BROGUE_TEXT_RUN *)key;
+
+    return run->hash;
+}
+
+/*  Text run equivalence for the display's text run hash  */
+static gboolean textRunEqual(gconstpointer a, gconstpointer b)
+{
+    BROGUE_TEXT_RUN *run_a = (BROGUE_TEXT_RUN *)a;
+    BROGUE_TEXT_RUN *run_b = (BROGUE_TEXT_RUN *)b;
+    int i;
+
+    if (run_a->hash != run_b->hash
+	|| run_a->proportional != run_b->proportional
+	|| run_a->has_color != run_b->has_color)
+    {
+	return FALSE;
+    }
+
+    if (run_a->has_color
+	&& (run_a->color.r != run_b->color.r
+	    || run_a->color.g != run_b->color.g
+	    || run_a->color.b != run_b->color.b))
+    {
+	return FALSE;
+    }
+
+    for (i = 0; run_a->text[i] == run_b->text[i]; i++)
+    {
+	if (run_a->text[i] == 0)
+	{
+	    return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
+/*  Free a text run stored in the display's text run cache  */
+static void textRunFree(gpointer data)
+{
+    BROGUE_TEXT_RUN *run = (BROGUE_TEXT_RUN *)data;
+
+    if (run->surface != NULL)
+    {
+	SDL_FreeSurface(run->surface);
+    }
+    free(run->text);
+    free(run);
+}
+
+/*  Free the scratch surfaces used by a rasterizing thread  */
+static void BrogueRasterScratch_free(BROGUE_RASTER_SCRATCH *scratch)
+{
+    if (scratch->render_glyph != NULL)
+    {
+	SDL_FreeSurface(scratch->render_glyph);
+	scratch->render_glyph = NULL;
+    }
+
+    if (scratch->tint != NULL)
+    {
+	SDL_FreeSurface(scratch->tint);
+	scratch->tint = NULL;
+    }
+}
+
+/*  Recreate the scratch surfaces for the display's current cell size  */
+static void BrogueRasterScratch_reset(BROGUE_RASTER_SCRATCH *scratch)
+{
+    BROGUE_DISPLAY *display = scratch->display;
+
+    BrogueRasterScratch_free(scratch);
+
+    if (display->font_width > 0 && display->font_height > 0)
+    {
+	scratch->render_glyph = SDL_CreateRGBSurface(
+	    0, display->font_width, display->font_height, 32,
+	    0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    }
+}
+
 /*  Open the global display state for the app  */
 BROGUE_DISPLAY *BrogueDisplay_open(int width, int height)
 {
@@ -68,14 +195,72 @@ BROGUE_DISPLAY *BrogueDisplay_open(int width, int height)
 
     display->width = width;
     display->height = height;
+    display->full_damage = 1;
+    display->anim_frame = -1;
+
+    display->damage = malloc(width * height);
+    display->damage_rects = malloc(sizeof(SDL_Rect) * width * height);
+    display->damage_columns = malloc(sizeof(int) * width);
+    display->raster_mask = malloc(width * height);
+    display->backdrop_cover = malloc(sizeof(unsigned short) * width * height);
+    if (display->damage == NULL || display->damage_rects == NULL
+	|| display->damage_columns == NULL || display->raster_mask == NULL
+	|| display->backdrop_cover == NULL)
+    {
+	free(display->damage);
+	free(display->damage_rects);
+	free(display->damage_columns);
+	free(display->raster_mask);
+	free(display->backdrop_cover);
+	free(display);
+	return NULL;
+    }
+    memset(display->damage, 0, width * height);
+
+    display->raster_scratch[0].display = display;
+    display->raster_scratch[0].thread_id = SDL_ThreadID();
 
     display->effect_classes = g_hash_table_new(wcs_hash, wcs_equal);
     if (display->effect_classes == NULL)
     {
+	free(display->damage);
+	free(display->damage_rects);
+	free(display->damage_columns);
+	free(display->raster_mask);
+	free(display->backdrop_cover);
 	free(display);
 	return NULL;
     }
 
+    display->glyph_atlas = g_hash_table_new_full(
+	g_int64_hash, g_int64_equal, NULL, glyphFree);
+    display->text_runs = g_hash_table_new_full(
+	textRunHash, textRunEqual, NULL, textRunFree);
+    g_queue_init(&display->text_run_lru);
+    display->text_run_budget = DEFAULT_TEXT_CACHE_BUDGET;
+    if (display->glyph_atlas == NULL || display->text_runs == NULL)
+    {
+	if (display->glyph_atlas != NULL)
+	{
+	    g_hash_table_destroy(display->glyph_atlas);
+	}
+	if (display->text_runs != NULL)
+	{
+	    g_hash_table_destroy(display->text_runs);
+	}
+	g_hash_table_destroy(display->effect_classes);
+	free(display->damage);
+	free(display->damage_rects);
+	free(display->damage_columns);
+	free(display->raster_mask);
+	free(display->backdrop_cover);
+	free(display);
+	return NULL;
+    }
+
+    BroguePool_init(&display->draw_pool, sizeof(BROGUE_DEFERRED_DRAW));
+    BrogueDisplay_initCharPool(display);
+
     display->root_window = BrogueWindow_open(NULL, 0, 0, width, height);
     if (display->root_window == NULL)
     {
@@ -96,12 +281,36 @@ static void effectClassFree(gpointer key, gpointer value, gpointer data)
     free(value);
 }
 
+/*  Discard the measured advance widths, as for a change of fonts  */
+static void BrogueDisplay_freeAdvances(BROGUE_DISPLAY *display)
+{
+    int i, j;
+
+    for (i = 0; i < 2; i++)
+    {
+	for (j = 0; j < ADVANCE_PAGE_COUNT; j++)
+	{
+	    free(display->advance_pages[i][j]);
+	    display->advance_pages[i][j] = NULL;
+	}
+    }
+}
+
 /*  Close down the display.  */
 void BrogueDisplay_close(BROGUE_DISPLAY *display)
 {
-    if (display->render_glyph != NULL)
+    BrogueDisplay_setRasterThreads(display, 0);
+    BrogueRasterScratch_free(&display->raster_scratch[0]);
+    if (display->raster_mutex != NULL)
+    {
+	SDL_DestroyCond(display->raster_work_cond);
+	SDL_DestroyCond(display->raster_done_cond);
+	SDL_DestroyMutex(display->raster_mutex);
+    }
+
+    if (display->frame_surface != NULL)
     {
-	SDL_FreeSurface(display->render_glyph);
+	SDL_FreeSurface(display->frame_surface);
     }
  
     if (display->root_window)
@@ -110,123 +319,1049 @@ void BrogueDisplay_close(BROGUE_DISPLAY *display)
 	display->root_window = NULL;
     }
 
-    g_hash_table_foreach(display->effect_classes, effectClassFree, NULL);
-    g_hash_table_destroy(display->effect_classes);
+    g_hash_table_foreach(display->effect_classes, effectClassFree, NULL);
+    g_hash_table_destroy(display->effect_classes);
+    g_hash_table_destroy(display->glyph_atlas);
+    BrogueDisplay_freeAdvances(display);
+    g_queue_clear(&display->text_run_lru);
+    g_hash_table_destroy(display->text_runs);
+    BroguePool_destroy(&display->draw_pool);
+    BroguePool_destroy(&display->char_pool);
+
+    free(display->damage);
+    free(display->damage_rects);
+    free(display->damage_columns);
+    free(display->raster_jobs);
+    free(display->raster_mask);
+    free(display->backdrop_cover);
+    free(display);
+}
+
+/*  Mark a rectangle of screen cells as needing to be rasterized  */
+static void BrogueDisplay_damageRect(
+    BROGUE_DISPLAY *display, int x, int y, int width, int height)
+{
+    int i, j;
+
+    for (j = y; j < y + height; j++)
+    {
+	if (j < 0 || j >= display->height)
+	{
+	    continue;
+	}
+
+	for (i = x; i < x + width; i++)
+	{
+	    if (i >= 0 && i < display->width)
+	    {
+		display->damage[j * display->width + i] = 1;
+	    }
+	}
+    }
+}
+
+/*  Count the damaged screen cells within a rectangle  */
+static int BrogueDisplay_countDamage(
+    BROGUE_DISPLAY *display, int x, int y, int width, int height)
+{
+    int i, j;
+    int count = 0;
+
+    for (j = y; j < y + height; j++)
+    {
+	if (j < 0 || j >= display->height)
+	{
+	    continue;
+	}
+
+	for (i = x; i < x + width; i++)
+	{
+	    if (i >= 0 && i < display->width)
+	    {
+		count += display->damage[j * display->width + i];
+	    }
+	}
+    }
+
+    return count;
+}
+
+/*  Count the damaged cells of an area which a window must rasterize,
+    leaving out cells covered by the cached backdrop of a window above */
+static int BrogueWindow_countDamage(
+    BROGUE_WINDOW *window, int x, int y, int width, int height)
+{
+    BROGUE_DISPLAY *display = window->display;
+    int i, j, index;
+    int count = 0;
+
+    for (j = y; j < y + height; j++)
+    {
+	if (j < 0 || j >= display->height)
+	{
+	    continue;
+	}
+
+	for (i = x; i < x + width; i++)
+	{
+	    index = j * display->width + i;
+	    if (i >= 0 && i < display->width
+		&& display->backdrop_cover[index] <= window->draw_order)
+	    {
+		count += display->damage[index];
+	    }
+	}
+    }
+
+    return count;
+}
+
+/*  Force the entire screen to be regenerated on the next frame  */
+void BrogueDisplay_damageAll(BROGUE_DISPLAY *display)
+{
+    display->full_damage = 1;
+}
+
+/*  Move the cells replaced in a window (and its children) since the last 
+    frame to the screen damage map.  Animated draws are considered
+    replaced whenever the animation frame advances.  */
+static void BrogueWindow_collectDamage(
+    BROGUE_WINDOW *window, int origin_x, int origin_y, int anim_advanced)
+{
+    BROGUE_DISPLAY *display = window->display;
+    int i, x, y;
+
+    origin_x += window->x;
+    origin_y += window->y;
+
+    /*  Damage collected so far comes from the windows drawn below this 
+	one.  If there is none, the blurred background is unchanged.  */
+    window->draw_order = ++display->window_count;
+    window->backdrop_valid = 0;
+    if (window->visible && window->backdrop != NULL 
+	&& !display->full_damage
+	&& !BrogueDisplay_countDamage(display, origin_x, origin_y, 
+				      window->width, window->height))
+    {
+	window->backdrop_valid = 1;
+
+	for (y = origin_y; y < origin_y + window->height; y++)
+	{
+	    for (x = origin_x; x < origin_x + window->width; x++)
+	    {
+		if (x >= 0 && x < display->width 
+		    && y >= 0 && y < display->height)
+		{
+		    display->backdrop_cover[y * display->width + x] = 
+			window->draw_order;
+		}
+	    }
+	}
+    }
+
+    for (y = 0; y < window->height; y++)
+    {
+	for (x = 0; x < window->width; x++)
+	{
+	    int index = y * window->width + x;
+	    BROGUE_DEFERRED_DRAW *draw = window->draws[index];
+
+	    if (window->visible && window->dirty[index])
+	    {
+		BrogueDisplay_damageRect(
+		    display, origin_x + x, origin_y + y, 1, 1);
+	    }
+	    window->dirty[index] = 0;
+
+	    if (window->visible && draw != NULL && draw->is_animated)
+	    {
+		display->animated_count++;
+	    }
+
+	    if (window->visible && anim_advanced 
+		&& draw != NULL && draw->is_animated)
+	    {
+		BrogueDisplay_damageRect(
+		    display, origin_x + draw->x, origin_y + draw->y, 
+		    draw->width, draw->height);
+	    }
+	}
+    }
+
+    for (i = 0; i < window->children->len; i++)
+    {
+	BROGUE_WINDOW *child = 
+	    (BROGUE_WINDOW *)g_ptr_array_index(window->children, i);
+
+	BrogueWindow_collectDamage(child, origin_x, origin_y, anim_advanced);
+    }
+}
+
+/*  
+    Grow the damaged area so that any draw touching damage is redrawn in
+    its entirety, as are translucent windows, since their blurred 
+    background depends on everything below them.  Returns true if the 
+    damaged area changed.
+*/
+static int BrogueWindow_expandDamage(
+    BROGUE_WINDOW *window, int origin_x, int origin_y)
+{
+    BROGUE_DISPLAY *display = window->display;
+    int i, x, y;
+    int changed = 0;
+    int damage;
+
+    if (!window->visible)
+    {
+	return 0;
+    }
+
+    origin_x += window->x;
+    origin_y += window->y;
+
+    if (window->color.alpha != 0.0)
+    {
+	damage = BrogueDisplay_countDamage(
+	    display, origin_x, origin_y, window->width, window->height);
+	if (damage > 0 && damage < window->width * window->height)
+	{
+	    BrogueDisplay_damageRect(
+		display, origin_x, origin_y, window->width, window->height);
+	    changed = 1;
+	}
+    }
+
+    for (y = 0; y < window->height; y++)
+    {
+	for (x = 0; x < window->width; x++)
+	{
+	    BROGUE_DEFERRED_DRAW *draw = window->draws[y * window->width + x];
+	    int dx, dy, width, height;
+
+	    if (draw == NULL)
+	    {
+		continue;
+	    }
+
+	    dx = draw->x;
+	    dy = draw->y;
+	    width = draw->width;
+	    height = draw->height;
+	    BrogueWindow_clip(window, &dx, &dy, &width, &height);
+
+	    if (width * height <= 1)
+	    {
+		continue;
+	    }
+
+	    damage = BrogueDisplay_countDamage(
+		display, origin_x + dx, origin_y + dy, width, height);
+	    if (damage > 0 && damage < width * height)
+	    {
+		BrogueDisplay_damageRect(
+		    display, origin_x + dx, origin_y + dy, width, height);
+		changed = 1;
+	    }
+	}
+    }
+
+    for (i = 0; i < window->children->len; i++)
+    {
+	BROGUE_WINDOW *child = 
+	    (BROGUE_WINDOW *)g_ptr_array_index(window->children, i);
+
+	if (BrogueWindow_expandDamage(child, origin_x, origin_y))
+	{
+	    changed = 1;
+	}
+    }
+
+    return changed;
+}
+
+/*  Convert the damaged screen cells to a list of pixel rectangles, 
+    merging vertically adjacent runs spanning identical columns  */
+static void BrogueDisplay_buildDamageRects(BROGUE_DISPLAY *display)
+{
+    int x, y, i;
+    SDL_Rect *rects = display->damage_rects;
+    int *open_rect = display->damage_columns;
+    int count = 0;
+
+    /*  open_rect[x] is the index of a rectangle ending on the previous 
+	row whose leftmost column is x, or -1 if there is none  */
+    for (x = 0; x < display->width; x++)
+    {
+	open_rect[x] = -1;
+    }
+
+    for (y = 0; y < display->height; y++)
+    {
+	x = 0;
+	while (x < display->width)
+	{
+	    int run_begin, index;
+
+	    if (!display->damage[y * display->width + x])
+	    {
+		open_rect[x] = -1;
+		x++;
+		continue;
+	    }
+
+	    run_begin = x;
+	    while (x < display->width && display->damage[y * display->width + x])
+	    {
+		if (x > run_begin)
+		{
+		    open_rect[x] = -1;
+		}
+		x++;
+	    }
+
+	    index = open_rect[run_begin];
+	    if (index >= 0 && rects[index].w == x - run_begin)
+	    {
+		rects[index].h++;
+	    }
+	    else
+	    {
+		index = count++;
+		rects[index].x = run_begin;
+		rects[index].y = y;
+		rects[index].w = x - run_begin;
+		rects[index].h = 1;
+	    }
+	    open_rect[run_begin] = index;
+	}
+    }
+
+    for (i = 0; i < count; i++)
+    {
+	rects[i].x *= display->font_width;
+	rects[i].y *= display->font_height;
+	rects[i].w *= display->font_width;
+	rects[i].h *= display->font_height;
+    }
+
+    display->damage_rect_count = count;
+}
+
+/*  Return true if any animated draws were visible in the last frame  */
+int BrogueDisplay_isAnimating(BROGUE_DISPLAY *display)
+{
+    return display->animated_count > 0;
+}
+
+/*  Return true if the last prepared frame changed any pixels  */
+int BrogueDisplay_isFrameChanged(BROGUE_DISPLAY *display)
+{
+    return display->damage_rect_count > 0;
+}
+
+/*  Render frames to the screen surface only, without pushing them to
+    a video device  */
+void BrogueDisplay_setOffscreen(BROGUE_DISPLAY *display, int offscreen)
+{
+    display->offscreen = offscreen;
+}
+
+/*  Animate by the given time rather than the SDL clock from now on, so 
+    that the same sequence of times produces the same frames  */
+void BrogueDisplay_setVirtualTime(BROGUE_DISPLAY *display, Uint32 ticks)
+{
+    display->virtual_time_enabled = 1;
+    display->virtual_time = ticks;
+}
+
+/*  Go back to animating by the SDL clock  */
+void BrogueDisplay_setRealTime(BROGUE_DISPLAY *display)
+{
+    display->virtual_time_enabled = 0;
+}
+
+/*  Generate the framebuffer from the current state of the display, 
+    rasterizing only those cells which have changed since the last frame  */
+static void BrogueDisplay_renderFrame(BROGUE_DISPLAY *display)
+{
+    SDL_Surface *surface;
+    int err;
+    SDL_Rect rect;
+    int w, h, i;
+    int anim_frame, anim_advanced;
+    Uint32 ticks;
+    int screen_compatible = 1;
+
+    if (display->screen->format->Rmask != 0x00FF0000
+	|| display->screen->format->Gmask != 0x0000FF00
+	|| display->screen->format->Bmask != 0x000000FF)
+    {
+	screen_compatible = 0;
+    }
+
+    w = display->width * display->font_width;
+    h = display->height * display->font_height;
+
+    rect.x = (display->screen->w - w) / 2;
+    rect.y = (display->screen->h - h) / 2;
+    rect.w = w;
+    rect.h = h;
+
+    if (display->virtual_time_enabled)
+    {
+	ticks = display->virtual_time;
+    }
+    else
+    {
+	ticks = SDL_GetTicks();
+    }
+    anim_frame = ticks / FRAME_TIME;
+    anim_advanced = (anim_frame != display->anim_frame);
+    display->anim_frame = anim_frame;
+
+    display->animated_count = 0;
+    display->window_count = 0;
+    memset(display->backdrop_cover, 0, 
+	   sizeof(unsigned short) * display->width * display->height);
+    BrogueWindow_collectDamage(display->root_window, 0, 0, anim_advanced);
+    if (display->full_damage)
+    {
+	memset(display->damage, 1, display->width * display->height);
+    }
+    while (BrogueWindow_expandDamage(display->root_window, 0, 0))
+    {
+    }
+
+    BrogueDisplay_buildDamageRects(display);
+    if (display->damage_rect_count == 0)
+    {
+	return;
+    }
+
+    if (!screen_compatible)
+    {
+	if (display->frame_surface == NULL)
+	{
+	    display->frame_surface = SDL_CreateRGBSurface(
+		0, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	    if (display->frame_surface == NULL)
+	    {
+		return;
+	    }
+	}
+
+	surface = display->frame_surface;
+    }
+    else
+    {
+	/*  If the screen surface matches our expected ARGB pixel format,
+	    we can render to it directly rather than rendering to
+	    another surface and converting afterward  */
+	surface = SDL_CreateRGBSurfaceFrom(
+	    display->screen->pixels 
+	    + 4 * rect.x + display->screen->pitch * rect.y, 
+	    w, h, 32, display->screen->pitch,
+	    0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+
+	if (display->full_damage)
+	{
+	    memset(display->screen->pixels, 0, 
+		   display->screen->pitch * display->screen->h);
+	}
+    }
+    if (surface == NULL)
+    {
+	return;
+    }
+
+    for (i = 0; i < display->damage_rect_count; i++)
+    {
+	SDL_FillRect(surface, &display->damage_rects[i], 0);
+    }
+
+    BrogueProfile_begin(BROGUE_PROFILE_WINDOW_DRAW);
+    err = BrogueWindow_draw(display->root_window, surface);
+    BrogueProfile_end(BROGUE_PROFILE_WINDOW_DRAW);
+
+    if (!screen_compatible)
+    {
+	for (i = 0; !err && i < display->damage_rect_count; i++)
+	{
+	    SDL_Rect src = display->damage_rects[i];
+	    SDL_Rect dst = src;
+
+	    dst.x += rect.x;
+	    dst.y += rect.y;
+	    SDL_BlitSurface(surface, &src, display->screen, &dst);
+	}
+    }
+    else
+    {
+	SDL_FreeSurface(surface);
+    }
+
+    /*  Translate the damage to screen coordinates for presentation  */
+    for (i = 0; i < display->damage_rect_count; i++)
+    {
+	display->damage_rects[i].x += rect.x;
+	display->damage_rects[i].y += rect.y;
+    }
+}
+
+/*  Generate the next frame, timing it for the profiler  */
+void BrogueDisplay_prepareFrame(BROGUE_DISPLAY *display)
+{
+    BrogueProfile_begin(BROGUE_PROFILE_PREPARE_FRAME);
+    BrogueDisplay_renderFrame(display);
+    BrogueProfile_end(BROGUE_PROFILE_PREPARE_FRAME);
+}
+
+/*  Push the regions of the screen generated by the last prepared frame
+    to the display, then reset the damage for the next frame  */
+void BrogueDisplay_presentFrame(BROGUE_DISPLAY *display)
+{
+    BrogueProfile_begin(BROGUE_PROFILE_FLIP);
+    if (display->offscreen)
+    {
+	/*  The frame stays in the screen surface for the caller to read  */
+    }
+    else if (display->full_damage)
+    {
+	SDL_Flip(display->screen);
+    }
+    else if (display->damage_rect_count > 0)
+    {
+	SDL_UpdateRects(display->screen, 
+			display->damage_rect_count, display->damage_rects);
+    }
+    BrogueProfile_end(BROGUE_PROFILE_FLIP);
+
+    display->full_damage = 0;
+    display->damage_rect_count = 0;
+    memset(display->damage, 0, display->width * display->height);
+}
+
+/*  Set the target screen surface  */
+void BrogueDisplay_setScreen(BROGUE_DISPLAY *display, SDL_Surface *screen)
+{
+    display->screen = screen;
+
+    if (display->frame_surface != NULL)
+    {
+	SDL_FreeSurface(display->frame_surface);
+	display->frame_surface = NULL;
+    }
+    display->full_damage = 1;
+}
+
+/*  Get one of the fonts associated with the display  */
+TTF_Font *BrogueDisplay_getFont(BROGUE_DISPLAY *display, int proportional)
+{
+    if (proportional)
+    {
+	return display->sans_font;
+    }
+    else
+    {
+	return display->mono_font;
+    }
+}
+
+/*  Get the current cell size of the display  */
+void BrogueDisplay_getFontSize(BROGUE_DISPLAY *display, 
+			       int *width, int *height)
+{
+    *width = display->font_width;
+    *height = display->font_height;
+}
+
+/*  Set the fonts to be used by the display  */
+void BrogueDisplay_setFonts(
+    BROGUE_DISPLAY *display, TTF_Font *mono_font, TTF_Font *sans_font,
+    int font_width, int font_height)
+{
+    int i;
+
+    if (mono_font != display->mono_font || sans_font != display->sans_font)
+    {
+	BrogueDisplay_freeAdvances(display);
+    }
+
+    display->mono_font = mono_font;
+    display->sans_font = sans_font;
+    display->font_width = font_width;
+    display->font_height = font_height;
+    display->font_descent = 0;
+    display->full_damage = 1;
+
+    if (display->frame_surface != NULL)
+    {
+	SDL_FreeSurface(display->frame_surface);
+	display->frame_surface = NULL;
+    }
+
+    if (mono_font != NULL)
+    {
+	display->font_descent = TTF_FontDescent(mono_font);
+    }
+
+    for (i = 0; i <= display->raster_thread_count; i++)
+    {
+	BrogueRasterScratch_reset(&display->raster_scratch[i]);
+    }
+}
+
+/*  Note the point size of the fonts about to be set.  Glyphs are keyed
+    by point size, so those of other sizes are kept for when we switch 
+    back, but the cached text runs must go.  */
+void BrogueDisplay_setGlyphPointSize(BROGUE_DISPLAY *display, int point_size)
+{
+    if (point_size != display->glyph_point_size)
+    {
+	g_queue_clear(&display->text_run_lru);
+	g_hash_table_remove_all(display->text_runs);
+	display->text_run_bytes = 0;
+	display->glyph_point_size = point_size;
+    }
+}
+
+static gboolean glyphHasPointSize(
+    gpointer key, gpointer value, gpointer data)
+{
+    BROGUE_GLYPH *glyph = (BROGUE_GLYPH *)value;
+
+    return (int)(glyph->key >> 40) == GPOINTER_TO_INT(data);
+}
+
+/*  Discard the glyphs rendered at a point size no longer in use  */
+void BrogueDisplay_discardGlyphPointSize(
+    BROGUE_DISPLAY *display, int point_size)
+{
+    if (point_size == display->glyph_point_size)
+    {
+	return;
+    }
+
+    g_hash_table_foreach_remove(display->glyph_atlas, glyphHasPointSize,
+				GINT_TO_POINTER(point_size));
+}
+
+/*  The glyph atlas key for a codepoint in one of the fonts  */
+static gint64 BrogueDisplay_glyphKey(
+    BROGUE_DISPLAY *display, int proportional, wchar_t c)
+{
+    return ((gint64)display->glyph_point_size << 40)
+	| ((gint64)(proportional ? 1 : 0) << 32)
+	| (gint64)(Uint16)c;
+}
+
+/*  Look up a glyph which has already been rendered, without rendering
+    it if it is missing.  This doesn't modify the atlas, so it is safe
+    to call from rasterization worker threads.  */
+BROGUE_GLYPH *BrogueDisplay_findGlyph(
+    BROGUE_DISPLAY *display, int proportional, wchar_t c)
+{
+    gint64 key = BrogueDisplay_glyphKey(display, proportional, c);
+
+    return g_hash_table_lookup(display->glyph_atlas, &key);
+}
+
+/*  Look up the rendered coverage of a glyph, rendering it with the
+    current font if this is the first time it has been requested.  */
+BROGUE_GLYPH *BrogueDisplay_getGlyph(
+    BROGUE_DISPLAY *display, int proportional, wchar_t c)
+{
+    SDL_Color white = { 255, 255, 255, 255 };
+    TTF_Font *font = BrogueDisplay_getFont(display, proportional);
+    BROGUE_GLYPH *glyph;
+    gint64 key;
+
+    key = BrogueDisplay_glyphKey(display, proportional, c);
+    glyph = g_hash_table_lookup(display->glyph_atlas, &key);
+    if (glyph != NULL)
+    {
+	display->glyph_hits++;
+	return glyph;
+    }
+    display->glyph_misses++;
+
+    if (font == NULL)
+    {
+	return NULL;
+    }
+
+    glyph = BrogueDisplay_allocate(display, sizeof(BROGUE_GLYPH));
+    if (glyph == NULL)
+    {
+	return NULL;
+    }
+    memset(glyph, 0, sizeof(BROGUE_GLYPH));
+    glyph->key = key;
+
+    /*  A glyph which fails to render is stored without coverage, so
+	that we don't retry every frame  */
+    if (TTF_GlyphMetrics(font, c, &glyph->minx, &glyph->maxx, 
+			 &glyph->miny, &glyph->maxy, &glyph->advance) == 0)
+    {
+	glyph->coverage = TTF_RenderGlyph_Blended(font, c, white);
+    }
+
+    g_hash_table_insert(display->glyph_atlas, &glyph->key, glyph);
+
+    return glyph;
+}
+
+/*  Measure the advances of a page of codepoints in one font.  Glyphs
+    the font can't measure advance by the cell width.  */
+static Sint16 *BrogueDisplay_measureAdvancePage(
+    BROGUE_DISPLAY *display, int proportional, int page)
+{
+    TTF_Font *font = BrogueDisplay_getFont(display, proportional);
+    Sint16 *advances;
+    int i, advance;
+
+    advances = BrogueDisplay_allocate(
+	display, sizeof(Sint16) * ADVANCE_PAGE_SIZE);
+    if (advances == NULL)
+    {
+	return NULL;
+    }
+
+    for (i = 0; i < ADVANCE_PAGE_SIZE; i++)
+    {
+	Uint16 c = (Uint16)(page * ADVANCE_PAGE_SIZE + i);
+
+	if (font == NULL 
+	    || TTF_GlyphMetrics(font, c, NULL, NULL, NULL, NULL, &advance))
+	{
+	    advance = display->font_width;
+	}
+	advances[i] = (Sint16)advance;
+    }
+
+    return advances;
+}
+
+/*  Get the pixel advance of a character in the current font, by direct
+    lookup in the advance table of its page.  Characters outside the
+    Basic Multilingual Plane are given the cell width.  */
+int BrogueDisplay_getAdvance(
+    BROGUE_DISPLAY *display, int proportional, wchar_t c)
+{
+    Sint16 **page;
+
+    if ((unsigned long)c > 0xFFFF)
+    {
+	return display->font_width;
+    }
+
+    page = &display->advance_pages[proportional ? 1 : 0]
+	[c / ADVANCE_PAGE_SIZE];
+    if (*page == NULL)
+    {
+	*page = BrogueDisplay_measureAdvancePage(
+	    display, proportional, c / ADVANCE_PAGE_SIZE);
+	if (*page == NULL)
+	{
+	    return display->font_width;
+	}
+    }
+
+    return (*page)[c % ADVANCE_PAGE_SIZE];
+}
+
+/*  Retrieve the glyph atlas hit and miss counts  */
+void BrogueDisplay_getGlyphStats(
+    BROGUE_DISPLAY *display, unsigned *hits, unsigned *misses)
+{
+    *hits = display->glyph_hits;
+    *misses = display->glyph_misses;
+}
+
+/*  Allocate memory needed while drawing, counting the allocation so
+    that we can verify steady-state drawing doesn't touch the heap  */
+void *BrogueDisplay_allocate(BROGUE_DISPLAY *display, size_t size)
+{
+    display->alloc_count++;
+
+    return malloc(size);
+}
+
+/*  Get the number of heap allocations made while drawing  */
+unsigned BrogueDisplay_getAllocationCount(BROGUE_DISPLAY *display)
+{
+    return display->alloc_count;
+}
+
+/*  Initialize an empty pool of elements of a particular size  */
+void BroguePool_init(BROGUE_POOL *pool, size_t element_size)
+{
+    memset(pool, 0, sizeof(BROGUE_POOL));
+
+    /*  Each element must be able to hold the free list link, and we 
+	keep elements aligned as malloc would  */
+    if (element_size < sizeof(void *))
+    {
+	element_size = sizeof(void *);
+    }
+    pool->element_size = (element_size + 15) & ~(size_t)15;
+    pool->elements_per_slab = 256;
+}
+
+/*  Free all slabs held by a pool.  Any elements still in use are
+    freed along with them.  */
+void BroguePool_destroy(BROGUE_POOL *pool)
+{
+    void *slab, *next_slab;
+
+    slab = pool->slabs;
+    while (slab != NULL)
+    {
+	next_slab = *(void **)slab;
+	free(slab);
+	slab = next_slab;
+    }
+
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->in_use = 0;
+}
+
+/*  Allocate an element from a pool, growing the pool by a slab when 
+    no free elements remain.  The element is zero-filled.  */
+void *BroguePool_alloc(BROGUE_DISPLAY *display, BROGUE_POOL *pool)
+{
+    void *element;
+    char *slab;
+    int i;
+
+    if (pool->free_list == NULL)
+    {
+	/*  The first 16 bytes of the slab link to the previous slab  */
+	slab = BrogueDisplay_allocate(
+	    display, 16 + pool->element_size * pool->elements_per_slab);
+	if (slab == NULL)
+	{
+	    return NULL;
+	}
+
+	*(void **)slab = pool->slabs;
+	pool->slabs = slab;
+
+	for (i = pool->elements_per_slab - 1; i >= 0; i--)
+	{
+	    element = slab + 16 + pool->element_size * i;
+	    *(void **)element = pool->free_list;
+	    pool->free_list = element;
+	}
+    }
+
+    element = pool->free_list;
+    pool->free_list = *(void **)element;
+    pool->in_use++;
 
-    free(display);
+    memset(element, 0, pool->element_size);
+    return element;
 }
 
-/*  Generate the framebuffer from the current state of the display  */
-void BrogueDisplay_prepareFrame(BROGUE_DISPLAY *display)
+/*  Return an element to the pool from which it was allocated  */
+void BroguePool_free(BROGUE_POOL *pool, void *element)
 {
-    SDL_Surface *surface;
-    int err;
-    SDL_Rect rect;
-    int w, h;
-    int screen_compatible = 1;
+    *(void **)element = pool->free_list;
+    pool->free_list = element;
+    pool->in_use--;
+}
 
-    if (display->screen->format->Rmask != 0x00FF0000
-	|| display->screen->format->Gmask != 0x0000FF00
-	|| display->screen->format->Bmask != 0x000000FF)
+/*  Set the amount of memory the text run cache may use before evicting
+    the least recently used runs  */
+void BrogueDisplay_setTextCacheBudget(BROGUE_DISPLAY *display, size_t bytes)
+{
+    display->text_run_budget = bytes;
+}
+
+/*  Evict least recently used text runs until we are within budget,
+    keeping the most recent run regardless of its size  */
+static void BrogueDisplay_trimTextRuns(BROGUE_DISPLAY *display)
+{
+    while (display->text_run_bytes > display->text_run_budget
+	   && display->text_run_lru.length > 1)
     {
-	screen_compatible = 0;
+	GList *link = g_queue_peek_tail_link(&display->text_run_lru);
+	BROGUE_TEXT_RUN *run = (BROGUE_TEXT_RUN *)link->data;
+
+	g_queue_unlink(&display->text_run_lru, link);
+	g_list_free(link);
+	display->text_run_bytes -= run->bytes;
+	g_hash_table_remove(display->text_runs, run);
     }
+}
 
-    w = display->width * display->font_width;
-    h = display->height * display->font_height;
+/*  Move a text run to the front of the cache, as most recently used  */
+static void BrogueDisplay_touchTextRun(
+    BROGUE_DISPLAY *display, BROGUE_TEXT_RUN *run)
+{
+    g_queue_unlink(&display->text_run_lru, run->link);
+    g_queue_push_head_link(&display->text_run_lru, run->link);
+}
 
-    rect.x = (display->screen->w - w) / 2;
-    rect.y = (display->screen->h - h) / 2;
-    rect.w = w;
-    rect.h = h;
+/*  Find a cached text run, rendered with the given color if has_color
+    is set, or only measured otherwise.  Creates a new, empty run if
+    there is no match.  */
+static BROGUE_TEXT_RUN *BrogueDisplay_findTextRun(
+    BROGUE_DISPLAY *display, int proportional, const Uint16 *text,
+    int has_color, SDL_Color color)
+{
+    BROGUE_TEXT_RUN key, *run;
+    guint hash = 2166136261u;
+    int i, len;
 
-    if (!screen_compatible)
+    for (len = 0; text[len]; len++)
     {
-	surface = SDL_CreateRGBSurface(
-	    0, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0);
-	if (surface == NULL)
-	{
-	    return;
-	}
+	hash = (hash ^ text[len]) * 16777619u;
     }
-    else
+    hash = (hash ^ (proportional ? 1 : 0)) * 16777619u;
+    if (has_color)
     {
-	/*  If the screen surface matches our expected ARGB pixel format,
-	    we can render to it directly rather than rendering to
-	    another surface and converting afterward  */
-	surface = SDL_CreateRGBSurfaceFrom(
-	    display->screen->pixels 
-	    + 4 * rect.x + display->screen->pitch * rect.y, 
-	    w, h, 32, display->screen->pitch,
-	    0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	hash = (hash ^ ((color.r << 16) | (color.g << 8) | color.b)) 
+	    * 16777619u;
+    }
+
+    memset(&key, 0, sizeof(BROGUE_TEXT_RUN));
+    key.hash = hash;
+    key.text = (Uint16 *)text;
+    key.proportional = proportional ? 1 : 0;
+    key.has_color = has_color;
+    key.color = color;
 
-	memset(display->screen->pixels, 0, 
-	       display->screen->pitch * display->screen->h);
+    run = g_hash_table_lookup(display->text_runs, &key);
+    if (run != NULL)
+    {
+	display->text_run_hits++;
+
+	BrogueDisplay_touchTextRun(display, run);
+	return run;
     }
+    display->text_run_misses++;
 
-    err = BrogueWindow_draw(display->root_window, surface);
-    if (err)
+    run = BrogueDisplay_allocate(display, sizeof(BROGUE_TEXT_RUN));
+    if (run == NULL)
     {
-	return;
+	return NULL;
     }
+    *run = key;
 
-    if (!screen_compatible)
+    run->text = BrogueDisplay_allocate(display, sizeof(Uint16) * (len + 1));
+    if (run->text == NULL)
+    {
+	free(run);
+	return NULL;
+    }
+    for (i = 0; i <= len; i++)
     {
-	SDL_BlitSurface(surface, NULL, display->screen, &rect);
+	run->text[i] = text[i];
     }
-    SDL_FreeSurface(surface);
-}
+    run->width = -1;
+    run->bytes = sizeof(BROGUE_TEXT_RUN) + sizeof(Uint16) * (len + 1);
 
-/*  Set the target screen surface  */
-void BrogueDisplay_setScreen(BROGUE_DISPLAY *display, SDL_Surface *screen)
-{
-    display->screen = screen;
+    run->link = g_list_prepend(NULL, run);
+    g_queue_push_head_link(&display->text_run_lru, run->link);
+    g_hash_table_insert(display->text_runs, run, run);
+    display->text_run_bytes += run->bytes;
+
+    return run;
 }
 
-/*  Get one of the fonts associated with the display  */
-TTF_Font *BrogueDisplay_getFont(BROGUE_DISPLAY *display, int proportional)
+/*  Render a run of text, returning a surface owned by the text run cache.
+    The surface remains valid until the next text run is rendered or
+    measured.  */
+SDL_Surface *BrogueDisplay_renderText(
+    BROGUE_DISPLAY *display, int proportional, 
+    const Uint16 *text, SDL_Color color)
 {
-    if (proportional)
+    BROGUE_TEXT_RUN *run, *measured;
+    SDL_Color no_color = { 0, 0, 0, 0 };
+    SDL_Surface *surface;
+
+    run = BrogueDisplay_findTextRun(display, proportional, text, 1, color);
+    if (run == NULL)
     {
-	return display->sans_font;
+	return NULL;
     }
-    else
+
+    if (run->surface == NULL)
     {
-	return display->mono_font;
+	run->surface = TTF_RenderUNICODE_Blended(
+	    BrogueDisplay_getFont(display, proportional), text, color);
+	if (run->surface == NULL)
+	{
+	    return NULL;
+	}
+
+	run->width = run->surface->w;
+	run->height = run->surface->h;
+	run->bytes += run->surface->pitch * run->surface->h;
+	display->text_run_bytes += run->surface->pitch * run->surface->h;
+
+	/*  Keep the rendered size for measuring, so that text which has
+	    been drawn is never shaped again to measure it.  The rendered
+	    run is then made most recent again, so trimming keeps it.  */
+	measured = BrogueDisplay_findTextRun(
+	    display, proportional, text, 0, no_color);
+	if (measured != NULL && measured->width < 0)
+	{
+	    measured->width = run->width;
+	    measured->height = run->height;
+	}
+	BrogueDisplay_touchTextRun(display, run);
     }
-}
 
-/*  Get the current cell size of the display  */
-void BrogueDisplay_getFontSize(BROGUE_DISPLAY *display, 
-			       int *width, int *height)
-{
-    *width = display->font_width;
-    *height = display->font_height;
+    /*  Trimming can't evict this run, as it is the most recent  */
+    surface = run->surface;
+    BrogueDisplay_trimTextRuns(display);
+
+    return surface;
 }
 
-/*  Set the fonts to be used by the display  */
-void BrogueDisplay_setFonts(
-    BROGUE_DISPLAY *display, TTF_Font *mono_font, TTF_Font *sans_font,
-    int font_width, int font_height)
+/*  Measure a run of text as it would be rendered, using the cached
+    measurement if the run has been measured or rendered before  */
+int BrogueDisplay_measureText(
+    BROGUE_DISPLAY *display, int proportional, 
+    const Uint16 *text, int *width, int *height)
 {
-    display->mono_font = mono_font;
-    display->sans_font = sans_font;
-    display->font_width = font_width;
-    display->font_height = font_height;
-    display->font_descent = 0;
+    BROGUE_TEXT_RUN *run;
+    SDL_Color no_color = { 0, 0, 0, 0 };
+    int err;
 
-    if (mono_font != NULL)
+    run = BrogueDisplay_findTextRun(display, proportional, text, 0, no_color);
+    if (run == NULL)
     {
-	display->font_descent = TTF_FontDescent(mono_font);
+	return TTF_SizeUNICODE(BrogueDisplay_getFont(display, proportional), 
+			       text, width, height);
+    }
+
+    if (run->width < 0)
+    {
+	err = TTF_SizeUNICODE(BrogueDisplay_getFont(display, proportional), 
+			      text, &run->width, &run->height);
+	if (err)
+	{
+	    run->width = -1;
+	    return err;
+	}
     }
 
-    if (display->render_glyph != NULL)
+    if (width != NULL)
+    {
+	*width = run->width;
+    }
+    if (height != NULL)
     {
-	SDL_FreeSurface(display->render_glyph);
+	*height = run->height;
     }
-    display->render_glyph = SDL_CreateRGBSurface(
-	0, font_width, font_height, 32,
-	0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+
+    BrogueDisplay_trimTextRuns(display);
+
+    return 0;
 }
 
 /*  Set the tile-set to be used by the display  */
@@ -332,6 +1467,40 @@ void BrogueWindow_clip(BROGUE_WINDOW *window,
     }
 }
 
+/*  Mark a rectangle of cells in the window as needing to be rasterized 
+    on the next frame  */
+void BrogueWindow_damage(
+    BROGUE_WINDOW *window, int x, int y, int width, int height)
+{
+    int i, j;
+
+    BrogueWindow_clip(window, &x, &y, &width, &height);
+
+    for (j = y; j < y + height; j++)
+    {
+	for (i = x; i < x + width; i++)
+	{
+	    window->dirty[j * window->width + i] = 1;
+	}
+    }
+}
+
+/*  Damage the area of the parent covered by a window, for when the 
+    window appears, disappears or moves  */
+static void BrogueWindow_damageArea(BROGUE_WINDOW *window)
+{
+    if (window->parent != NULL)
+    {
+	BrogueWindow_damage(window->parent, 
+			    window->x, window->y, 
+			    window->width, window->height);
+    }
+    else if (window->display != NULL)
+    {
+	BrogueDisplay_damageAll(window->display);
+    }
+}
+
 /*  Open a new subwindow  */
 BROGUE_WINDOW *BrogueWindow_open(
     BROGUE_WINDOW *parent, int x, int y, int width, int height)
@@ -365,10 +1534,20 @@ BROGUE_WINDOW *BrogueWindow_open(
     }
     memset(window->draws, 0, 
 	   sizeof(BROGUE_DEFERRED_DRAW *) * window->width * window->height);
+
+    window->dirty = malloc(window->width * window->height);
+    if (window->dirty == NULL)
+    {
+	free(window->draws);
+	free(window);
+	return NULL;
+    }
+    memset(window->dirty, 0, window->width * window->height);
     
     window->children = g_ptr_array_new();
     if (window->children == NULL)
     {
+	free(window->dirty);
 	free(window->draws);
 	free(window);
 	return NULL;
@@ -378,6 +1557,7 @@ BROGUE_WINDOW *BrogueWindow_open(
     if (window->contexts == NULL)
     {
 	g_ptr_array_unref(window->children);
+	free(window->dirty);
 	free(window->draws);
 	free(window);
     }
@@ -389,6 +1569,7 @@ BROGUE_WINDOW *BrogueWindow_open(
 
 	g_ptr_array_add(parent->children, window);
     }
+    BrogueWindow_damageArea(window);
 
     return window;
 }
@@ -423,10 +1604,19 @@ void BrogueWindow_close(BROGUE_WINDOW *window)
 
     if (window->parent != NULL)
     {
+	if (window->visible)
+	{
+	    BrogueWindow_damageArea(window);
+	}
 	g_ptr_array_remove(window->parent->children, window);
     }
     g_ptr_array_unref(window->children);
     g_ptr_array_unref(window->contexts);
+    if (window->backdrop != NULL)
+    {
+	SDL_FreeSurface(window->backdrop);
+    }
+    free(window->dirty);
     free(window->draws);
     free(window);
 }
@@ -493,49 +1683,309 @@ int BrogueWindow_blurSurface(
 		gc += pix[1];
 		bc += pix[2];
 
-		pix += pix_offset;
-	    }
-	    else
-	    {
-		accum_count--;
-	    }
+		pix += pix_offset;
+	    }
+	    else
+	    {
+		accum_count--;
+	    }
+
+	    if (accum_count < amount)
+	    {
+		accum_count++;
+	    }
+	    else
+	    {
+		rc -= back_pix[0];
+		gc -= back_pix[1];
+		bc -= back_pix[2];
+
+		back_pix += pix_offset;
+	    }
+
+	    blur_pix[0] = rc / accum_count;
+	    blur_pix[1] = gc / accum_count;
+	    blur_pix[2] = bc / accum_count;
+
+	    blur_pix += 4;
+	}
+
+	pix = line_pix;
+	blur_pix = blur_line + amount / 2 * 4;
+
+	for (x = 0; x < blur_axis; x++)
+	{
+	    pix[0] = blur_pix[0];
+	    pix[1] = blur_pix[1];
+	    pix[2] = blur_pix[2];
+
+	    pix += pix_offset;
+	    blur_pix += 4;
+	}
+    }
+    free(blur_line);
+
+    return 0;
+}
+
+#if defined(BLUR_X86_KERNELS)
+
+/*  Fill a table of 15-bit fixed point reciprocals, rounded up, such that
+    ((2 * n) * recip[d]) >> 16 == n / d for any sum of d bytes  */
+static void blurReciprocals(unsigned short *recip, int amount)
+{
+    int d;
+
+    for (d = 1; d <= amount; d++)
+    {
+	recip[d] = (32768 + d - 1) / d;
+    }
+}
+
+/*  Divide eight 16-bit sums by a count, given its reciprocal  */
+__attribute__((target("sse2")))
+static __m128i blurDivideSse2(__m128i sum, __m128i recip)
+{
+    return _mm_mulhi_epu16(_mm_slli_epi16(sum, 1), recip);
+}
+
+/*  
+    Blur each row with a running sum over 'amount' pixels, keeping all
+    four channels of a pixel in the lanes of one register.  This matches
+    the scalar blur exactly, including at the edges, where fewer pixels
+    are averaged.  'line' holds a copy of the row, since the output 
+    overwrites pixels which are still to be subtracted from the sum.
+*/
+__attribute__((target("sse2")))
+static void blurHorizontalSse2(
+    unsigned char *base, int pitch, int w, int h, int amount,
+    unsigned char *line)
+{
+    unsigned short recip[MAX_SIMD_BLUR_AMOUNT + 1];
+    __m128i zero = _mm_setzero_si128();
+    int half = amount / 2;
+    int x, y, k, count;
+
+    blurReciprocals(recip, amount);
+
+    for (y = 0; y < h; y++)
+    {
+	unsigned char *row = base + y * pitch;
+	__m128i sum = zero, d;
+
+	memcpy(line, row, w * 4);
+
+	count = 0;
+	for (k = 0; k < w; k++)
+	{
+	    sum = _mm_add_epi16(sum, _mm_unpacklo_epi8(
+		_mm_cvtsi32_si128(*(int *)(line + k * 4)), zero));
+	    if (k >= amount)
+	    {
+		sum = _mm_sub_epi16(sum, _mm_unpacklo_epi8(
+		    _mm_cvtsi32_si128(*(int *)(line + (k - amount) * 4)), 
+		    zero));
+	    }
+	    else
+	    {
+		count++;
+	    }
+
+	    x = k - half;
+	    if (x >= 0)
+	    {
+		d = blurDivideSse2(sum, _mm_set1_epi16(recip[count]));
+		*(int *)(row + x * 4) = _mm_cvtsi128_si32(
+		    _mm_packus_epi16(d, zero));
+	    }
+	}
+
+	d = blurDivideSse2(sum, _mm_set1_epi16(recip[count]));
+	for (x = w - half; x < w; x++)
+	{
+	    if (x >= 0)
+	    {
+		*(int *)(row + x * 4) = _mm_cvtsi128_si32(
+		    _mm_packus_epi16(d, zero));
+	    }
+	}
+    }
+}
+
+/*  
+    Blur each column with a running sum, walking down the rows so that
+    memory is accessed in order, sixteen channels at a time.  'sums'
+    holds the running sum of each channel in the row, and 'ring' holds 
+    the last 'amount' input rows, to be subtracted as the window moves.
+*/
+__attribute__((target("sse2")))
+static void blurVerticalSse2(
+    unsigned char *base, int pitch, int w, int h, int amount,
+    unsigned char *ring, unsigned short *sums)
+{
+    unsigned short recip[MAX_SIMD_BLUR_AMOUNT + 1];
+    __m128i zero = _mm_setzero_si128();
+    int half = amount / 2;
+    int bytes = w * 4;
+    int vector_bytes = bytes & ~15;
+    int i, x, k, count;
+    __m128i r;
+
+    blurReciprocals(recip, amount);
+    memset(sums, 0, bytes * sizeof(unsigned short));
+
+    count = 0;
+    for (k = 0; k < h + half; k++)
+    {
+	unsigned char *in_row = base + k * pitch;
+	unsigned char *slot = ring + (k % amount) * bytes;
+	unsigned char *out_row;
+
+	if (k < h)
+	{
+	    if (k >= amount)
+	    {
+		for (i = 0; i < vector_bytes; i += 16)
+		{
+		    __m128i old = _mm_loadu_si128((__m128i *)(slot + i));
+		    __m128i *s = (__m128i *)(sums + i);
+
+		    _mm_storeu_si128(s, _mm_sub_epi16(
+			_mm_loadu_si128(s), _mm_unpacklo_epi8(old, zero)));
+		    _mm_storeu_si128(s + 1, _mm_sub_epi16(
+			_mm_loadu_si128(s + 1), _mm_unpackhi_epi8(old, zero)));
+		}
+		for (; i < bytes; i++)
+		{
+		    sums[i] -= slot[i];
+		}
+	    }
+	    else
+	    {
+		count++;
+	    }
+
+	    for (i = 0; i < vector_bytes; i += 16)
+	    {
+		__m128i pix = _mm_loadu_si128((__m128i *)(in_row + i));
+		__m128i *s = (__m128i *)(sums + i);
+
+		_mm_storeu_si128((__m128i *)(slot + i), pix);
+		_mm_storeu_si128(s, _mm_add_epi16(
+		    _mm_loadu_si128(s), _mm_unpacklo_epi8(pix, zero)));
+		_mm_storeu_si128(s + 1, _mm_add_epi16(
+		    _mm_loadu_si128(s + 1), _mm_unpackhi_epi8(pix, zero)));
+	    }
+	    for (; i < bytes; i++)
+	    {
+		slot[i] = in_row[i];
+		sums[i] += in_row[i];
+	    }
+	}
+
+	x = k - half;
+	if (x < 0)
+	{
+	    continue;
+	}
+
+	out_row = base + x * pitch;
+	r = _mm_set1_epi16(recip[count]);
+	for (i = 0; i < vector_bytes; i += 16)
+	{
+	    __m128i *s = (__m128i *)(sums + i);
+
+	    _mm_storeu_si128((__m128i *)(out_row + i), _mm_packus_epi16(
+		blurDivideSse2(_mm_loadu_si128(s), r), 
+		blurDivideSse2(_mm_loadu_si128(s + 1), r)));
+	}
+	for (; i < bytes; i++)
+	{
+	    out_row[i] = ((sums[i] << 1) * recip[count]) >> 16;
+	}
+    }
+}
+
+#endif
+
+/*  Blur a cairo surface along both axes, using the SSE2 kernels when
+    they are available  */
+static int BrogueWindow_blurBothAxes(cairo_surface_t *surface, int amount)
+{
+    int err;
+#if defined(BLUR_X86_KERNELS)
+    int pitch = cairo_image_surface_get_stride(surface);
+    unsigned char *base_pix = cairo_image_surface_get_data(surface);
+    int w = cairo_image_surface_get_width(surface);
+    int h = cairo_image_surface_get_height(surface);
+
+    if (amount <= MAX_SIMD_BLUR_AMOUNT && SDL_HasSSE2())
+    {
+	unsigned char *ring;
+	unsigned short *sums;
+
+	ring = malloc(amount * w * 4);
+	sums = malloc(w * 4 * sizeof(unsigned short));
+	if (ring == NULL || sums == NULL)
+	{
+	    free(ring);
+	    free(sums);
+	    return ENOMEM;
+	}
+
+	blurHorizontalSse2(base_pix, pitch, w, h, amount, ring);
+	blurVerticalSse2(base_pix, pitch, w, h, amount, ring, sums);
+
+	free(ring);
+	free(sums);
 
-	    if (accum_count < amount)
-	    {
-		accum_count++;
-	    }
-	    else
-	    {
-		rc -= back_pix[0];
-		gc -= back_pix[1];
-		bc -= back_pix[2];
+	return 0;
+    }
+#endif
 
-		back_pix += pix_offset;
-	    }
+    err = BrogueWindow_blurSurface(surface, amount, 0);
+    if (!err)
+    {
+	err = BrogueWindow_blurSurface(surface, amount, 1);
+    }
 
-	    blur_pix[0] = rc / accum_count;
-	    blur_pix[1] = gc / accum_count;
-	    blur_pix[2] = bc / accum_count;
+    return err;
+}
 
-	    blur_pix += 4;
-	}
+/*  Keep a copy of a translucent window's background as drawn, to be
+    reused until the windows below it change  */
+static void BrogueWindow_saveBackdrop(
+    BROGUE_WINDOW *window, SDL_Surface *surface)
+{
+    int y;
 
-	pix = line_pix;
-	blur_pix = blur_line + amount / 2 * 4;
+    if (window->backdrop != NULL
+	&& (window->backdrop->w != surface->w 
+	    || window->backdrop->h != surface->h))
+    {
+	SDL_FreeSurface(window->backdrop);
+	window->backdrop = NULL;
+    }
 
-	for (x = 0; x < blur_axis; x++)
+    if (window->backdrop == NULL)
+    {
+	window->backdrop = SDL_CreateRGBSurface(
+	    0, surface->w, surface->h, 32, 
+	    surface->format->Rmask, surface->format->Gmask,
+	    surface->format->Bmask, surface->format->Amask);
+	if (window->backdrop == NULL)
 	{
-	    pix[0] = blur_pix[0];
-	    pix[1] = blur_pix[1];
-	    pix[2] = blur_pix[2];
-
-	    pix += pix_offset;
-	    blur_pix += 4;
+	    return;
 	}
     }
-    free(blur_line);
 
-    return 0;
+    for (y = 0; y < surface->h; y++)
+    {
+	memcpy((char *)window->backdrop->pixels 
+	       + y * window->backdrop->pitch,
+	       (char *)surface->pixels + y * surface->pitch,
+	       surface->w * 4);
+    }
 }
 
 /*  Draw the background, for opaque or translucent windows  */
@@ -556,6 +2006,20 @@ int BrogueWindow_drawBackground(BROGUE_WINDOW *window, SDL_Surface *surface)
 	return 0;
     }
 
+    /*  Nothing below has changed since the background was last drawn  */
+    if (window->backdrop_valid 
+	&& window->backdrop->w == w && window->backdrop->h == h)
+    {
+	for (y = 0; y < h; y++)
+	{
+	    memcpy((char *)surface->pixels + y * surface->pitch,
+		   (char *)window->backdrop->pixels 
+		   + y * window->backdrop->pitch,
+		   w * 4);
+	}
+	return 0;
+    }
+
     blurred_surface = cairo_image_surface_create(
 	CAIRO_FORMAT_RGB24, surface->w, surface->h);
     if (blurred_surface == NULL)
@@ -597,11 +2061,14 @@ int BrogueWindow_drawBackground(BROGUE_WINDOW *window, SDL_Surface *surface)
 	memcpy(cairo_pix, pix, 4 * surface->w);
     }
 
-    /*  Blur the surface in both directions  */
-    err = BrogueWindow_blurSurface(blurred_surface, blur, 0);
-    if (!err)
+    /*  Blur the surface in both directions, unless the window color
+	will cover it entirely  */
+    err = 0;
+    if (a < 256)
     {
-	err = BrogueWindow_blurSurface(blurred_surface, blur, 1);
+	BrogueProfile_begin(BROGUE_PROFILE_BLUR);
+	err = BrogueWindow_blurBothAxes(blurred_surface, blur);
+	BrogueProfile_end(BROGUE_PROFILE_BLUR);
     }
     if (err)
     {
@@ -651,24 +2118,355 @@ int BrogueWindow_drawBackground(BROGUE_WINDOW *window, SDL_Surface *surface)
     cairo_surface_destroy(dst_surface);
     cairo_surface_destroy(blurred_surface);
 
+    if (a < 256)
+    {
+	BrogueWindow_saveBackdrop(window, surface);
+    }
+
+    return 0;
+}
+
+/*  Find the position of the window's upper left corner on the screen  */
+static void BrogueWindow_getScreenPosition(
+    BROGUE_WINDOW *window, int *x, int *y)
+{
+    *x = 0;
+    *y = 0;
+
+    while (window != NULL)
+    {
+	*x += window->x;
+	*y += window->y;
+
+	window = window->parent;
+    }
+}
+
+/*  Rasterize a deferred draw into its cells of a window's surface  */
+static int BrogueWindow_rasterize(
+    BROGUE_WINDOW *window, SDL_Surface *surface, BROGUE_DEFERRED_DRAW *draw,
+    int x, int y, int width, int height)
+{
+    SDL_Surface *draw_surface;
+    void *draw_pixels;
+    int font_width = window->display->font_width;
+    int font_height = window->display->font_height;
+    int err;
+
+    draw_pixels = (char *)surface->pixels 
+	+ y * font_height * surface->pitch
+	+ x * font_width * surface->format->BytesPerPixel;
+    draw_surface = SDL_CreateRGBSurfaceFrom(
+	draw_pixels, 
+	width * font_width, height * font_height,
+	surface->format->BitsPerPixel, surface->pitch,
+	surface->format->Rmask,
+	surface->format->Gmask,
+	surface->format->Bmask,
+	surface->format->Amask);
+    if (draw_surface == NULL)
+    {
+	return ENOMEM;
+    }
+
+    err = BrogueDeferredDraw_draw(window->display, draw, draw_surface);
+    SDL_FreeSurface(draw_surface);
+
+    if (err)
+    {
+	return err;
+    }
+
+    draw->drawn = 1;
+    return 0;
+}
+
+/*  Rasterize bands of queued jobs until none remain unclaimed.  Called
+    with the raster mutex held, which is released while rasterizing.  */
+static void BrogueDisplay_rasterizeBands(BROGUE_DISPLAY *display)
+{
+    BROGUE_RASTER_JOB *job;
+    int band, i, err;
+
+    while (display->raster_next_band < display->raster_band_count)
+    {
+	band = display->raster_next_band++;
+	SDL_UnlockMutex(display->raster_mutex);
+
+	err = 0;
+	for (i = display->raster_band_start[band]; 
+	     i < display->raster_band_start[band + 1] && !err; i++)
+	{
+	    job = &display->raster_jobs[i];
+	    err = BrogueWindow_rasterize(
+		display->raster_window, display->raster_surface, job->draw,
+		job->x, job->y, 1, 1);
+	}
+
+	SDL_LockMutex(display->raster_mutex);
+	if (err)
+	{
+	    display->raster_error = err;
+	}
+    }
+}
+
+/*  The entry point for rasterization worker threads, which wait for
+    a new generation of jobs, and help rasterize them  */
+static int BrogueDisplay_rasterThread(void *data)
+{
+    BROGUE_RASTER_SCRATCH *scratch = (BROGUE_RASTER_SCRATCH *)data;
+    BROGUE_DISPLAY *display = scratch->display;
+    int generation;
+
+    SDL_LockMutex(display->raster_mutex);
+    generation = display->raster_generation;
+    while (!display->raster_quit)
+    {
+	if (generation == display->raster_generation)
+	{
+	    SDL_CondWait(display->raster_work_cond, display->raster_mutex);
+	    continue;
+	}
+	generation = display->raster_generation;
+
+	display->raster_active++;
+	BrogueDisplay_rasterizeBands(display);
+	display->raster_active--;
+
+	if (display->raster_active == 0)
+	{
+	    SDL_CondSignal(display->raster_done_cond);
+	}
+    }
+    SDL_UnlockMutex(display->raster_mutex);
+
+    return 0;
+}
+
+/*  Rasterize the jobs queued for a window, splitting them into bands 
+    of rows shared between the worker threads and the main thread.
+    Jobs cover disjoint cells, so the result doesn't depend on which 
+    thread rasterizes which band.  */
+static int BrogueDisplay_rasterizeJobs(
+    BROGUE_DISPLAY *display, BROGUE_WINDOW *window, SDL_Surface *surface)
+{
+    int band, band_count, rows_per_band, i, err;
+
+    band_count = 4 * (display->raster_thread_count + 1);
+    if (band_count > MAX_RASTER_BANDS)
+    {
+	band_count = MAX_RASTER_BANDS;
+    }
+    if (band_count > window->height)
+    {
+	band_count = window->height;
+    }
+    rows_per_band = (window->height + band_count - 1) / band_count;
+
+    SDL_LockMutex(display->raster_mutex);
+
+    /*  Jobs are queued in row order, so each band is a range of jobs  */
+    i = 0;
+    for (band = 0; band < band_count; band++)
+    {
+	display->raster_band_start[band] = i;
+	while (i < display->raster_job_count
+	       && display->raster_jobs[i].y < (band + 1) * rows_per_band)
+	{
+	    i++;
+	}
+    }
+    display->raster_band_start[band_count] = display->raster_job_count;
+
+    display->raster_window = window;
+    display->raster_surface = surface;
+    display->raster_band_count = band_count;
+    display->raster_next_band = 0;
+    display->raster_error = 0;
+    display->raster_generation++;
+    SDL_CondBroadcast(display->raster_work_cond);
+
+    BrogueDisplay_rasterizeBands(display);
+    while (display->raster_active > 0)
+    {
+	SDL_CondWait(display->raster_done_cond, display->raster_mutex);
+    }
+
+    err = display->raster_error;
+    display->raster_band_count = 0;
+    display->raster_job_count = 0;
+
+    SDL_UnlockMutex(display->raster_mutex);
+
+    return err;
+}
+
+/*  Queue a single cell draw for rasterization by the worker threads  */
+static int BrogueDisplay_queueRasterJob(
+    BROGUE_DISPLAY *display, BROGUE_DEFERRED_DRAW *draw, int x, int y)
+{
+    BROGUE_RASTER_JOB *jobs;
+    int capacity;
+
+    if (display->raster_job_count == display->raster_job_capacity)
+    {
+	capacity = display->raster_job_capacity * 2;
+	if (capacity < 256)
+	{
+	    capacity = 256;
+	}
+
+	jobs = BrogueDisplay_allocate(
+	    display, sizeof(BROGUE_RASTER_JOB) * capacity);
+	if (jobs == NULL)
+	{
+	    return ENOMEM;
+	}
+	memcpy(jobs, display->raster_jobs, 
+	       sizeof(BROGUE_RASTER_JOB) * display->raster_job_count);
+	free(display->raster_jobs);
+
+	display->raster_jobs = jobs;
+	display->raster_job_capacity = capacity;
+    }
+
+    display->raster_jobs[display->raster_job_count].draw = draw;
+    display->raster_jobs[display->raster_job_count].x = x;
+    display->raster_jobs[display->raster_job_count].y = y;
+    display->raster_job_count++;
+
+    return 0;
+}
+
+/*  Set the number of worker threads used to rasterize cells, in 
+    addition to the main thread.  Zero rasterizes on the main thread 
+    only.  */
+int BrogueDisplay_setRasterThreads(BROGUE_DISPLAY *display, int count)
+{
+    BROGUE_RASTER_SCRATCH *scratch;
+    int i;
+
+    if (count < 0 || count > MAX_RASTER_THREADS)
+    {
+	return EINVAL;
+    }
+
+    /*  Stop any running workers before starting the new set  */
+    if (display->raster_thread_count > 0)
+    {
+	SDL_LockMutex(display->raster_mutex);
+	display->raster_quit = 1;
+	SDL_CondBroadcast(display->raster_work_cond);
+	SDL_UnlockMutex(display->raster_mutex);
+
+	for (i = 1; i <= display->raster_thread_count; i++)
+	{
+	    scratch = &display->raster_scratch[i];
+
+	    SDL_WaitThread(scratch->thread, NULL);
+	    BrogueRasterScratch_free(scratch);
+	    memset(scratch, 0, sizeof(BROGUE_RASTER_SCRATCH));
+	}
+
+	display->raster_thread_count = 0;
+	display->raster_quit = 0;
+    }
+
+    if (count == 0)
+    {
+	return 0;
+    }
+
+    if (display->raster_mutex == NULL)
+    {
+	display->raster_mutex = SDL_CreateMutex();
+	display->raster_work_cond = SDL_CreateCond();
+	display->raster_done_cond = SDL_CreateCond();
+	if (display->raster_mutex == NULL 
+	    || display->raster_work_cond == NULL 
+	    || display->raster_done_cond == NULL)
+	{
+	    return ENOMEM;
+	}
+    }
+
+    for (i = 1; i <= count; i++)
+    {
+	scratch = &display->raster_scratch[i];
+	scratch->display = display;
+	BrogueRasterScratch_reset(scratch);
+
+	scratch->thread = SDL_CreateThread(BrogueDisplay_rasterThread, scratch);
+	if (scratch->thread == NULL)
+	{
+	    BrogueRasterScratch_free(scratch);
+	    break;
+	}
+
+	/*  Workers don't look up scratch surfaces until jobs are handed 
+	    to them under the raster mutex, after this is set  */
+	scratch->thread_id = SDL_GetThreadID(scratch->thread);
+	display->raster_thread_count = i;
+    }
+
     return 0;
 }
 
+/*  Get the scratch surfaces belonging to the calling thread  */
+BROGUE_RASTER_SCRATCH *BrogueDisplay_getRasterScratch(
+    BROGUE_DISPLAY *display)
+{
+    Uint32 thread_id;
+    int i;
+
+    if (display->raster_thread_count > 0)
+    {
+	thread_id = SDL_ThreadID();
+	for (i = 1; i <= display->raster_thread_count; i++)
+	{
+	    if (display->raster_scratch[i].thread_id == thread_id)
+	    {
+		return &display->raster_scratch[i];
+	    }
+	}
+    }
+
+    return &display->raster_scratch[0];
+}
+
 /*  Draw the current contents of a window (and children) onto 
-    a target surface  */
+    a target surface.  Only draws which overlap the display's damaged
+    cells are rasterized; the rest of the surface is left untouched.  
+
+    With worker threads, single cell draws which can be prepared are 
+    queued and rasterized in parallel, unless another draw being 
+    rasterized overlaps them, in which case they are drawn in order on 
+    the main thread so that overlapping draws stack as before.  */
 int BrogueWindow_draw(BROGUE_WINDOW *window, SDL_Surface *surface)
 {
+    BROGUE_DISPLAY *display = window->display;
     int i, err;
     int x, y;
     int font_width, font_height;
+    int origin_x, origin_y;
+    int parallel;
 
     if (!window->visible)
     {
 	return 0;
     }
 
-    font_width = window->display->font_width;
-    font_height = window->display->font_height;
+    BrogueWindow_getScreenPosition(window, &origin_x, &origin_y);
+    if (!BrogueDisplay_countDamage(display, origin_x, origin_y, 
+				   window->width, window->height))
+    {
+	return 0;
+    }
+
+    font_width = display->font_width;
+    font_height = display->font_height;
+    parallel = (display->raster_thread_count > 0);
 
     for (i = 0; i < window->width * window->height; i++)
     {
@@ -684,14 +2482,54 @@ int BrogueWindow_draw(BROGUE_WINDOW *window, SDL_Surface *surface)
     {
 	return err;
     }
+
+    /*  Mark the cells covered by draws which must be rasterized on the
+	main thread  */
+    if (parallel)
+    {
+	memset(display->raster_mask, 0, window->width * window->height);
+
+	for (y = 0; y < window->height; y++)
+	{
+	    for (x = 0; x < window->width; x++)
+	    {
+		BROGUE_DEFERRED_DRAW *draw = 
+		    window->draws[y * window->width + x];
+		int dy, x, y, width, height;
+
+		if (draw == NULL || (draw->prepare_func != NULL 
+				     && draw->width == 1 && draw->height == 1))
+		{
+		    continue;
+		}
+
+		x = draw->x;
+		y = draw->y;
+		width = draw->width;
+		height = draw->height;
+		BrogueWindow_clip(window, &x, &y, &width, &height);
+
+		if (!BrogueWindow_countDamage(window, 
+					      origin_x + x, origin_y + y, 
+					      width, height))
+		{
+		    continue;
+		}
+
+		for (dy = y; dy < y + height; dy++)
+		{
+		    memset(display->raster_mask + dy * window->width + x, 
+			   1, width);
+		}
+	    }
+	}
+    }
     
     for (y = 0; y < window->height; y++)
     {
 	for (x = 0; x < window->width; x++)
 	{
 	    BROGUE_DEFERRED_DRAW *draw = window->draws[y * window->width + x];
-	    SDL_Surface *draw_surface;
-	    void *draw_pixels;
 	    int x, y, width, height;
 
 	    if (draw == NULL || draw->drawn)
@@ -704,32 +2542,49 @@ int BrogueWindow_draw(BROGUE_WINDOW *window, SDL_Surface *surface)
 	    width = draw->width;
 	    height = draw->height;
 	    BrogueWindow_clip(window, &x, &y, &width, &height);
-	    
-	    draw_pixels = (char *)surface->pixels 
-		+ y * font_height * surface->pitch
-		+ x * font_width * surface->format->BytesPerPixel;
-	    draw_surface = SDL_CreateRGBSurfaceFrom(
-		draw_pixels, 
-		width * font_width, height * font_height,
-		surface->format->BitsPerPixel, surface->pitch,
-		surface->format->Rmask,
-		surface->format->Gmask,
-		surface->format->Bmask,
-		surface->format->Amask);
-	    if (draw_surface == NULL)
+
+	    if (!BrogueWindow_countDamage(window, 
+					  origin_x + x, origin_y + y, 
+					  width, height))
+	    {
+		continue;
+	    }
+
+	    if (draw->prepare_func != NULL)
 	    {
-		return ENOMEM;
+		err = draw->prepare_func(display, draw->draw_param);
+		if (err)
+		{
+		    return err;
+		}
 	    }
 
-	    err = BrogueDeferredDraw_draw(window->display, draw, draw_surface);
-	    SDL_FreeSurface(draw_surface);
+	    if (parallel && draw->prepare_func != NULL 
+		&& width == 1 && height == 1
+		&& !display->raster_mask[y * window->width + x])
+	    {
+		err = BrogueDisplay_queueRasterJob(display, draw, x, y);
+	    }
+	    else
+	    {
+		err = BrogueWindow_rasterize(
+		    window, surface, draw, x, y, width, height);
+	    }
 
 	    if (err)
 	    {
+		display->raster_job_count = 0;
 		return err;
 	    }
+	}
+    }
 
-	    draw->drawn = 1;
+    if (display->raster_job_count > 0)
+    {
+	err = BrogueDisplay_rasterizeJobs(display, window, surface);
+	if (err)
+	{
+	    return err;
 	}
     }
 
@@ -779,6 +2634,7 @@ int BrogueWindow_reposition(
     BROGUE_WINDOW *window, int x, int y, int width, int height)
 {
     BROGUE_DEFERRED_DRAW **draws;
+    unsigned char *dirty;
 
     BrogueWindow_clip(window->parent, &x, &y, &width, &height);
 
@@ -791,8 +2647,17 @@ int BrogueWindow_reposition(
     memset(draws, 0, 
 	   sizeof(BROGUE_DEFERRED_DRAW *) * width * height);
 
+    dirty = malloc(width * height);
+    if (dirty == NULL)
+    {
+	free(draws);
+	return ENOMEM;
+    }
+    memset(dirty, 0, width * height);
+
     /*  Unreference all deferred draws  */
     BrogueWindow_clear(window);
+    BrogueWindow_damageArea(window);
 
     window->x = x;
     window->y = y;
@@ -801,6 +2666,9 @@ int BrogueWindow_reposition(
 
     free(window->draws);
     window->draws = draws;
+    free(window->dirty);
+    window->dirty = dirty;
+    BrogueWindow_damageArea(window);
 
     return 0;
 }
@@ -808,6 +2676,10 @@ int BrogueWindow_reposition(
 /*  Set the background color  */
 void BrogueWindow_setColor(BROGUE_WINDOW *window, BROGUE_DRAW_COLOR color)
 {
+    if (memcmp(&window->color, &color, sizeof(BROGUE_DRAW_COLOR)) != 0)
+    {
+	BrogueWindow_damageArea(window);
+    }
     window->color = color;
 }
 
@@ -815,6 +2687,10 @@ void BrogueWindow_setColor(BROGUE_WINDOW *window, BROGUE_DRAW_COLOR color)
     using this method  */
 void BrogueWindow_setVisible(BROGUE_WINDOW *window, int visible)
 {
+    if (window->visible != visible)
+    {
+	BrogueWindow_damageArea(window);
+    }
     window->visible = visible;
 }
 
@@ -835,10 +2711,36 @@ void BrogueWindow_replaceCell(
     }
 
     cell = &window->draws[y * window->width + x];
+    if (*cell == NULL && draw == NULL)
+    {
+	return;
+    }
+
+    /*  If the new draw is identical to the old one, keep the old draw,
+	so that the cell isn't damaged and its pixels are left alone  */
+    if (*cell != NULL && draw != NULL && draw->content_hash != 0
+	&& (*cell)->content_hash == draw->content_hash
+	&& (*cell)->draw_func == draw->draw_func
+	&& (*cell)->x == draw->x && (*cell)->y == draw->y
+	&& (*cell)->width == draw->width && (*cell)->height == draw->height)
+    {
+	return;
+    }
+
+    /*  Both the area previously drawn and the newly drawn area must be
+	regenerated with the next frame  */
+    window->dirty[y * window->width + x] = 1;
     if (*cell != NULL)
     {
+	BrogueWindow_damage(window, (*cell)->x, (*cell)->y, 
+			    (*cell)->width, (*cell)->height);
 	BrogueDeferredDraw_unref(*cell);
     }
+    if (draw != NULL)
+    {
+	BrogueWindow_damage(window, draw->x, draw->y, 
+			    draw->width, draw->height);
+    }
     *cell = draw;
     if (*cell != NULL)
     {
@@ -846,6 +2748,38 @@ void BrogueWindow_replaceCell(
     }
 }
 
+/*  Get the deferred draw currently occupying a cell of the window  */
+BROGUE_DEFERRED_DRAW *BrogueWindow_getCell(
+    BROGUE_WINDOW *window, int x, int y)
+{
+    if (x < 0 || y < 0 || x >= window->width || y >= window->height)
+    {
+	return NULL;
+    }
+
+    return window->draws[y * window->width + x];
+}
+
+/*  Mark a cell as needing to be redrawn after its deferred draw has been
+    modified in place, rather than replaced  */
+void BrogueWindow_touchCell(BROGUE_WINDOW *window, int x, int y)
+{
+    BROGUE_DEFERRED_DRAW *draw;
+
+    if (x < 0 || y < 0 || x >= window->width || y >= window->height)
+    {
+	return;
+    }
+
+    window->dirty[y * window->width + x] = 1;
+    draw = window->draws[y * window->width + x];
+    if (draw != NULL)
+    {
+	BrogueWindow_damage(window, draw->x, draw->y, 
+			    draw->width, draw->height);
+    }
+}
+
 /*  Clear all deferred draws from the window  */
 void BrogueWindow_clear(BROGUE_WINDOW *window)
 {
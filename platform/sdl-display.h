@@ -42,10 +42,52 @@
 #include "sdl-svgset.h"
 
 #define FRAME_TIME (1000 / 30)
+#define DEFAULT_TEXT_CACHE_BUDGET (4 * 1024 * 1024)
+#define MAX_RASTER_THREADS 32
+#define MAX_RASTER_BANDS 128
+#define BROGUE_PROFILE_HISTORY 128
+#define ADVANCE_PAGE_SIZE 256
+#define ADVANCE_PAGE_COUNT (0x10000 / ADVANCE_PAGE_SIZE)
 
 typedef struct BROGUE_EFFECT_CLASS BROGUE_EFFECT_CLASS;
 typedef struct BROGUE_DRAW_CONTEXT_STATE BROGUE_DRAW_CONTEXT_STATE;
 typedef struct BROGUE_DEFERRED_DRAW BROGUE_DEFERRED_DRAW;
+typedef struct BROGUE_GLYPH BROGUE_GLYPH;
+typedef struct BROGUE_POOL BROGUE_POOL;
+typedef struct BROGUE_RASTER_SCRATCH BROGUE_RASTER_SCRATCH;
+typedef struct BROGUE_RASTER_JOB BROGUE_RASTER_JOB;
+typedef struct BROGUE_PROFILE_FRAME BROGUE_PROFILE_FRAME;
+
+/*  A pool of fixed-size elements, allocated from the heap in slabs
+    so that short-lived draws can be recycled without calling malloc  */
+struct BROGUE_POOL
+{
+    size_t element_size;
+    int elements_per_slab;
+
+    void *slabs;
+    void *free_list;
+    int in_use;
+};
+
+/*  Surfaces used while rasterizing, one set for each thread which
+    rasterizes cells  */
+struct BROGUE_RASTER_SCRATCH
+{
+    BROGUE_DISPLAY *display;
+    SDL_Thread *thread;
+    Uint32 thread_id;
+
+    SDL_Surface *render_glyph;
+    SDL_Surface *tint;
+};
+
+/*  A single cell draw to be rasterized by the worker threads  */
+struct BROGUE_RASTER_JOB
+{
+    BROGUE_DEFERRED_DRAW *draw;
+    int x, y;
+};
 
 /*  The global display object for the app  */
 struct BROGUE_DISPLAY
@@ -56,11 +98,75 @@ struct BROGUE_DISPLAY
     GHashTable *effect_classes;
 
     SDL_Surface *screen;
-    SDL_Surface *render_glyph;
     TTF_Font *mono_font;
     TTF_Font *sans_font;
     int font_width, font_height, font_descent;
     SDL_SVGSET *svgset;
+
+    /*  Glyphs rendered from the TTF fonts, keyed by codepoint, font
+	and point size  */
+    GHashTable *glyph_atlas;
+    int glyph_point_size;
+    unsigned glyph_hits, glyph_misses;
+
+    /*  Advance widths of the Basic Multilingual Plane in each font,
+	indexed by codepoint.  Pages are measured when first used, and
+	discarded when the fonts change.  */
+    Sint16 *advance_pages[2][ADVANCE_PAGE_COUNT];
+
+    /*  Rendered and measured runs of text, with the least recently used
+	evicted when the memory used exceeds the budget  */
+    GHashTable *text_runs;
+    GQueue text_run_lru;
+    size_t text_run_bytes, text_run_budget;
+    unsigned text_run_hits, text_run_misses;
+
+    /*  Pools for deferred draws and single character parameters, with
+	a count of heap allocations made while drawing  */
+    BROGUE_POOL draw_pool;
+    BROGUE_POOL char_pool;
+    unsigned alloc_count;
+
+    /*  Screen cells which need to be rasterized for the next frame, and
+	the rectangles covering them, to be pushed to the screen  */
+    int full_damage;
+    unsigned char *damage;
+    int damage_rect_count;
+    SDL_Rect *damage_rects;
+    int *damage_columns;
+    int anim_frame;
+    int animated_count;
+
+    /*  Offscreen displays are never pushed to a video device, and may
+	animate by a virtual clock so that frames are reproducible  */
+    int offscreen;
+    int virtual_time_enabled;
+    Uint32 virtual_time;
+
+    /*  For each screen cell, the draw order of the topmost window whose
+	cached backdrop covers it this frame, or zero.  Windows below it
+	needn't rasterize the cell.  */
+    int window_count;
+    unsigned short *backdrop_cover;
+
+    /*  Persistent frame buffer for screens not in our pixel format  */
+    SDL_Surface *frame_surface;
+
+    /*  Worker threads which rasterize single cell draws in bands of 
+	rows.  Scratch zero belongs to the main thread.  */
+    int raster_thread_count;
+    BROGUE_RASTER_SCRATCH raster_scratch[MAX_RASTER_THREADS + 1];
+    SDL_mutex *raster_mutex;
+    SDL_cond *raster_work_cond, *raster_done_cond;
+    int raster_generation, raster_active, raster_quit, raster_error;
+
+    BROGUE_WINDOW *raster_window;
+    SDL_Surface *raster_surface;
+    BROGUE_RASTER_JOB *raster_jobs;
+    int raster_job_count, raster_job_capacity;
+    int raster_band_start[MAX_RASTER_BANDS + 1];
+    int raster_band_count, raster_next_band;
+    unsigned char *raster_mask;
 };
 
 /*  A window of the display  */
@@ -74,9 +180,17 @@ struct BROGUE_WINDOW
     int visible;
     BROGUE_DRAW_COLOR color;
     BROGUE_DEFERRED_DRAW **draws;
+    unsigned char *dirty;
 
     GPtrArray *children;
     GPtrArray *contexts;
+
+    /*  The position of the window in this frame's drawing order, and
+	for translucent windows, the blurred background as last drawn,
+	which remains valid until something below the window changes  */
+    int draw_order;
+    SDL_Surface *backdrop;
+    int backdrop_valid;
 };
 
 /*  The drawing stated embedded in a draw context  */
@@ -117,6 +231,8 @@ struct BROGUE_DRAW_CONTEXT_STATE
 typedef int (*BROGUE_DEFERRED_DRAW_FUNC)(
     BROGUE_DISPLAY *display, void *param, SDL_Surface *surface);
 typedef void (*BROGUE_DEFERRED_FREE_FUNC)(void *param);
+typedef int (*BROGUE_DEFERRED_PREPARE_FUNC)(
+    BROGUE_DISPLAY *display, void *param);
 
 /*  Effect classes have a few associated virtual methods  */
 typedef void *(*BROGUE_EFFECT_NEW_FUNC)(void);
@@ -139,16 +255,46 @@ struct BROGUE_EFFECT_CLASS
     when the frame buffer is refreshed.  */
 struct BROGUE_DEFERRED_DRAW
 {
+    BROGUE_DISPLAY *display;
     BROGUE_WINDOW *window;
     int ref_count;
 
     BROGUE_DEFERRED_DRAW_FUNC draw_func;
     BROGUE_DEFERRED_FREE_FUNC free_func;
     void *draw_param;
+
+    /*  Single cell draws with a prepare function, which is called on
+	the main thread before rasterizing, may be rasterized by worker
+	threads.  Such draws must only use shared state which has been 
+	prepared, and scratch surfaces from BrogueDisplay_getRasterScratch.  */
+    BROGUE_DEFERRED_PREPARE_FUNC prepare_func;
     
     int x, y;
     int width, height;
     int drawn;
+    int is_animated;
+
+    /*  A hash of the draw parameters, or zero if the draw isn't hashed.
+	Replacing a cell with a draw of identical content is skipped.  */
+    guint64 content_hash;
+};
+
+/*  The coverage and metrics of a glyph rendered from a TTF font.  The
+    coverage is rendered in white, so that color can be applied by
+    multiplying into a scratch surface at draw time.  */
+struct BROGUE_GLYPH
+{
+    gint64 key;
+
+    int minx, maxx, miny, maxy, advance;
+    SDL_Surface *coverage;
+};
+
+/*  Milliseconds spent in each profiled stage during one frame  */
+struct BROGUE_PROFILE_FRAME
+{
+    float stage[BROGUE_PROFILE_STAGE_COUNT];
+    float total;
 };
 
 /*  Utility functions exposed by the console  */
@@ -158,15 +304,52 @@ void Sdl_undoPremultipliedAlpha(SDL_Surface *surface);
 
 /*  Exposed internals of the display  */
 int BrogueDisplay_colorToSDL(SDL_Surface *surface, BROGUE_DRAW_COLOR *color);
+int BrogueDisplay_benchmarkBlend(void);
 SDL_Color BrogueDisplay_colorToSDLColor(BROGUE_DRAW_COLOR *color);
 void BrogueDisplay_setScreen(BROGUE_DISPLAY *display, SDL_Surface *screen);
 void BrogueDisplay_prepareFrame(BROGUE_DISPLAY *display);
+void BrogueDisplay_presentFrame(BROGUE_DISPLAY *display);
+int BrogueDisplay_isAnimating(BROGUE_DISPLAY *display);
+int BrogueDisplay_isFrameChanged(BROGUE_DISPLAY *display);
+void BrogueDisplay_setOffscreen(BROGUE_DISPLAY *display, int offscreen);
+void BrogueDisplay_setVirtualTime(BROGUE_DISPLAY *display, Uint32 ticks);
+void BrogueDisplay_setRealTime(BROGUE_DISPLAY *display);
+void BrogueDisplay_damageAll(BROGUE_DISPLAY *display);
 TTF_Font *BrogueDisplay_getFont(BROGUE_DISPLAY *display, int proportional);
 void BrogueDisplay_getFontSize(BROGUE_DISPLAY *display, 
 			       int *width, int *height);
 void BrogueDisplay_setFonts(
     BROGUE_DISPLAY *display, TTF_Font *mono_font, TTF_Font *sans_font,
     int font_width, int font_height);
+void BrogueDisplay_setGlyphPointSize(BROGUE_DISPLAY *display, int point_size);
+void BrogueDisplay_discardGlyphPointSize(
+    BROGUE_DISPLAY *display, int point_size);
+BROGUE_GLYPH *BrogueDisplay_getGlyph(
+    BROGUE_DISPLAY *display, int proportional, wchar_t c);
+int BrogueDisplay_getAdvance(
+    BROGUE_DISPLAY *display, int proportional, wchar_t c);
+BROGUE_GLYPH *BrogueDisplay_findGlyph(
+    BROGUE_DISPLAY *display, int proportional, wchar_t c);
+void BrogueDisplay_getGlyphStats(
+    BROGUE_DISPLAY *display, unsigned *hits, unsigned *misses);
+void *BrogueDisplay_allocate(BROGUE_DISPLAY *display, size_t size);
+unsigned BrogueDisplay_getAllocationCount(BROGUE_DISPLAY *display);
+void BroguePool_init(BROGUE_POOL *pool, size_t element_size);
+void BroguePool_destroy(BROGUE_POOL *pool);
+void *BroguePool_alloc(BROGUE_DISPLAY *display, BROGUE_POOL *pool);
+void BroguePool_free(BROGUE_POOL *pool, void *element);
+void BrogueDisplay_initCharPool(BROGUE_DISPLAY *display);
+int BrogueDisplay_checkTextMeasure(BROGUE_DISPLAY *display);
+int BrogueDisplay_setRasterThreads(BROGUE_DISPLAY *display, int count);
+BROGUE_RASTER_SCRATCH *BrogueDisplay_getRasterScratch(
+    BROGUE_DISPLAY *display);
+void BrogueDisplay_setTextCacheBudget(BROGUE_DISPLAY *display, size_t bytes);
+SDL_Surface *BrogueDisplay_renderText(
+    BROGUE_DISPLAY *display, int proportional, 
+    const Uint16 *text, SDL_Color color);
+int BrogueDisplay_measureText(
+    BROGUE_DISPLAY *display, int proportional, 
+    const Uint16 *text, int *width, int *height);
 void BrogueDisplay_setSvgset(BROGUE_DISPLAY *display, SDL_SVGSET *svgset);
 SDL_SVGSET *BrogueDisplay_getSvgset(BROGUE_DISPLAY *display);
 int BrogueDisplay_registerEffectClass(
@@ -177,6 +360,13 @@ int BrogueDisplay_registerEffectClass(
     BROGUE_EFFECT_SET_PARAM_FUNC set_param_func,
     BROGUE_EFFECT_DRAW_STRING_FUNC draw_string_func);
 
+void BrogueWindow_clip(BROGUE_WINDOW *window,
+		       int *x, int *y, int *width, int *height);
+void BrogueWindow_damage(
+    BROGUE_WINDOW *window, int x, int y, int width, int height);
+BROGUE_DEFERRED_DRAW *BrogueWindow_getCell(
+    BROGUE_WINDOW *window, int x, int y);
+void BrogueWindow_touchCell(BROGUE_WINDOW *window, int x, int y);
 void BrogueWindow_replaceCell(
     BROGUE_WINDOW *window, int x, int y, BROGUE_DEFERRED_DRAW *draw);
 int BrogueWindow_draw(BROGUE_WINDOW *window, SDL_Surface *surface);
@@ -197,6 +387,21 @@ int BrogueDeferredDraw_draw(
 
 void BrogueEffects_registerAll(BROGUE_DISPLAY *display);
 
+void BrogueProfile_enableOverlay(int enable);
+int BrogueProfile_enableRecording(int enable);
+void BrogueProfile_endFrame(void);
+int BrogueProfile_getLastFrame(BROGUE_PROFILE_FRAME *frame);
+void BrogueProfile_getPercentiles(
+    int stage, float *p50, float *p95, float *p99);
+const char *BrogueProfile_getStageName(int stage);
+BROGUE_DRAW_COLOR BrogueProfile_getStageColor(int stage);
+int BrogueProfile_writeCsv(const char *path);
+
+int BrogueExport_open(const char *directory, int interval, int format);
+int BrogueExport_frame(SDL_Surface *screen);
+int BrogueExport_close(void);
+unsigned BrogueExport_getFrameCount(void);
+
 void BrogueGraphic_ref(BROGUE_GRAPHIC *graphic);
 void BrogueGraphic_unref(BROGUE_GRAPHIC *graphic);
 
@@ -24,14 +24,21 @@
 #include <errno.h>
 #include <wchar.h>
 
-#if defined(__MMX__)
-#include <mmintrin.h>
-#endif
-
 #include "Rogue.h"
 
 #include "sdl-display.h"
 
+/*  SIMD blend kernels are compiled for x86 with per-function target
+    attributes, and selected at runtime by CPU feature detection  */
+#if (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#define BLEND_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/*  Substrings up to this length are measured in a buffer on the stack  */
+#define MEASURE_BUFFER_LENGTH 512
+
 typedef struct DEFERRED_CHAR DEFERRED_CHAR;
 typedef struct DEFERRED_STRING DEFERRED_STRING;
 typedef struct DEFERRED_GRAPHIC DEFERRED_GRAPHIC;
@@ -70,6 +77,8 @@ struct BROGUE_GRAPHIC
 /*  A deferred character which will fill a full display cell  */
 struct DEFERRED_CHAR
 {
+    BROGUE_POOL *pool;
+
     wchar_t c;
     int tile;
 
@@ -211,32 +220,364 @@ SDL_Color BrogueDisplay_colorToSDLColor(BROGUE_DRAW_COLOR *color)
     return ret;
 }
 
-/*  Fill a surface with a gradient which is generated by bilinearly 
-    interpolating between four corner color values.  Can take
-    a source surface and multiply it into the gradient, but if 
-    'src' is NULL, it will generate the gradient without multiplying  */
-static void fillBlend(
-    SDL_Surface *dst, SDL_Surface *src, BROGUE_DRAW_COLOR *color)
+/*  A row kernel generates one row of a blended gradient.  The gradient
+    color is 16-bit fixed point, starting at (r, g, b) and advancing by
+    (rpp, gpp, bpp) with each pixel.  'multiply' kernels multiply a 
+    source row by the gradient, keeping the source alpha, while 
+    'gradient' kernels write the gradient, keeping the destination alpha.
+
+    The SIMD kernels must produce output identical to the scalar
+    kernels, which serve as the reference.  */
+typedef void (*BLEND_ROW_FUNC)(
+    unsigned char *pix, const unsigned char *src_pix, int count,
+    int r, int g, int b, int rpp, int gpp, int bpp);
+
+/*  A set of row kernels for a particular instruction set  */
+struct BLEND_KERNEL
+{
+    const char *name;
+    int (*is_supported)(void);
+    BLEND_ROW_FUNC gradient;
+    BLEND_ROW_FUNC multiply;
+};
+typedef struct BLEND_KERNEL BLEND_KERNEL;
+
+/*  The scalar kernels are always available  */
+static int scalarSupported(void)
+{
+    return 1;
+}
+
+/*  Generate a row of gradient without a source  */
+static void blendGradientRowScalar(
+    unsigned char *pix, const unsigned char *src_pix, int count,
+    int r, int g, int b, int rpp, int gpp, int bpp)
+{
+    while (count > 0)
+    {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+	pix[2] = r >> 8;
+	pix[1] = g >> 8;
+	pix[0] = b >> 8;
+#else
+	pix[1] = r >> 8;
+	pix[2] = g >> 8;
+	pix[3] = b >> 8;
+#endif
+
+	r += rpp;
+	g += gpp;
+	b += bpp;
+
+	pix += 4;
+	count--;
+    }
+}
+
+/*  Multiply a row of source pixels by the gradient  */
+static void blendMultiplyRowScalar(
+    unsigned char *pix, const unsigned char *src_pix, int count,
+    int r, int g, int b, int rpp, int gpp, int bpp)
+{
+    while (count > 0)
+    {
+#if SDL_BYTEORDER == SDL_LIL_ENDIAN
+	pix[3] = src_pix[3];
+	pix[2] = (src_pix[2] * r) >> 16;
+	pix[1] = (src_pix[1] * g) >> 16;
+	pix[0] = (src_pix[0] * b) >> 16;
+#else
+	pix[0] = src_pix[0];
+	pix[1] = (src_pix[1] * r) >> 16;
+	pix[2] = (src_pix[2] * g) >> 16;
+	pix[3] = (src_pix[3] * b) >> 16;
+#endif
+
+	r += rpp;
+	g += gpp;
+	b += bpp;
+
+	src_pix += 4;
+	pix += 4;
+	count--;
+    }
+}
+
+#if defined(BLEND_X86_KERNELS)
+
+/*  Fill the four 16-bit lanes of a little-endian ARGB pixel with the 
+    gradient color 'n' pixels into the row.  The gradient stays within
+    0 - 0xFFFF over the row, so the lanes hold it exactly, and 16-bit
+    wrapping addition of the step matches the scalar accumulation.  */
+static void blendPixelLanes(
+    short *lanes, int n, int r, int g, int b, int rpp, int gpp, int bpp)
+{
+    lanes[0] = (short)(b + n * bpp);
+    lanes[1] = (short)(g + n * gpp);
+    lanes[2] = (short)(r + n * rpp);
+    lanes[3] = 0;
+}
+
+/*  SSE2 support, as reported by SDL  */
+static int sse2Supported(void)
+{
+    return SDL_HasSSE2();
+}
+
+/*  Generate a row of gradient four pixels at a time using SSE2  */
+__attribute__((target("sse2")))
+static void blendGradientRowSse2(
+    unsigned char *pix, const unsigned char *src_pix, int count,
+    int r, int g, int b, int rpp, int gpp, int bpp)
 {
-    int x, y;
+    short lanes[8];
+    __m128i color_lo, color_hi, step, alpha_mask, old_pix, result;
+    int done = 0;
+
+    blendPixelLanes(lanes, 0, r, g, b, rpp, gpp, bpp);
+    blendPixelLanes(lanes + 4, 1, r, g, b, rpp, gpp, bpp);
+    color_lo = _mm_loadu_si128((__m128i *)lanes);
+    blendPixelLanes(lanes, 2, r, g, b, rpp, gpp, bpp);
+    blendPixelLanes(lanes + 4, 3, r, g, b, rpp, gpp, bpp);
+    color_hi = _mm_loadu_si128((__m128i *)lanes);
+    blendPixelLanes(lanes, 4, 0, 0, 0, rpp, gpp, bpp);
+    blendPixelLanes(lanes + 4, 4, 0, 0, 0, rpp, gpp, bpp);
+    step = _mm_loadu_si128((__m128i *)lanes);
+    alpha_mask = _mm_set1_epi32(0xFF000000);
+
+    while (count - done >= 4)
+    {
+	old_pix = _mm_loadu_si128((__m128i *)pix);
+	result = _mm_packus_epi16(
+	    _mm_srli_epi16(color_lo, 8), _mm_srli_epi16(color_hi, 8));
+	result = _mm_or_si128(_mm_andnot_si128(alpha_mask, result),
+			      _mm_and_si128(alpha_mask, old_pix));
+	_mm_storeu_si128((__m128i *)pix, result);
+
+	color_lo = _mm_add_epi16(color_lo, step);
+	color_hi = _mm_add_epi16(color_hi, step);
+	pix += 16;
+	done += 4;
+    }
+
+    blendGradientRowScalar(pix, NULL, count - done, 
+			   r + done * rpp, g + done * gpp, b + done * bpp, 
+			   rpp, gpp, bpp);
+}
+
+/*  Multiply a row of source pixels four at a time using SSE2  */
+__attribute__((target("sse2")))
+static void blendMultiplyRowSse2(
+    unsigned char *pix, const unsigned char *src_pix, int count,
+    int r, int g, int b, int rpp, int gpp, int bpp)
+{
+    short lanes[8];
+    __m128i color_lo, color_hi, step, alpha_mask, zero, src, lo, hi, result;
+    int done = 0;
+
+    blendPixelLanes(lanes, 0, r, g, b, rpp, gpp, bpp);
+    blendPixelLanes(lanes + 4, 1, r, g, b, rpp, gpp, bpp);
+    color_lo = _mm_loadu_si128((__m128i *)lanes);
+    blendPixelLanes(lanes, 2, r, g, b, rpp, gpp, bpp);
+    blendPixelLanes(lanes + 4, 3, r, g, b, rpp, gpp, bpp);
+    color_hi = _mm_loadu_si128((__m128i *)lanes);
+    blendPixelLanes(lanes, 4, 0, 0, 0, rpp, gpp, bpp);
+    blendPixelLanes(lanes + 4, 4, 0, 0, 0, rpp, gpp, bpp);
+    step = _mm_loadu_si128((__m128i *)lanes);
+    alpha_mask = _mm_set1_epi32(0xFF000000);
+    zero = _mm_setzero_si128();
+
+    while (count - done >= 4)
+    {
+	src = _mm_loadu_si128((__m128i *)src_pix);
+
+	/*  (src * color) >> 16 is exactly the high half of the 
+	    unsigned 16-bit product  */
+	lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(src, zero), color_lo);
+	hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(src, zero), color_hi);
+	result = _mm_packus_epi16(lo, hi);
+	result = _mm_or_si128(_mm_andnot_si128(alpha_mask, result),
+			      _mm_and_si128(alpha_mask, src));
+	_mm_storeu_si128((__m128i *)pix, result);
+
+	color_lo = _mm_add_epi16(color_lo, step);
+	color_hi = _mm_add_epi16(color_hi, step);
+	src_pix += 16;
+	pix += 16;
+	done += 4;
+    }
+
+    blendMultiplyRowScalar(pix, src_pix, count - done, 
+			   r + done * rpp, g + done * gpp, b + done * bpp, 
+			   rpp, gpp, bpp);
+}
+
+/*  AVX2 support, including operating system support for saving the
+    wider registers  */
+static int avx2Supported(void)
+{
+    __builtin_cpu_init();
+
+    return __builtin_cpu_supports("avx2");
+}
+
+/*  Load the gradient colors for eight pixels into the layout used by
+    AVX2 byte unpacking, which works within 128-bit halves:  the 'lo' 
+    registers hold pixels 0, 1, 4, 5 and the 'hi' registers 2, 3, 6, 7  */
+__attribute__((target("avx2")))
+static void blendLoadAvx2Colors(
+    __m256i *color_lo, __m256i *color_hi, __m256i *step,
+    int r, int g, int b, int rpp, int gpp, int bpp)
+{
+    short lanes[16];
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+	blendPixelLanes(lanes + i * 4, (i & 1) + (i & 2) * 2, 
+			r, g, b, rpp, gpp, bpp);
+    }
+    *color_lo = _mm256_loadu_si256((__m256i *)lanes);
+    for (i = 0; i < 4; i++)
+    {
+	blendPixelLanes(lanes + i * 4, 2 + (i & 1) + (i & 2) * 2, 
+			r, g, b, rpp, gpp, bpp);
+    }
+    *color_hi = _mm256_loadu_si256((__m256i *)lanes);
+    for (i = 0; i < 4; i++)
+    {
+	blendPixelLanes(lanes + i * 4, 8, 0, 0, 0, rpp, gpp, bpp);
+    }
+    *step = _mm256_loadu_si256((__m256i *)lanes);
+}
+
+/*  Generate a row of gradient eight pixels at a time using AVX2  */
+__attribute__((target("avx2")))
+static void blendGradientRowAvx2(
+    unsigned char *pix, const unsigned char *src_pix, int count,
+    int r, int g, int b, int rpp, int gpp, int bpp)
+{
+    __m256i color_lo, color_hi, step, alpha_mask, old_pix, result;
+    int done = 0;
+
+    blendLoadAvx2Colors(&color_lo, &color_hi, &step, 
+			r, g, b, rpp, gpp, bpp);
+    alpha_mask = _mm256_set1_epi32(0xFF000000);
+
+    while (count - done >= 8)
+    {
+	old_pix = _mm256_loadu_si256((__m256i *)pix);
+	result = _mm256_packus_epi16(
+	    _mm256_srli_epi16(color_lo, 8), _mm256_srli_epi16(color_hi, 8));
+	result = _mm256_blendv_epi8(result, old_pix, alpha_mask);
+	_mm256_storeu_si256((__m256i *)pix, result);
+
+	color_lo = _mm256_add_epi16(color_lo, step);
+	color_hi = _mm256_add_epi16(color_hi, step);
+	pix += 32;
+	done += 8;
+    }
+
+    /*  Finish with the narrower kernel  */
+    blendGradientRowSse2(pix, NULL, count - done, 
+			 r + done * rpp, g + done * gpp, b + done * bpp, 
+			 rpp, gpp, bpp);
+}
+
+/*  Multiply a row of source pixels eight at a time using AVX2  */
+__attribute__((target("avx2")))
+static void blendMultiplyRowAvx2(
+    unsigned char *pix, const unsigned char *src_pix, int count,
+    int r, int g, int b, int rpp, int gpp, int bpp)
+{
+    __m256i color_lo, color_hi, step, alpha_mask, zero, src, lo, hi, result;
+    int done = 0;
+
+    blendLoadAvx2Colors(&color_lo, &color_hi, &step, 
+			r, g, b, rpp, gpp, bpp);
+    alpha_mask = _mm256_set1_epi32(0xFF000000);
+    zero = _mm256_setzero_si256();
+
+    while (count - done >= 8)
+    {
+	src = _mm256_loadu_si256((__m256i *)src_pix);
+
+	lo = _mm256_mulhi_epu16(_mm256_unpacklo_epi8(src, zero), color_lo);
+	hi = _mm256_mulhi_epu16(_mm256_unpackhi_epi8(src, zero), color_hi);
+	result = _mm256_packus_epi16(lo, hi);
+	result = _mm256_blendv_epi8(result, src, alpha_mask);
+	_mm256_storeu_si256((__m256i *)pix, result);
+
+	color_lo = _mm256_add_epi16(color_lo, step);
+	color_hi = _mm256_add_epi16(color_hi, step);
+	src_pix += 32;
+	pix += 32;
+	done += 8;
+    }
+
+    blendMultiplyRowSse2(pix, src_pix, count - done, 
+			 r + done * rpp, g + done * gpp, b + done * bpp, 
+			 rpp, gpp, bpp);
+}
+
+#endif
+
+/*  Available kernels, in increasing order of preference  */
+static BLEND_KERNEL blendKernels[] = 
+{
+    { "scalar", scalarSupported, 
+      blendGradientRowScalar, blendMultiplyRowScalar },
+#if defined(BLEND_X86_KERNELS)
+    { "sse2", sse2Supported, blendGradientRowSse2, blendMultiplyRowSse2 },
+    { "avx2", avx2Supported, blendGradientRowAvx2, blendMultiplyRowAvx2 },
+#endif
+};
+#define BLEND_KERNEL_COUNT (sizeof(blendKernels) / sizeof(BLEND_KERNEL))
+
+/*  The kernel selected by CPU feature detection  */
+static BLEND_KERNEL *blendKernel = NULL;
+
+/*  Select the fastest blend kernel supported by the CPU  */
+static BLEND_KERNEL *selectBlendKernel(void)
+{
+    int i;
+
+    if (blendKernel == NULL)
+    {
+	blendKernel = &blendKernels[0];
+	for (i = 1; i < BLEND_KERNEL_COUNT; i++)
+	{
+	    if (blendKernels[i].is_supported())
+	    {
+		blendKernel = &blendKernels[i];
+	    }
+	}
+    }
+
+    return blendKernel;
+}
+
+/*  Fill the upper left w by h pixels of a surface with a gradient 
+    which is generated by bilinearly interpolating between four corner 
+    color values, using a particular set of row kernels.  */
+static void fillBlendWithKernel(
+    BLEND_KERNEL *kernel, SDL_Surface *dst, SDL_Surface *src, 
+    int w, int h, BROGUE_DRAW_COLOR *color)
+{
+    int y;
     int lr, lg, lb, rr, rg, rb;
     int ldr, ldg, ldb, rdr, rdg, rdb;
-    int w, h;
     BROGUE_DRAW_COLOR ul = color[0];
     BROGUE_DRAW_COLOR ur = color[1];
     BROGUE_DRAW_COLOR bl = color[2];
     BROGUE_DRAW_COLOR br = color[3];
-#if defined(__MMX__)
-    int mmx = SDL_HasMMX();
-#endif
-    
-    w = dst->w;
-    h = dst->h;
 
+    assert(dst->w >= w);
+    assert(dst->h >= h);
     if (src != NULL)
     {
-	assert(dst->w == src->w);
-	assert(dst->h == src->h);
+	assert(src->w == w);
+	assert(src->h == h);
     }
 
     lr = clamp(ul.red * 0xFFFF, 0, 0xFFFF);
@@ -258,22 +599,26 @@ static void fillBlend(
     for (y = 0; y < h; y++)
     {
 	unsigned char *pix;
-	int dr, dg, db;
-	int rpp, gpp, bpp, raccum, gaccum, baccum;
+	int rpp, gpp, bpp;
 
 	pix = (unsigned char *)dst->pixels + dst->pitch * y;
 
-	dr = rr - lr;
-	dg = rg - lg;
-	db = rb - lb;
+	rpp = (rr - lr) / w;
+	gpp = (rg - lg) / w;
+	bpp = (rb - lb) / w;
 
-	rpp = dr / w;
-	gpp = dg / w;
-	bpp = db / w;
+	if (src != NULL)
+	{
+	    unsigned char *src_pix = (unsigned char *)src->pixels 
+		+ src->pitch * y;
 
-	raccum = lr;
-	gaccum = lg;
-	baccum = lb;
+	    kernel->multiply(pix, src_pix, w, lr, lg, lb, rpp, gpp, bpp);
+	}
+	else
+	{
+	    /*  If no source surface, we'll just generate the gradient  */
+	    kernel->gradient(pix, NULL, w, lr, lg, lb, rpp, gpp, bpp);
+	}
 
 	lr += ldr;
 	lg += ldg;
@@ -282,194 +627,197 @@ static void fillBlend(
 	rr += rdr;
 	rg += rdg;
 	rb += rdb;
+    }
+}
 
-	if (src != NULL)
-	{
-	    unsigned char *src_pix = (unsigned char *)src->pixels 
-		+ src->pitch * y;
-	    x = w;
+/*  Fill a surface with a gradient which is generated by bilinearly 
+    interpolating between four corner color values.  Can take
+    a source surface and multiply it into the gradient, but if 
+    'src' is NULL, it will generate the gradient without multiplying  */
+static void fillBlend(
+    SDL_Surface *dst, SDL_Surface *src, BROGUE_DRAW_COLOR *color)
+{
+    if (src != NULL)
+    {
+	assert(dst->w == src->w);
+	assert(dst->h == src->h);
+    }
 
-#if defined(__MMX__)
-	    /*  MMX is significantly faster.  Use it if the CPU supports it  */
-	    if (mmx)
-	    {
-		__m64 mmx_zero = _m_from_int(0);
-
-		long long ll_color = 
-		    ((long long)0xFFFF << 48)
-		    | ((long long)raccum << 32)
-		    | ((long long)gaccum << 16)
-		    | ((long long)baccum);
-		__m64 mmx_color = *(__m64 *)&ll_color;
-
-		long long ll_pp = 
-		    ((long long)(rpp & 0xFFFF) << 32)
-		    | ((long long)(gpp & 0xFFFF) << 16)
-		    | ((long long)(bpp & 0xFFFF));
-		__m64 mmx_pp = *(__m64 *)&ll_pp;
-
-		while (x >= 2)
-		{
-		    __m64 src_pair = *(__m64 *)src_pix;
-		
-		    /*  Separate the left pixel and right pixel  */
-		    __m64 left_pix = _mm_unpacklo_pi8(src_pair, mmx_zero);
-		    __m64 right_pix = _mm_unpackhi_pi8(src_pair, mmx_zero);
-		
-		    /*  Multiply the left source by the gradient color  */
-		    left_pix = _mm_mullo_pi16(left_pix, 
-					      _mm_srli_pi16(mmx_color, 8));
-		    /*  Advance the gradient color for the next pixel */
-		    mmx_color = _mm_add_pi16(mmx_color, mmx_pp);
-
-		    /*  Multiply the right source by the gradient color  */
-		    right_pix = _mm_mullo_pi16(right_pix,
-					       _mm_srli_pi16(mmx_color, 8));
-		    /*  Advance the gradient  */
-		    mmx_color = _mm_add_pi16(mmx_color, mmx_pp); 
-
-		    /*  Recombine the pixels  */
-		    __m64 result_pix = _mm_packs_pu16(
-			_mm_srli_pi16(left_pix, 8),
-			_mm_srli_pi16(right_pix, 8));
-		    
-		    *(__m64 *)pix = result_pix;
-
-		    src_pix += 8;
-		    pix += 8;
-		    x -= 2;
-		}
+    fillBlendWithKernel(selectBlendKernel(), dst, src, dst->w, dst->h, color);
+}
 
-		/*  Extract the accumulated gradient value for the potential
-		    odd remaining pixel  */
-		short *s_color = (short *)&mmx_color;
-		raccum = s_color[2];
-		gaccum = s_color[1];
-		baccum = s_color[0];
-	    }
-#endif
+/*  Multiply a source surface into the gradient, writing the result to
+    the upper left of a destination surface at least as large  */
+static void fillBlendInto(
+    SDL_Surface *dst, SDL_Surface *src, BROGUE_DRAW_COLOR *color)
+{
+    fillBlendWithKernel(selectBlendKernel(), dst, src, src->w, src->h, color);
+}
 
-	    /*  The equivalent slow loop for odd pixels or CPUs without MMX  */
-	    while (x > 0)
-	    {
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-		pix[3] = src_pix[3];
-		pix[2] = (src_pix[2] * raccum) >> 16;
-		pix[1] = (src_pix[1] * gaccum) >> 16;
-		pix[0] = (src_pix[0] * baccum) >> 16;
-#else
-		pix[0] = src_pix[0];
-		pix[1] = (src_pix[1] * raccum) >> 16;
-		pix[2] = (src_pix[2] * gaccum) >> 16;
-		pix[3] = (src_pix[3] * baccum) >> 16;
-#endif
+/*  Measure the throughput of each blend kernel supported by the CPU
+    at common cell sizes, checking that each kernel's output matches
+    the scalar kernel.  Returns non-zero if any kernel mismatches.  */
+int BrogueDisplay_benchmarkBlend(void)
+{
+    static const int sizes[][2] = 
+	{ { 8, 16 }, { 10, 20 }, { 12, 24 }, { 16, 32 }, { 24, 48 } };
+    BROGUE_DRAW_COLOR colors[4] = 
+    {
+	{ 1.0, 0.5, 0.25, 1.0 }, { 0.1, 0.9, 0.3, 1.0 },
+	{ 0.0, 0.2, 1.0, 1.0 }, { 0.7, 0.7, 0.0, 1.0 }
+    };
+    SDL_Surface *src, *dst, *reference;
+    int s, k, i, y, iterations, multiply, mismatch = 0;
+    unsigned start, elapsed;
 
-		raccum += rpp;
-		gaccum += gpp;
-		baccum += bpp;
+    if (!SDL_WasInit(SDL_INIT_TIMER) && SDL_Init(SDL_INIT_TIMER))
+    {
+	return 1;
+    }
 
-		src_pix += 4;
-		pix += 4;
-		x--;
-	    }
+    printf("%-8s %-8s %-8s %16s\n", "size", "kernel", "mode", "pixels/s");
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+	int w = sizes[s][0], h = sizes[s][1];
+
+	src = SDL_CreateRGBSurface(0, w, h, 32, 0x00FF0000, 0x0000FF00, 
+				   0x000000FF, 0xFF000000);
+	dst = SDL_CreateRGBSurface(0, w, h, 32, 0x00FF0000, 0x0000FF00, 
+				   0x000000FF, 0xFF000000);
+	reference = SDL_CreateRGBSurface(0, w, h, 32, 0x00FF0000, 
+					 0x0000FF00, 0x000000FF, 0xFF000000);
+	if (src == NULL || dst == NULL || reference == NULL)
+	{
+	    return 1;
 	}
-	else
+
+	for (i = 0; i < src->pitch * h; i++)
 	{
-	    /*  If no source surface, we'll just generate the gradient  */
-	    x = w;
+	    ((unsigned char *)src->pixels)[i] = (i * 37) & 0xFF;
+	}
+
+	for (multiply = 0; multiply < 2; multiply++)
+	{
+	    memset(reference->pixels, 0x5A, reference->pitch * h);
+	    fillBlendWithKernel(&blendKernels[0], reference, 
+				multiply ? src : NULL, w, h, colors);
 
-#if defined(__MMX__)
-	    /*  MMX is significantly faster.  Use it if the CPU supports it  */
-	    if (mmx)
+	    for (k = 0; k < BLEND_KERNEL_COUNT; k++)
 	    {
-		long long ll_color = 
-		    ((long long)0xFFFF << 48)
-		    | ((long long)raccum << 32)
-		    | ((long long)gaccum << 16)
-		    | ((long long)baccum);
-		__m64 mmx_color = *(__m64 *)&ll_color;
-
-		long long ll_pp = 
-		    ((long long)(rpp & 0xFFFF) << 32)
-		    | ((long long)(gpp & 0xFFFF) << 16)
-		    | ((long long)(bpp & 0xFFFF));
-		__m64 mmx_pp = *(__m64 *)&ll_pp;
-
-		while (x >= 2)
+		if (!blendKernels[k].is_supported())
+		{
+		    continue;
+		}
+
+		memset(dst->pixels, 0x5A, dst->pitch * h);
+		fillBlendWithKernel(&blendKernels[k], dst, 
+				    multiply ? src : NULL, w, h, colors);
+		for (y = 0; y < h; y++)
 		{
-		    /*  Store the left pixel  */
-		    __m64 left_pix = _mm_srli_pi16(mmx_color, 8);
-		    /*  Advance the gradient  */
-		    mmx_color = _mm_add_pi16(mmx_color, mmx_pp);
-		    /*  Store the right pixel  */
-		    __m64 right_pix = _mm_srli_pi16(mmx_color, 8);
-		    /*  Advance the gradient  */
-		    mmx_color = _mm_add_pi16(mmx_color, mmx_pp); 
-
-		    /*  Recombine the pixels  */
-		    __m64 result_pix = _mm_packs_pu16(left_pix, right_pix);
-
-		    *(__m64 *)pix = result_pix;
-		    
-		    pix += 8;
-		    x -= 2;
+		    if (memcmp((char *)dst->pixels + y * dst->pitch,
+			       (char *)reference->pixels + y * reference->pitch,
+			       w * 4))
+		    {
+			printf("%s kernel output differs from scalar "
+			       "at %dx%d\n", blendKernels[k].name, w, h);
+			mismatch = 1;
+			break;
+		    }
 		}
 
-		/*  Extract the accumulated gradient value for the potential
-		    odd remaining pixel  */
-		short *s_color = (short *)&mmx_color;
-		raccum = s_color[2];
-		gaccum = s_color[1];
-		baccum = s_color[0];
+		/*  Run for at least half a second to get a usable 
+		    measurement from millisecond ticks  */
+		iterations = 0;
+		start = SDL_GetTicks();
+		do
+		{
+		    for (i = 0; i < 1000; i++)
+		    {
+			fillBlendWithKernel(&blendKernels[k], dst, 
+					    multiply ? src : NULL, w, h, colors);
+		    }
+		    iterations += 1000;
+		    elapsed = SDL_GetTicks() - start;
+		} while (elapsed < 500);
+
+		printf("%3dx%-4d %-8s %-8s %16.0f\n", w, h, 
+		       blendKernels[k].name, multiply ? "multiply" : "gradient",
+		       (double)iterations * w * h * 1000.0 / elapsed);
 	    }
-#endif
+	}
 
-	    /*  The slow loop for odd pixels or MMU-less CPUs  */
-	    while (x > 0)
-	    {
-#if SDL_BYTEORDER == SDL_LIL_ENDIAN
-		pix[2] = raccum >> 8;
-		pix[1] = gaccum >> 8;
-		pix[0] = baccum >> 8;
-#else
-		pix[1] = raccum >> 8;
-		pix[2] = gaccum >> 8;
-		pix[3] = baccum >> 8;
-#endif
+	SDL_FreeSurface(src);
+	SDL_FreeSurface(dst);
+	SDL_FreeSurface(reference);
+    }
 
-		raccum += rpp;
-		gaccum += gpp;
-		baccum += bpp;
+    return mismatch;
+}
 
-		x--;
-		pix += 4;
-	    }
-	}
+/*  Grow the scratch surface used for coloring glyphs as needed  */
+static int growScratchTint(BROGUE_RASTER_SCRATCH *scratch, int w, int h)
+{
+    if (scratch->tint != NULL 
+	&& scratch->tint->w >= w && scratch->tint->h >= h)
+    {
+	return 0;
     }
 
-#if defined(__MMX__)
-    /*  Empty the MMX state to avoid interfering with future FPU results  */
-    if (mmx)
+    if (scratch->tint != NULL)
     {
-	_mm_empty();
+	w = max(w, scratch->tint->w);
+	h = max(h, scratch->tint->h);
+	SDL_FreeSurface(scratch->tint);
     }
-#endif
+
+    scratch->tint = SDL_CreateRGBSurface(
+	0, w, h, 32, 0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+    if (scratch->tint == NULL)
+    {
+	return ENOMEM;
+    }
+
+    return 0;
 }
 
-/*  Just-in-time rendering of a character filling a full cell  */
-static int deferredChar(
+/*  Copy a tinted glyph shared through the svgset's cache into the
+    scratch surface, so that it can be blitted without touching the
+    shared surface's blit map, which SDL rewrites for each destination  */
+static int copyToScratchTint(BROGUE_RASTER_SCRATCH *scratch, 
+			     SDL_Surface *glyph)
+{
+    int y, err;
+
+    err = growScratchTint(scratch, glyph->w, glyph->h);
+    if (err)
+    {
+	return err;
+    }
+
+    for (y = 0; y < glyph->h; y++)
+    {
+	memcpy((Uint8 *)scratch->tint->pixels + y * scratch->tint->pitch,
+	       (Uint8 *)glyph->pixels + y * glyph->pitch,
+	       glyph->w * sizeof(Uint32));
+    }
+
+    return 0;
+}
+
+/*  Rasterize a character filling a full cell  */
+static int rasterizeChar(
     BROGUE_DISPLAY *display, void *data, SDL_Surface *surface)
 {
     DEFERRED_CHAR *param = (DEFERRED_CHAR *)data;
     wchar_t c = param->c;
     int tile = param->tile;
-    int need_free_glyph = 0;
-    int err;
     BROGUE_DRAW_COLOR fg = param->foreground;
     SDL_Color sdl_fg = { 255, 255, 255, 255 };
     SDL_Rect rect = { 0, 0, surface->w, surface->h };
+    SDL_Rect glyph_rect = { 0, 0, 0, 0 };
     SDL_Surface *glyph;
-    int bg_color;
+    BROGUE_RASTER_SCRATCH *scratch = BrogueDisplay_getRasterScratch(display);
+    int bg_color, err;
 
     if (param->is_background_blended)
     {
@@ -489,86 +837,169 @@ static int deferredChar(
     glyph = NULL;
     if (tile)
     {
-	int frame = SDL_GetTicks() / FRAME_TIME;
+	int frame = display->anim_frame;
 
 	if (param->is_foreground_blended)
 	{
-	    /*  We'll use a 'render_glyph' rather than allocating a 
+	    /*  We'll use a scratch 'render_glyph' rather than allocating a 
 		new surface for the common case for the dungeon grid
 	        where the foreground is gradient blended.  */
 	    glyph = SdlSvgset_getGlyph(display->svgset, c, frame);
-	    fillBlend(display->render_glyph, glyph, param->blended_foreground);
-	    glyph = display->render_glyph;
+	    if (glyph != NULL)
+	    {
+		fillBlend(scratch->render_glyph, glyph, 
+			  param->blended_foreground);
+		glyph = scratch->render_glyph;
+	    }
 	}
 	else
 	{
-	    glyph = SdlSvgset_render(display->svgset, 
-				     c, frame, sdl_fg);
-	    need_free_glyph = 1;
+	    SDL_Surface *tint = SdlSvgset_render(display->svgset, 
+						 c, frame, sdl_fg);
+
+	    /*  The tint may be in use by other raster threads at once,
+		so it is never blitted directly  */
+	    if (tint != NULL)
+	    {
+		err = copyToScratchTint(scratch, tint);
+		glyph_rect.w = tint->w;
+		glyph_rect.h = tint->h;
+		SdlSvgset_releaseGlyph(display->svgset, tint);
+		if (err)
+		{
+		    return err;
+		}
+		glyph = scratch->tint;
+	    }
 	}
     }
 
     if (glyph == NULL)
     {
-	TTF_Font *font = display->mono_font;
-	int minx, maxx, miny, maxy;
+	BROGUE_GLYPH *cached;
+	BROGUE_DRAW_COLOR solid[4] = { fg, fg, fg, fg };
 
-	glyph = TTF_RenderGlyph_Blended(font, c, sdl_fg);
-	if (glyph == NULL)
+	/*  The glyph was rendered when the draw was prepared  */
+	cached = BrogueDisplay_findGlyph(display, 0, c);
+	if (cached == NULL || cached->coverage == NULL)
 	{
 	    return EINVAL;
 	}
 
-	need_free_glyph = 1;
-	err = TTF_GlyphMetrics(font, c,
-			       &minx, &maxx, &miny, &maxy, NULL);
+	/*  Center the glyph horizontally, adjust for descenders vertically. */
+	rect.x += (display->font_width - cached->maxx + cached->minx) / 2;
+	rect.y += (display->font_height - cached->maxy) + 
+	    display->font_descent - 1;
+
+	err = growScratchTint(scratch, 
+			      cached->coverage->w, cached->coverage->h);
 	if (err)
 	{
-	    SDL_FreeSurface(glyph);
 	    return err;
 	}
-	
-	/*  Center the glyph horizontally, adjust for descenders vertically. */
-	rect.x += (display->font_width - maxx + minx) / 2;
-	rect.y += (display->font_height - maxy) + 
-	    display->font_descent - 1;
 
+	/*  The cached coverage is white, so color it as we go  */
 	if (param->is_foreground_blended)
 	{
-	    fillBlend(glyph, glyph, param->blended_foreground);
+	    fillBlendInto(scratch->tint, cached->coverage, 
+			  param->blended_foreground);
+	}
+	else
+	{
+	    fillBlendInto(scratch->tint, cached->coverage, solid);
 	}
+	glyph = scratch->tint;
+	glyph_rect.w = cached->coverage->w;
+	glyph_rect.h = cached->coverage->h;
     }
 
     if (glyph != NULL)
     {
-	SDL_BlitSurface(glyph, NULL, surface, &rect);
-	if (need_free_glyph)
+	if (glyph_rect.w > 0)
 	{
-	    SDL_FreeSurface(glyph);
+	    SDL_BlitSurface(glyph, &glyph_rect, surface, &rect);
+	}
+	else
+	{
+	    SDL_BlitSurface(glyph, NULL, surface, &rect);
 	}
     }
 
     return 0;
 }
 
+/*  Just-in-time rendering of a character filling a full cell  */
+static int deferredChar(
+    BROGUE_DISPLAY *display, void *data, SDL_Surface *surface)
+{
+    int err;
+
+    BrogueProfile_begin(BROGUE_PROFILE_DRAW_CHAR);
+    err = rasterizeChar(display, data, surface);
+    BrogueProfile_end(BROGUE_PROFILE_DRAW_CHAR);
+
+    return err;
+}
+
+/*  Prepare to rasterize a deferred character, possibly on a worker 
+    thread, by rendering the shared resources it may need  */
+static int prepareDeferredChar(BROGUE_DISPLAY *display, void *data)
+{
+    DEFERRED_CHAR *param = (DEFERRED_CHAR *)data;
+
+    selectBlendKernel();
+
+    /*  SVG frames are rasterized the first time they are requested  */
+    if (param->tile && display->svgset != NULL)
+    {
+	SdlSvgset_getGlyph(display->svgset, param->c, display->anim_frame);
+    }
+
+    /*  Tiles fall back to the font when the tile can't be rendered  */
+    BrogueDisplay_getGlyph(display, 0, param->c);
+
+    return 0;
+}
+
+/*  Hash the contents of a draw parameter, so that identical draws can
+    be recognized.  Zero is reserved for unhashed draws.  */
+static guint64 hashContent(const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+	hash = (hash ^ bytes[i]) * G_GUINT64_CONSTANT(1099511628211);
+    }
+
+    if (hash == 0)
+    {
+	hash = 1;
+    }
+
+    return hash;
+}
+
 /*  Deferred characters don't have internal pointers which need
-    freeing, so they can use this generic free method, but other
-    structures which have internal pointers use other free methods  */
-static void freeParam(void *param)
+    freeing, and are returned to the display's pool of characters  */
+static void freeDeferredChar(void *data)
 {
-    free(param);
+    DEFERRED_CHAR *param = (DEFERRED_CHAR *)data;
+
+    BroguePool_free(param->pool, param);
 }
 
-/*  A just-in-time rendered string, possibly using multiple display
-    cells, and perhaps rendered using a proportional font  */
-static int deferredString(
+/*  Rasterize a string, possibly using multiple display cells, and 
+    perhaps rendered using a proportional font  */
+static int rasterizeString(
     BROGUE_DISPLAY *display, void *data, SDL_Surface *surface)
 {
     DEFERRED_STRING *param = (DEFERRED_STRING *)data;
     SDL_Rect rect = { 0, 0, surface->w, surface->h };
     SDL_Surface *font_surface;
     int bg_color;
-    TTF_Font *font = BrogueDisplay_getFont(display, param->is_proportional);
     int i;
     SDL_Color sdl_fg;
 
@@ -593,23 +1024,36 @@ static int deferredString(
 	}
 
 	sdl_fg = BrogueDisplay_colorToSDLColor(&fg);
-	font_surface = TTF_RenderUNICODE_Blended(font, param->str[i], sdl_fg);
+	font_surface = BrogueDisplay_renderText(
+	    display, param->is_proportional, param->str[i], sdl_fg);
 
 	if (font_surface == NULL)
 	{
 	    return ENOMEM;
 	}
 	
+	/*  The surface is owned by the display's text run cache  */
 	SDL_BlitSurface(font_surface, NULL, surface, &rect);
 
 	rect.x += font_surface->w;
-
-	SDL_FreeSurface(font_surface);
     }
 
     return 0;
 }
 
+/*  A just-in-time rendered string  */
+static int deferredString(
+    BROGUE_DISPLAY *display, void *data, SDL_Surface *surface)
+{
+    int err;
+
+    BrogueProfile_begin(BROGUE_PROFILE_DRAW_STRING);
+    err = rasterizeString(display, data, surface);
+    BrogueProfile_end(BROGUE_PROFILE_DRAW_STRING);
+
+    return err;
+}
+
 /*  The free routing for a deferred string draw.  Frees all associated
     memory.  */
 static void freeDeferredString(void *data)
@@ -1020,62 +1464,130 @@ int BrogueDrawContext_setTabStops(
     return 0;
 }
 
+/*  Prepare the display's pool of deferred characters, whose size is 
+    only known here  */
+void BrogueDisplay_initCharPool(BROGUE_DISPLAY *display)
+{
+    BroguePool_init(&display->char_pool, sizeof(DEFERRED_CHAR));
+}
+
 /*  Draw an individual character  */
 void BrogueDrawContext_drawChar(
     BROGUE_DRAW_CONTEXT *context, int x, int y, wchar_t c)
 {
+    BROGUE_DISPLAY *display = context->window->display;
     BROGUE_DEFERRED_DRAW *draw;
-    DEFERRED_CHAR *defer;
+    DEFERRED_CHAR content, *defer;
+    guint64 hash;
+    int is_animated = 0;
+
+    memset(&content, 0, sizeof(DEFERRED_CHAR));
+    content.pool = &display->char_pool;
+    content.is_foreground_blended = context->state.is_foreground_blended;
+    content.foreground = context->state.foreground;
+    memcpy(content.blended_foreground, context->state.blended_foreground,
+	   sizeof(BROGUE_DRAW_COLOR) * 4);
+    content.is_background_blended = context->state.is_background_blended;
+    content.background = context->state.background;
+    memcpy(content.blended_background, context->state.blended_background,
+	   sizeof(BROGUE_DRAW_COLOR) * 4);
+    content.tile = context->state.tile_enable;
+    content.c = c;
+    hash = hashContent(&content, sizeof(DEFERRED_CHAR));
 
-    defer = (DEFERRED_CHAR *)malloc(sizeof(DEFERRED_CHAR));
+    /*  Animated tiles need to be redrawn as the animation advances,
+	even though the cell hasn't been replaced  */
+    if (content.tile && display->svgset != NULL)
+    {
+	is_animated = SdlSvgset_isAnimated(display->svgset, c);
+    }
+
+    draw = BrogueWindow_getCell(context->window, x, y);
+    if (draw != NULL && draw->draw_func == deferredChar 
+	&& draw->x == x && draw->y == y)
+    {
+	/*  Redrawing the same character in the same colors leaves the
+	    cell, and its already rendered pixels, untouched  */
+	if (draw->content_hash == hash)
+	{
+	    return;
+	}
+
+	/*  If only the window references the existing character draw,
+	    we can overwrite it rather than allocating another  */
+	if (draw->ref_count == 1)
+	{
+	    defer = (DEFERRED_CHAR *)draw->draw_param;
+	    *defer = content;
+	    draw->content_hash = hash;
+	    draw->is_animated = is_animated;
+
+	    BrogueWindow_touchCell(context->window, x, y);
+	    return;
+	}
+    }
+
+    defer = (DEFERRED_CHAR *)BroguePool_alloc(display, &display->char_pool);
     if (defer == NULL)
     {
 	return;
     }
-    memset(defer, 0, sizeof(DEFERRED_CHAR));
-
-    defer->is_foreground_blended = context->state.is_foreground_blended;
-    defer->foreground = context->state.foreground;
-    memcpy(defer->blended_foreground, context->state.blended_foreground,
-	   sizeof(BROGUE_DRAW_COLOR) * 4);
-    defer->is_background_blended = context->state.is_background_blended;
-    defer->background = context->state.background;
-    memcpy(defer->blended_background, context->state.blended_background,
-	   sizeof(BROGUE_DRAW_COLOR) * 4);
-    defer->tile = context->state.tile_enable;
-    defer->c = c;
+    *defer = content;
 
     draw = BrogueDeferredDraw_create(
-	context->window, deferredChar, freeParam, defer, x, y, 1, 1);
+	context->window, deferredChar, freeDeferredChar, defer, x, y, 1, 1);
     if (draw == NULL)
     {
-	free(defer);
+	freeDeferredChar(defer);
 	return;
     }
+    draw->prepare_func = prepareDeferredChar;
+    draw->content_hash = hash;
+    draw->is_animated = is_animated;
 
     BrogueWindow_replaceCell(context->window, x, y, draw);
     BrogueDeferredDraw_unref(draw);
 }
 
-/*  Measure the pixel length of a substring  */
-static int measureSubstring(
-    BROGUE_DRAW_CONTEXT *context, const wchar_t *str, int len, int x)
+/*  Measure the width of a run of a substring, as drawn by SDL_ttf  */
+static int measureRun(
+    BROGUE_DISPLAY *display, int proportional, const Uint16 *uni)
 {
-    TTF_Font *font;
-    Uint16 *uni;
-    int i, w, h, uni_index, tab_index;
-    int font_width = context->window->display->font_width;
+    int w, h;
 
-    if (context->state.proportional_enable)
+    if (uni[0] == 0 
+	|| BrogueDisplay_measureText(display, proportional, uni, &w, &h))
     {
-	font = context->window->display->sans_font;
+	return 0;
     }
-    else
+
+    return w;
+}
+
+/*  Measure the pixel length of a substring.  Runs between escapes are
+    measured just as they are rendered, through the display's text run
+    cache, so that kerning and overhang are counted and the width
+    matches what is drawn.  Substrings short enough for the stack 
+    buffer are measured without allocating.  */
+static int measureSubstring(
+    BROGUE_DRAW_CONTEXT *context, const wchar_t *str, int len, int x)
+{
+    BROGUE_DISPLAY *display = context->window->display;
+    int proportional = context->state.proportional_enable;
+    Uint16 stack_uni[MEASURE_BUFFER_LENGTH], *uni;
+    int i, uni_index, tab_index;
+    int font_width = display->font_width;
+
+    uni = stack_uni;
+    if (len >= MEASURE_BUFFER_LENGTH)
     {
-	font = context->window->display->mono_font;
+	uni = (Uint16 *)malloc(sizeof(Uint16) * (len + 1));
+	if (uni == NULL)
+	{
+	    return x;
+	}
     }
 
-    uni = (Uint16 *)malloc(sizeof(Uint16) * (len + 1));
     uni_index = 0;
     tab_index = 0;
     for (i = 0; i < len; i++)
@@ -1083,9 +1595,7 @@ static int measureSubstring(
 	if (str[i] == COLOR_ESCAPE || str[i] == '*' || str[i] == '\t') 
 	{
 	    uni[uni_index] = 0;
-	    TTF_SizeUNICODE(font, uni, &w, &h);
-	    x += w;
-
+	    x += measureRun(display, proportional, uni);
 	    uni_index = 0;
 
 	    if (str[i] == COLOR_ESCAPE)
@@ -1113,10 +1623,12 @@ static int measureSubstring(
 	}
     }
     uni[uni_index] = 0;
-    TTF_SizeUNICODE(font, uni, &w, &h);
-    x += w;
-    
-    free(uni);
+    x += measureRun(display, proportional, uni);
+
+    if (uni != stack_uni)
+    {
+	free(uni);
+    }
 
     return x;
 }
@@ -1125,18 +1637,20 @@ static int measureSubstring(
 static void drawSubstring(
     BROGUE_DRAW_CONTEXT *context, const wchar_t *str, int len, int x, int y)
 {
+    BROGUE_DISPLAY *display = context->window->display;
     DEFERRED_STRING *defer;
     BROGUE_DEFERRED_DRAW *draw;
     BROGUE_DRAW_COLOR color;
     int i, j, str_begin, start_x, end_x, escape_count, str_index, tab_index;
-    int font_width = context->window->display->font_width;
+    int font_width = display->font_width;
 
     if (len == 0)
     {
 	return;
     }
 
-    defer = (DEFERRED_STRING *)malloc(sizeof(DEFERRED_STRING));
+    defer = (DEFERRED_STRING *)BrogueDisplay_allocate(
+	display, sizeof(DEFERRED_STRING));
     memset(defer, 0, sizeof(DEFERRED_STRING));
 
     escape_count = 0;
@@ -1154,11 +1668,14 @@ static void drawSubstring(
     }
 
     defer->str_count = escape_count + 1;
-    defer->str = malloc(sizeof(Uint16 **) * defer->str_count);
+    defer->str = BrogueDisplay_allocate(
+	display, sizeof(Uint16 **) * defer->str_count);
     memset(defer->str, 0, sizeof(Uint16 **) * defer->str_count);
-    defer->str_color = malloc(sizeof(BROGUE_DRAW_COLOR) * defer->str_count);
+    defer->str_color = BrogueDisplay_allocate(
+	display, sizeof(BROGUE_DRAW_COLOR) * defer->str_count);
     memset(defer->str_color, 0, sizeof(BROGUE_DRAW_COLOR) * defer->str_count);
-    defer->str_position = malloc(sizeof(int) * defer->str_count);
+    defer->str_position = BrogueDisplay_allocate(
+	display, sizeof(int) * defer->str_count);
     memset(defer->str_position, 0, sizeof(int) * defer->str_count);
     start_x = (x / font_width) * font_width;
     defer->str_position[0] = x - start_x;
@@ -1172,8 +1689,8 @@ static void drawSubstring(
     {
 	if (str[i] == COLOR_ESCAPE || str[i] == '\t')
 	{
-	    defer->str[str_index] = malloc(
-		sizeof(Uint16) * (i - str_begin + 1));
+	    defer->str[str_index] = BrogueDisplay_allocate(
+		display, sizeof(Uint16) * (i - str_begin + 1));
 	    for (j = str_begin; j < i; j++)
 	    {
 		defer->str[str_index][j - str_begin] = str[j];
@@ -1211,8 +1728,8 @@ static void drawSubstring(
     }
     assert(str_index == defer->str_count - 1);
 
-    defer->str[str_index] = malloc(
-	sizeof(Uint16) * (i - str_begin + 1));
+    defer->str[str_index] = BrogueDisplay_allocate(
+	display, sizeof(Uint16) * (i - str_begin + 1));
     for (j = str_begin; j < i; j++)
     {
 	defer->str[str_index][j - str_begin] = str[j];
@@ -1250,8 +1767,7 @@ int BrogueDrawContext_drawString(
     int i, begin_word, begin_line, begin_line_x, font_width;
     BROGUE_EFFECT *effect;
 
-    int u8c_width, line_pixel_width, len, new_wrap_right;
-    TTF_Font *font;
+    int line_pixel_width, len, new_wrap_right;
 
     font_width = context->window->display->font_width;
 
@@ -1279,15 +1795,6 @@ int BrogueDrawContext_drawString(
         line_pixel_width = 0;
         len = wcslen(str);
 
-        if (context->state.proportional_enable)
-        {
-            font = context->window->display->sans_font;
-        }
-        else
-        {
-            font = context->window->display->mono_font;
-        }
-
         for (i = 0; str[i]; ++i)
         {
             if (str[i] == '\n')
@@ -1319,8 +1826,9 @@ int BrogueDrawContext_drawString(
                 }
                 else
                 {
-                    TTF_GlyphMetrics(font, (Uint16)(str[i]), NULL, NULL, NULL, NULL, &u8c_width);
-                    line_pixel_width += u8c_width; //u8c_maxx - u8c_minx;
+                    line_pixel_width += BrogueDisplay_getAdvance(
+                        context->window->display,
+                        context->state.proportional_enable, str[i]);
 
                     if (context->state.wrap_enable && line_pixel_width >= context->state.wrap_right * font_width)
                     {
@@ -1432,8 +1940,7 @@ BROGUE_TEXT_SIZE BrogueDrawContext_measureString(
     int h = 1;
     int minx, maxx;
     int i, begin_word, begin_line, begin_line_x, font_width;
-    int line_pixel_width, u8c_width, len;
-    TTF_Font *font;
+    int line_pixel_width, len;
 
     font_width = context->window->display->font_width;
 
@@ -1446,14 +1953,6 @@ BROGUE_TEXT_SIZE BrogueDrawContext_measureString(
 
     line_pixel_width = 0;
     len = wcslen(str); 
-    if (context->state.proportional_enable)
-    {
-        font = context->window->display->sans_font;
-    }
-    else
-    {
-        font = context->window->display->mono_font;
-    }
 
     for (i = 0; str[i]; ++i)
     {
@@ -1490,8 +1989,9 @@ BROGUE_TEXT_SIZE BrogueDrawContext_measureString(
             }
             else
             {
-                TTF_GlyphMetrics(font, (Uint16)(str[i]), NULL, NULL, NULL, NULL, &u8c_width);
-                line_pixel_width += u8c_width;
+                line_pixel_width += BrogueDisplay_getAdvance(
+                    context->window->display,
+                    context->state.proportional_enable, str[i]);
 
                 if (context->state.wrap_enable && line_pixel_width >= context->state.wrap_right * font_width)
                 {
@@ -1591,7 +2091,8 @@ int BrogueDrawContext_drawAsciiString(
     int i, err;
 
     int ws_size = (strlen(str) + 1) * 3 + 1;
-    ustr = malloc(sizeof(wchar_t) * ws_size);
+    ustr = BrogueDisplay_allocate(
+	context->window->display, sizeof(wchar_t) * ws_size);
     if (ustr == NULL)
     {
 	return ENOMEM;
@@ -1623,7 +2124,8 @@ BROGUE_TEXT_SIZE BrogueDrawContext_measureAsciiString(
     BROGUE_TEXT_SIZE size = { 0, 0 };
 
     int ws_size = (strlen(str) + 1) * 3 + 1;
-    ustr = malloc(sizeof(wchar_t) * ws_size);
+    ustr = BrogueDisplay_allocate(
+	context->window->display, sizeof(wchar_t) * ws_size);
     if (ustr == NULL)
     {
 	return size;
@@ -1642,6 +2144,154 @@ BROGUE_TEXT_SIZE BrogueDrawContext_measureAsciiString(
     return size;
 }
 
+/*  Find how much of an ASCII string fits on a line of the given number
+    of columns, starting from column x.  Returns the number of bytes 
+    which fit, stopping short of any newline, and never splitting a 
+    UTF-8 sequence or a color escape.  At least one character is always
+    taken, so that wrapping makes progress.  */
+int BrogueDrawContext_fitAsciiString(
+    BROGUE_DRAW_CONTEXT *context, int x, const char *str, int width)
+{
+    BROGUE_DISPLAY *display = context->window->display;
+    int proportional = context->state.proportional_enable;
+    int font_width = display->font_width;
+    int pixel_x = x * font_width;
+    int limit = (x + width) * font_width;
+    int i, j, next, advance, units, wide_len;
+    wchar_t wide[MEASURE_BUFFER_LENGTH];
+    int wide_end[MEASURE_BUFFER_LENGTH], byte_end[MEASURE_BUFFER_LENGTH];
+
+    /*  The advance table finds the break quickly, keeping each
+	character as wide characters for measuring below  */
+    i = 0;
+    units = 0;
+    wide_len = 0;
+    while (str[i] != 0 && str[i] != '\n' 
+	   && wide_len + 4 <= MEASURE_BUFFER_LENGTH)
+    {
+	next = i;
+	if (str[i] == COLOR_ESCAPE)
+	{
+	    advance = 0;
+	    for (next = i + 1; next < i + 4 && str[next] != 0; next++);
+	    for (j = i; j < next; j++)
+	    {
+		wide[wide_len++] = (unsigned char)str[j];
+	    }
+	}
+	else if (str[i] == '*')
+	{
+	    advance = font_width;
+	    wide[wide_len++] = '*';
+	    next = i + 1;
+	}
+	else
+	{
+	    wide[wide_len] = u8_nextchar(str, &next);
+	    advance = BrogueDisplay_getAdvance(
+		display, proportional, wide[wide_len]);
+	    wide_len++;
+	}
+
+	if (i > 0 && pixel_x + advance > limit)
+	{
+	    break;
+	}
+	pixel_x += advance;
+	i = next;
+
+	wide_end[units] = wide_len;
+	byte_end[units] = i;
+	units++;
+    }
+
+    /*  Advances leave out kerning and the overhang of the last glyph,
+	so measure the line as it will be drawn, and give back characters
+	until it fits  */
+    while (units > 1 
+	   && measureSubstring(context, wide, wide_end[units - 1], 
+			       x * font_width) > limit)
+    {
+	units--;
+    }
+
+    return units > 0 ? byte_end[units - 1] : 0;
+}
+
+/*  Check the text measurement used for layout against SDL_ttf on a
+    sample string in each font: whole runs must measure as 
+    TTF_SizeUNICODE does, and lines fitted to a width must not be wider
+    when drawn.  Returns the number of mismatches, which are reported
+    on stderr.  */
+int BrogueDisplay_checkTextMeasure(BROGUE_DISPLAY *display)
+{
+    static const char *sample = 
+	"AVATAR Wolf's fiery jaws, \xe5\x9c\xb0\xe7\x89\xa2 "
+	"\xe7\x9a\x84\xe6\xb7\xb1\xe5\xa4\x84 (12/34) fly!";
+    BROGUE_DRAW_CONTEXT *context;
+    wchar_t wide[MEASURE_BUFFER_LENGTH];
+    Uint16 uni[MEASURE_BUFFER_LENGTH];
+    int proportional, width, fit, len, i, w, h, measured;
+    int mismatches = 0;
+
+    context = BrogueDrawContext_open(BrogueDisplay_getRootWindow(display));
+    if (context == NULL)
+    {
+	return 1;
+    }
+
+    for (proportional = 0; proportional < 2; proportional++)
+    {
+	TTF_Font *font = BrogueDisplay_getFont(display, proportional);
+
+	BrogueDrawContext_enableProportionalFont(context, proportional);
+
+	len = 0;
+	for (i = 0; sample[i] != 0; )
+	{
+	    wide[len] = u8_nextchar(sample, &i);
+	    uni[len] = wide[len];
+	    len++;
+	}
+	uni[len] = 0;
+
+	measured = measureSubstring(context, wide, len, 0);
+	if (TTF_SizeUNICODE(font, uni, &w, &h) == 0 && measured != w)
+	{
+	    fprintf(stderr, "%s sample measures %d pixels, but SDL_ttf "
+		    "measures %d\n", proportional ? "Proportional" : "Mono",
+		    measured, w);
+	    mismatches++;
+	}
+
+	for (width = 1; width <= 40; width++)
+	{
+	    fit = BrogueDrawContext_fitAsciiString(context, 0, sample, width);
+
+	    len = 0;
+	    for (i = 0; i < fit; )
+	    {
+		uni[len++] = u8_nextchar(sample, &i);
+	    }
+	    uni[len] = 0;
+
+	    if (len > 1 && TTF_SizeUNICODE(font, uni, &w, &h) == 0
+		&& w > width * display->font_width)
+	    {
+		fprintf(stderr, "%s sample fitted to %d columns is %d pixels "
+			"wide, over %d\n", 
+			proportional ? "Proportional" : "Mono",
+			width, w, width * display->font_width);
+		mismatches++;
+	    }
+	}
+    }
+
+    BrogueDrawContext_close(context);
+
+    return mismatches;
+}
+
 /*  Draw a graphic which has been loaded from an external SVG  */
 int BrogueDrawContext_drawGraphic(
     BROGUE_DRAW_CONTEXT *context, 
@@ -1650,7 +2300,8 @@ int BrogueDrawContext_drawGraphic(
     DEFERRED_GRAPHIC *deferred_graphic;
     BROGUE_DEFERRED_DRAW *draw;
 
-    deferred_graphic = malloc(sizeof(DEFERRED_GRAPHIC));
+    deferred_graphic = BrogueDisplay_allocate(
+	context->window->display, sizeof(DEFERRED_GRAPHIC));
     if (deferred_graphic == NULL)
     {
 	return ENOMEM;
@@ -1759,13 +2410,13 @@ BROGUE_DEFERRED_DRAW *BrogueDeferredDraw_create(
 {
     BROGUE_DEFERRED_DRAW *draw;
 
-    draw = malloc(sizeof(BROGUE_DEFERRED_DRAW));
+    draw = BroguePool_alloc(window->display, &window->display->draw_pool);
     if (draw == NULL)
     {
 	return NULL;
     }
-    memset(draw, 0, sizeof(BROGUE_DEFERRED_DRAW));
 
+    draw->display = window->display;
     draw->window = window;
     draw->ref_count = 1;
     draw->draw_func = draw_func;
@@ -1795,7 +2446,7 @@ void BrogueDeferredDraw_unref(BROGUE_DEFERRED_DRAW *draw)
 	    draw->free_func(draw->draw_param);
 	}
 
-	free(draw);
+	BroguePool_free(&draw->display->draw_pool, draw);
     }
 }
 
@@ -31,11 +31,54 @@ typedef struct PROGRESS_BAR PROGRESS_BAR;
 typedef struct PROGRESS_BAR_DRAW PROGRESS_BAR_DRAW;
 typedef struct BUTTON BUTTON;
 typedef struct BUTTON_DRAW BUTTON_DRAW;
+typedef struct EFFECT_SURFACE EFFECT_SURFACE;
+typedef struct MENU_FLAMES MENU_FLAMES;
+typedef struct MENU_FLAMES_DRAW MENU_FLAMES_DRAW;
+typedef struct EFFECT_CACHE EFFECT_CACHE;
+
+typedef int (*EFFECT_RENDER_FUNC)(
+    BROGUE_DISPLAY *display, void *param, SDL_Surface *layer);
+
+#define EFFECT_CACHE_SIZE 64
+
+/*  Flame simulation constants.  Flame intensities are kept in tenths of
+    the game's 0 to 100 color scale.  */
+#define MENU_FLAME_PRECISION_FACTOR 10
+#define MENU_FLAME_RISE_SPEED 50
+#define MENU_FLAME_SPREAD_SPEED 20
+#define MENU_FLAME_COLOR_DRIFT_SPEED 500
+#define MENU_FLAME_FADE_SPEED 20
+#define MENU_FLAME_UPDATE_DELAY 50
+#define MENU_FLAME_WARMUP_STEPS 100
+#define MENU_FLAME_MAX_CATCHUP_STEPS 4
+#define MENU_FLAME_DENOMINATOR \
+    (100 + MENU_FLAME_RISE_SPEED + MENU_FLAME_SPREAD_SPEED)
+
+/*  A rendered effect, with the key of the content and display state
+    it was rendered from  */
+struct EFFECT_SURFACE
+{
+    guint64 key;
+    SDL_Surface *surface;
+    unsigned last_used;
+};
+
+/*  The most recently rendered surfaces of an effect instance, so that
+    redrawing unchanged buttons and bars is only a blit.  The cache is
+    shared by reference with deferred draws, which can outlive the
+    effect instance.  */
+struct EFFECT_CACHE
+{
+    int ref_count;
+    unsigned clock;
+    EFFECT_SURFACE entries[EFFECT_CACHE_SIZE];
+};
 
 /*  A progress bar effect instance  */
 struct PROGRESS_BAR
 {
     PROGRESS_BAR_EFFECT_PARAM param;
+    EFFECT_CACHE *cache;
 };
 
 /*  A deferred draw for a progress bar  */
@@ -45,6 +88,9 @@ struct PROGRESS_BAR_DRAW
     BROGUE_DRAW_COLOR foreground;
     BROGUE_DRAW_COLOR background;
     wchar_t *str;
+
+    EFFECT_CACHE *cache;
+    guint64 content_hash;
 };
 
 /*  A button effect instance  */
@@ -54,6 +100,8 @@ struct BUTTON
 
     wchar_t *symbols;
     int *symbol_flags;
+
+    EFFECT_CACHE *cache;
 };
 
 /*  A deferred draw for a button  */
@@ -67,8 +115,284 @@ struct BUTTON_DRAW
 
     int tab_stop_count;
     int *tab_stops;
+
+    EFFECT_CACHE *cache;
+    guint64 content_hash;
 };
 
+/*  The title screen flame simulation, shared by reference between the
+    effect instance and its deferred draw, which advances it as the
+    display's animation clock advances  */
+struct MENU_FLAMES
+{
+    int ref_count;
+    int width, height;
+    Uint32 rng;
+    int step;
+
+    /*  Red, green and blue intensity of each cell, row-major  */
+    Sint16 *flames;
+    Sint16 *row;
+
+    /*  The cells fed by color sources, in row-major order, with the 
+	drifting random weights of each  */
+    int source_count;
+    int *source_cells;
+    MENU_FLAME_SOURCE *source_colors;
+    Sint16 (*source_drift)[4];
+
+    /*  Per-frame 8-bit color of each cell corner  */
+    unsigned char *corners;
+};
+
+/*  A deferred draw of the flames over a window  */
+struct MENU_FLAMES_DRAW
+{
+    MENU_FLAMES *flames;
+};
+
+/*  Continue an FNV-1a hash of effect content  */
+static guint64 hashEffect(guint64 hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+	hash = (hash ^ bytes[i]) * G_GUINT64_CONSTANT(1099511628211);
+    }
+
+    return hash;
+}
+
+/*  Allocate an empty cache of rendered effect surfaces  */
+static EFFECT_CACHE *effectCacheNew(void)
+{
+    EFFECT_CACHE *cache;
+
+    cache = malloc(sizeof(EFFECT_CACHE));
+    if (cache == NULL)
+    {
+	return NULL;
+    }
+    memset(cache, 0, sizeof(EFFECT_CACHE));
+    cache->ref_count = 1;
+
+    return cache;
+}
+
+/*  Add a reference to an effect cache  */
+static EFFECT_CACHE *effectCacheRef(EFFECT_CACHE *cache)
+{
+    cache->ref_count++;
+
+    return cache;
+}
+
+/*  Release a reference to an effect cache, freeing its surfaces with
+    the last reference  */
+static void effectCacheUnref(EFFECT_CACHE *cache)
+{
+    int i;
+
+    if (cache == NULL || --cache->ref_count > 0)
+    {
+	return;
+    }
+
+    for (i = 0; i < EFFECT_CACHE_SIZE; i++)
+    {
+	if (cache->entries[i].surface != NULL)
+	{
+	    SDL_FreeSurface(cache->entries[i].surface);
+	}
+    }
+    free(cache);
+}
+
+/*  Find a rendered surface by key, or return NULL if there is none  */
+static SDL_Surface *effectCacheFind(EFFECT_CACHE *cache, guint64 key)
+{
+    int i;
+
+    for (i = 0; i < EFFECT_CACHE_SIZE; i++)
+    {
+	if (cache->entries[i].surface != NULL && cache->entries[i].key == key)
+	{
+	    cache->entries[i].last_used = ++cache->clock;
+	    return cache->entries[i].surface;
+	}
+    }
+
+    return NULL;
+}
+
+/*  Store a rendered surface, replacing the least recently used  */
+static void effectCacheInsert(
+    EFFECT_CACHE *cache, guint64 key, SDL_Surface *surface)
+{
+    EFFECT_SURFACE *entry = &cache->entries[0];
+    int i;
+
+    for (i = 0; i < EFFECT_CACHE_SIZE; i++)
+    {
+	if (cache->entries[i].surface == NULL)
+	{
+	    entry = &cache->entries[i];
+	    break;
+	}
+	if (cache->entries[i].last_used < entry->last_used)
+	{
+	    entry = &cache->entries[i];
+	}
+    }
+
+    if (entry->surface != NULL)
+    {
+	SDL_FreeSurface(entry->surface);
+    }
+    entry->key = key;
+    entry->surface = surface;
+    entry->last_used = ++cache->clock;
+}
+
+/*  Composite a surface over an effect layer.  Unlike SDL's alpha blit,
+    which leaves the destination's alpha untouched, this accumulates
+    coverage in the layer, so that the layer can later be blitted over
+    whatever is behind the effect.  */
+static void blendLayer(SDL_Surface *src, SDL_Surface *layer, int x, int y)
+{
+    SDL_PixelFormat *format = src->format;
+    int begin_x, end_x, begin_y, end_y, i, j;
+
+    begin_x = x < 0 ? 0 : x;
+    begin_y = y < 0 ? 0 : y;
+    end_x = x + src->w < layer->w ? x + src->w : layer->w;
+    end_y = y + src->h < layer->h ? y + src->h : layer->h;
+
+    for (j = begin_y; j < end_y; j++)
+    {
+	Uint32 *src_row = (Uint32 *)((char *)src->pixels 
+				     + (j - y) * src->pitch);
+	Uint32 *layer_row = (Uint32 *)((char *)layer->pixels 
+				       + j * layer->pitch);
+
+	for (i = begin_x; i < end_x; i++)
+	{
+	    Uint32 s = src_row[i - x], d = layer_row[i];
+	    unsigned sa, sr, sg, sb, da, dr, dg, db, a, r, g, b, w;
+
+	    sa = format->Amask ? (s & format->Amask) >> format->Ashift : 255;
+	    if (sa == 0)
+	    {
+		continue;
+	    }
+	    sr = (s & format->Rmask) >> format->Rshift;
+	    sg = (s & format->Gmask) >> format->Gshift;
+	    sb = (s & format->Bmask) >> format->Bshift;
+
+	    da = d >> 24;
+	    dr = (d >> 16) & 0xFF;
+	    dg = (d >> 8) & 0xFF;
+	    db = d & 0xFF;
+
+	    /*  Porter-Duff over with unpremultiplied colors, with alpha
+		scaled by 255  */
+	    w = da * (255 - sa);
+	    a = sa * 255 + w;
+	    r = (sr * sa * 255 + dr * w) / a;
+	    g = (sg * sa * 255 + dg * w) / a;
+	    b = (sb * sa * 255 + db * w) / a;
+
+	    layer_row[i] = ((a + 127) / 255) << 24 | r << 16 | g << 8 | b;
+	}
+    }
+}
+
+/*  Cairo leaves premultiplied color in an ARGB32 layer, but SDL blits
+    expect unpremultiplied color  */
+static void unpremultiplyLayer(SDL_Surface *layer)
+{
+    int i, j;
+
+    for (j = 0; j < layer->h; j++)
+    {
+	Uint32 *row = (Uint32 *)((char *)layer->pixels + j * layer->pitch);
+
+	for (i = 0; i < layer->w; i++)
+	{
+	    unsigned a = row[i] >> 24, r, g, b;
+
+	    if (a == 0 || a == 255)
+	    {
+		continue;
+	    }
+	    r = (((row[i] >> 16) & 0xFF) * 255 + a / 2) / a;
+	    g = (((row[i] >> 8) & 0xFF) * 255 + a / 2) / a;
+	    b = ((row[i] & 0xFF) * 255 + a / 2) / a;
+
+	    row[i] = a << 24 
+		| (r > 255 ? 255 : r) << 16
+		| (g > 255 ? 255 : g) << 8 
+		| (b > 255 ? 255 : b);
+	}
+    }
+}
+
+/*  Draw an effect from its cached surface, rendering the surface
+    first if the content or the fonts have changed since it was last
+    drawn at this size  */
+static int drawCachedEffect(
+    BROGUE_DISPLAY *display, EFFECT_CACHE *cache, guint64 content_hash,
+    EFFECT_RENDER_FUNC render_func, void *param, SDL_Surface *surface)
+{
+    SDL_SVGSET *svgset = BrogueDisplay_getSvgset(display);
+    TTF_Font *fonts[2];
+    SDL_Surface *layer;
+    guint64 key = content_hash;
+    int provisional = 0;
+    int err;
+
+    fonts[0] = BrogueDisplay_getFont(display, 0);
+    fonts[1] = BrogueDisplay_getFont(display, 1);
+    if (svgset != NULL)
+    {
+	provisional = SdlSvgset_hasProvisional(svgset);
+    }
+
+    key = hashEffect(key, &surface->w, sizeof(int));
+    key = hashEffect(key, &surface->h, sizeof(int));
+    key = hashEffect(key, fonts, sizeof(fonts));
+    key = hashEffect(key, &svgset, sizeof(SDL_SVGSET *));
+    key = hashEffect(key, &provisional, sizeof(int));
+
+    layer = effectCacheFind(cache, key);
+    if (layer == NULL)
+    {
+	layer = SDL_CreateRGBSurface(
+	    SDL_SWSURFACE, surface->w, surface->h, 32, 
+	    0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+	if (layer == NULL)
+	{
+	    return ENOMEM;
+	}
+	SDL_FillRect(layer, NULL, 0);
+
+	err = render_func(display, param, layer);
+	if (err)
+	{
+	    SDL_FreeSurface(layer);
+	    return err;
+	}
+
+	effectCacheInsert(cache, key, layer);
+    }
+
+    SDL_BlitSurface(layer, NULL, surface, NULL);
+
+    return 0;
+}
+
 /*  Convert a wide char string to uint16's for rendering with SDL_ttf  */
 static Uint16 *wcsToUint16(wchar_t *str, int len)
 {
@@ -90,7 +414,8 @@ static Uint16 *wcsToUint16(wchar_t *str, int len)
     return unitext;
 }
 
-/*  A text drawing method used by both progress bars and buttons  */
+/*  A text drawing method used by both progress bars and buttons,
+    drawing into an effect layer  */
 static int drawEffectText(
     BROGUE_DISPLAY *display, SDL_Surface *surface, 
     BROGUE_DRAW_COLOR color, int centered, wchar_t *str,
@@ -107,6 +432,7 @@ static int drawEffectText(
     int i, begin_span, total_len, str_len, x, symbol_index, tab_index;
     int w, h, font_width, font_height;
     int base_x;
+    int tinted;
 
     BrogueDisplay_getFontSize(display, &font_width, &font_height);
 
@@ -200,7 +526,7 @@ static int drawEffectText(
 		rect.w = text_surface->w;
 		rect.h = text_surface->h;
    
-		SDL_BlitSurface(text_surface, NULL, surface, &rect);
+		blendLayer(text_surface, surface, rect.x, rect.y);
 		SDL_FreeSurface(text_surface);
 		
 		x += w;
@@ -227,11 +553,13 @@ static int drawEffectText(
 	    else if (str[i] == '*' && symbol_index < symbol_count)
 	    {
 		glyph = NULL;
+		tinted = 0;
 
 		if (symbol_flags[symbol_index] & PLOT_CHAR_TILE)
 		{
 		    glyph = SdlSvgset_render(svgset, 
 					     symbols[symbol_index], 0, sdl_fg);
+		    tinted = (glyph != NULL);
 		}
 
 		if (glyph == NULL)
@@ -250,8 +578,15 @@ static int drawEffectText(
 		rect.w = surface->w + (font_width - glyph->w) / 2;
 		rect.h = surface->h;
    
-		SDL_BlitSurface(glyph, NULL, surface, &rect);
-		SDL_FreeSurface(glyph);
+		blendLayer(glyph, surface, rect.x, rect.y);
+		if (tinted)
+		{
+		    SdlSvgset_releaseGlyph(svgset, glyph);
+		}
+		else
+		{
+		    SDL_FreeSurface(glyph);
+		}
 		
 		symbol_index++;
 		x += font_width;
@@ -280,15 +615,15 @@ static int drawEffectText(
 	rect.w = text_surface->w;
 	rect.h = text_surface->h;
     
-	SDL_BlitSurface(text_surface, NULL, surface, &rect);
+	blendLayer(text_surface, surface, rect.x, rect.y);
 	SDL_FreeSurface(text_surface);
     }
 
     return 0;
 }
 
-/*  Draw a progress bar just-in-time  */
-static int progressBarDeferredDraw(
+/*  Render a progress bar into an effect layer  */
+static int progressBarRender(
     BROGUE_DISPLAY *display, void *param, SDL_Surface *surface)
 {
     PROGRESS_BAR_DRAW *draw = (PROGRESS_BAR_DRAW *)param;
@@ -299,7 +634,7 @@ static int progressBarDeferredDraw(
     int h = surface->h;
 
     cairo_surface = cairo_image_surface_create_for_data(
-	surface->pixels, CAIRO_FORMAT_RGB24,
+	surface->pixels, CAIRO_FORMAT_ARGB32,
 	surface->w, surface->h, surface->pitch);
     if (cairo_surface == NULL)
     {
@@ -343,6 +678,7 @@ static int progressBarDeferredDraw(
     
     cairo_destroy(cairo);
     cairo_surface_destroy(cairo_surface);
+    unpremultiplyLayer(surface);
 
     err = drawEffectText(display, surface, draw->foreground, 1, draw->str, 
 			 0, NULL, NULL, 0, NULL);
@@ -350,11 +686,22 @@ static int progressBarDeferredDraw(
     return err;
 }
 
+/*  Draw a progress bar just-in-time  */
+static int progressBarDeferredDraw(
+    BROGUE_DISPLAY *display, void *param, SDL_Surface *surface)
+{
+    PROGRESS_BAR_DRAW *draw = (PROGRESS_BAR_DRAW *)param;
+
+    return drawCachedEffect(display, draw->cache, draw->content_hash,
+			    progressBarRender, draw, surface);
+}
+
 /*  Free the resources associated with a deferred progress bar draw  */
 static void progressBarDeferredFree(void *param)
 {
     PROGRESS_BAR_DRAW *draw = (PROGRESS_BAR_DRAW *)param;
 
+    effectCacheUnref(draw->cache);
     free(draw->str);
     free(draw);
 }
@@ -371,6 +718,13 @@ static void *progressBarNew(void)
     }
     memset(progress_bar, 0, sizeof(PROGRESS_BAR));
 
+    progress_bar->cache = effectCacheNew();
+    if (progress_bar->cache == NULL)
+    {
+	free(progress_bar);
+	return NULL;
+    }
+
     return progress_bar;
 }
 
@@ -379,6 +733,7 @@ static void progressBarDestroy(void *effect_state)
 {
     PROGRESS_BAR *progress_bar = (PROGRESS_BAR *)effect_state;
 
+    effectCacheUnref(progress_bar->cache);
     free(progress_bar);
 }
 
@@ -400,8 +755,10 @@ static BROGUE_DEFERRED_DRAW *progressBarDraw(
     PROGRESS_BAR *progress_bar = (PROGRESS_BAR *)effect_state;
     BROGUE_DEFERRED_DRAW *draw;
     PROGRESS_BAR_DRAW *progress_draw;
+    guint64 hash;
 
-    progress_draw = (PROGRESS_BAR_DRAW *)malloc(sizeof(PROGRESS_BAR_DRAW));
+    progress_draw = (PROGRESS_BAR_DRAW *)BrogueDisplay_allocate(
+	window->display, sizeof(PROGRESS_BAR_DRAW));
     if (progress_draw == NULL)
     {
 	return NULL;
@@ -411,7 +768,8 @@ static BROGUE_DEFERRED_DRAW *progressBarDraw(
     progress_draw->param = progress_bar->param;
     progress_draw->foreground = context_state->foreground;
     progress_draw->background = context_state->background;
-    progress_draw->str = malloc(sizeof(wchar_t) * (wcslen(str) + 1));
+    progress_draw->str = BrogueDisplay_allocate(
+	window->display, sizeof(wchar_t) * (wcslen(str) + 1));
     if (progress_draw->str == NULL)
     {
 	free(progress_draw);
@@ -419,21 +777,34 @@ static BROGUE_DEFERRED_DRAW *progressBarDraw(
     }
     wcscpy(progress_draw->str, str);
 
+    /*  The parameter structure has padding, so hash field by field  */
+    hash = G_GUINT64_CONSTANT(14695981039346656037);
+    hash = hashEffect(hash, &progress_bar->param.size, sizeof(int));
+    hash = hashEffect(hash, &progress_bar->param.amount, sizeof(double));
+    hash = hashEffect(hash, &progress_draw->foreground, 
+		      sizeof(BROGUE_DRAW_COLOR));
+    hash = hashEffect(hash, &progress_draw->background, 
+		      sizeof(BROGUE_DRAW_COLOR));
+    hash = hashEffect(hash, str, sizeof(wchar_t) * wcslen(str));
+    progress_draw->content_hash = hash ? hash : 1;
+    progress_draw->cache = effectCacheRef(progress_bar->cache);
+
     draw = BrogueDeferredDraw_create(
 	window, progressBarDeferredDraw, progressBarDeferredFree,
 	progress_draw, x, y, progress_bar->param.size, 1);
     if (draw == NULL)
     {
-	free(progress_draw);
+	progressBarDeferredFree(progress_draw);
 	return NULL;
     }
+    draw->content_hash = progress_draw->content_hash;
 
     return draw;
 }
 
-/*  The just-in-time drawing routing for a button  */
-static int buttonDeferredDraw(BROGUE_DISPLAY *display, 
-			      void *param, SDL_Surface *surface)
+/*  Render a button into an effect layer  */
+static int buttonRender(BROGUE_DISPLAY *display, 
+			void *param, SDL_Surface *surface)
 {
     cairo_surface_t *cairo_surface;
     cairo_t *cairo;
@@ -453,7 +824,7 @@ static int buttonDeferredDraw(BROGUE_DISPLAY *display,
     if (button_draw->param.is_shaded)
     {
 	cairo_surface = cairo_image_surface_create_for_data(
-	    surface->pixels, CAIRO_FORMAT_RGB24,
+	    surface->pixels, CAIRO_FORMAT_ARGB32,
 	    w, h, surface->pitch);
 	if (cairo_surface == NULL)
 	{
@@ -517,6 +888,7 @@ static int buttonDeferredDraw(BROGUE_DISPLAY *display,
 	cairo_pattern_destroy(pattern);
 	cairo_destroy(cairo);
 	cairo_surface_destroy(cairo_surface);
+	unpremultiplyLayer(surface);
     }
 
     drawEffectText(display, surface, 
@@ -529,11 +901,23 @@ static int buttonDeferredDraw(BROGUE_DISPLAY *display,
     return 0;
 }
 
+/*  The just-in-time drawing routing for a button  */
+static int buttonDeferredDraw(BROGUE_DISPLAY *display, 
+			      void *param, SDL_Surface *surface)
+{
+    BUTTON_DRAW *button_draw = param;
+
+    return drawCachedEffect(display, button_draw->cache, 
+			    button_draw->content_hash,
+			    buttonRender, button_draw, surface);
+}
+
 /*  Free the resources associated with a deferred button draw  */
 void buttonDeferredFree(void *param)
 {
     BUTTON_DRAW *button_draw = param;
 
+    effectCacheUnref(button_draw->cache);
     free(button_draw->symbols);
     free(button_draw->symbol_flags);
     free(button_draw->tab_stops);
@@ -553,6 +937,13 @@ static void *buttonNew(void)
     }
     memset(button, 0, sizeof(BUTTON));
 
+    button->cache = effectCacheNew();
+    if (button->cache == NULL)
+    {
+	free(button);
+	return NULL;
+    }
+
     return button;
 }
 
@@ -561,6 +952,7 @@ static void buttonDestroy(void *state)
 {
     BUTTON *button = state;
 
+    effectCacheUnref(button->cache);
     free(button);
 }
 
@@ -615,15 +1007,17 @@ BROGUE_DEFERRED_DRAW *buttonDraw(
     BUTTON *button = effect_state;
     BUTTON_DRAW *button_draw;
     BROGUE_DEFERRED_DRAW *draw;
+    guint64 hash;
 
-    button_draw = malloc(sizeof(BUTTON_DRAW));
+    button_draw = BrogueDisplay_allocate(window->display, sizeof(BUTTON_DRAW));
     if (button_draw == NULL)
     {
 	return NULL;
     }
     memset(button_draw, 0, sizeof(BUTTON_DRAW));
 
-    button_draw->str = malloc(sizeof(wchar_t) * (wcslen(str) + 1));
+    button_draw->str = BrogueDisplay_allocate(
+	window->display, sizeof(wchar_t) * (wcslen(str) + 1));
     if (button_draw->str == NULL)
     {
 	free(button_draw);
@@ -632,10 +1026,10 @@ BROGUE_DEFERRED_DRAW *buttonDraw(
 
     if (button->param.symbol_count > 0)
     {
-	button_draw->symbols = malloc(
-	    sizeof(wchar_t) * button->param.symbol_count);
-	button_draw->symbol_flags = malloc(
-	    sizeof(int) * button->param.symbol_count);
+	button_draw->symbols = BrogueDisplay_allocate(
+	    window->display, sizeof(wchar_t) * button->param.symbol_count);
+	button_draw->symbol_flags = BrogueDisplay_allocate(
+	    window->display, sizeof(int) * button->param.symbol_count);
 
 	if (button_draw->symbols == NULL || button_draw->symbol_flags == NULL)
 	{
@@ -655,8 +1049,8 @@ BROGUE_DEFERRED_DRAW *buttonDraw(
     if (context_state->tab_stop_count)
     {
 	button_draw->tab_stop_count = context_state->tab_stop_count;
-	button_draw->tab_stops = malloc(
-	    sizeof(int) * context_state->tab_stop_count);
+	button_draw->tab_stops = BrogueDisplay_allocate(
+	    window->display, sizeof(int) * context_state->tab_stop_count);
 	if (button_draw->tab_stops == NULL)
 	{
 	    free(button_draw->symbols);
@@ -673,14 +1067,386 @@ BROGUE_DEFERRED_DRAW *buttonDraw(
     wcscpy(button_draw->str, str);
     button_draw->param = button->param;
 
+    /*  The parameter structure has padding and pointers, so hash the
+	fields, and the symbols pointed to  */
+    hash = G_GUINT64_CONSTANT(14695981039346656037);
+    hash = hashEffect(hash, &button->param.width, sizeof(int));
+    hash = hashEffect(hash, &button->param.is_shaded, sizeof(int));
+    hash = hashEffect(hash, &button->param.is_centered, sizeof(int));
+    hash = hashEffect(hash, &button->param.color, sizeof(BROGUE_DRAW_COLOR));
+    hash = hashEffect(hash, &button->param.highlight_color, 
+		      sizeof(BROGUE_DRAW_COLOR));
+    hash = hashEffect(hash, &button->param.symbol_count, sizeof(int));
+    hash = hashEffect(hash, button_draw->symbols, 
+		      sizeof(wchar_t) * button->param.symbol_count);
+    hash = hashEffect(hash, button_draw->symbol_flags, 
+		      sizeof(int) * button->param.symbol_count);
+    hash = hashEffect(hash, &button_draw->tab_stop_count, sizeof(int));
+    hash = hashEffect(hash, button_draw->tab_stops, 
+		      sizeof(int) * button_draw->tab_stop_count);
+    hash = hashEffect(hash, str, sizeof(wchar_t) * wcslen(str));
+    button_draw->content_hash = hash ? hash : 1;
+    button_draw->cache = effectCacheRef(button->cache);
+
     draw = BrogueDeferredDraw_create(
 	window, buttonDeferredDraw, buttonDeferredFree,
 	button_draw, x, y, button_draw->param.width, 1);
     if (draw == NULL)
     {
-	free(button_draw);
+	buttonDeferredFree(button_draw);
+	return NULL;
+    }
+    draw->content_hash = button_draw->content_hash;
+
+    return draw;
+}
+
+/*  Free the simulation with its last reference  */
+static void menuFlamesUnref(MENU_FLAMES *flames)
+{
+    if (flames == NULL || --flames->ref_count > 0)
+    {
+	return;
+    }
+
+    free(flames->flames);
+    free(flames->row);
+    free(flames->source_cells);
+    free(flames->source_colors);
+    free(flames->source_drift);
+    free(flames->corners);
+    free(flames);
+}
+
+/*  A small xorshift generator, so that the flames don't disturb the 
+    game's random number streams  */
+static int menuFlamesRandom(MENU_FLAMES *flames, int low, int high)
+{
+    Uint32 x = flames->rng;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    flames->rng = x;
+
+    return low + (int)(x % (Uint32)(high - low + 1));
+}
+
+/*  Advance the simulation by one step.  Each cell becomes a weighted
+    average of itself, its left and right neighbors, and the cell below,
+    fades a little, and then takes on the color of its source, if any.  */
+static void menuFlamesStep(MENU_FLAMES *flames)
+{
+    int width = flames->width, height = flames->height;
+    int i, j, k, left, right, source;
+    Sint16 *cell, *below;
+    MENU_FLAME_SOURCE *color;
+    Sint16 *drift;
+    int rand;
+
+    source = 0;
+    for (j = 0; j < height; j++)
+    {
+	memcpy(flames->row, flames->flames + j * width * 3, 
+	       sizeof(Sint16) * width * 3);
+
+	for (i = 0; i < width; i++)
+	{
+	    cell = flames->flames + (j * width + i) * 3;
+	    below = (j + 1 < height) ? cell + width * 3 : NULL;
+	    left = (i == 0) ? width - 1 : i - 1;
+	    right = (i == width - 1) ? 0 : i + 1;
+
+	    for (k = 0; k < 3; k++)
+	    {
+		int value = 100 * cell[k] / MENU_FLAME_DENOMINATOR;
+
+		value += MENU_FLAME_SPREAD_SPEED * flames->row[left * 3 + k] 
+		    / 2 / MENU_FLAME_DENOMINATOR;
+		value += MENU_FLAME_SPREAD_SPEED * flames->row[right * 3 + k] 
+		    / 2 / MENU_FLAME_DENOMINATOR;
+		if (below != NULL)
+		{
+		    value += MENU_FLAME_RISE_SPEED * below[k] 
+			/ MENU_FLAME_DENOMINATOR;
+		}
+		cell[k] = (1000 - MENU_FLAME_FADE_SPEED) * value / 1000;
+	    }
+
+	    if (source < flames->source_count
+		&& flames->source_cells[source] == j * width + i)
+	    {
+		color = &flames->source_colors[source];
+		drift = flames->source_drift[source];
+
+		for (k = 0; k < 4; k++)
+		{
+		    drift[k] += menuFlamesRandom(
+			flames, -MENU_FLAME_COLOR_DRIFT_SPEED, 
+			MENU_FLAME_COLOR_DRIFT_SPEED);
+		    if (drift[k] < 0)
+		    {
+			drift[k] = 0;
+		    }
+		    else if (drift[k] > 1000)
+		    {
+			drift[k] = 1000;
+		    }
+		}
+
+		rand = color->rand * drift[0] / 1000;
+		cell[0] += (color->red + color->red_rand * drift[1] / 1000 
+			    + rand) * MENU_FLAME_PRECISION_FACTOR;
+		cell[1] += (color->green + color->green_rand * drift[2] / 1000
+			    + rand) * MENU_FLAME_PRECISION_FACTOR;
+		cell[2] += (color->blue + color->blue_rand * drift[3] / 1000
+			    + rand) * MENU_FLAME_PRECISION_FACTOR;
+
+		source++;
+	    }
+	}
+    }
+}
+
+/*  Constructor for a flames effect instance, which has no simulation 
+    until it is given parameters  */
+static void *menuFlamesNew(void)
+{
+    MENU_FLAMES **state;
+
+    state = malloc(sizeof(MENU_FLAMES *));
+    if (state == NULL)
+    {
+	return NULL;
+    }
+    *state = NULL;
+
+    return state;
+}
+
+/*  Destructor for a flames effect instance  */
+static void menuFlamesDestroy(void *effect_state)
+{
+    MENU_FLAMES **state = (MENU_FLAMES **)effect_state;
+
+    menuFlamesUnref(*state);
+    free(state);
+}
+
+/*  Start a new simulation from the parameters, and run it for a while
+    so that the flames are already burning when first drawn  */
+static int menuFlamesSetParam(void *effect_state, void *param)
+{
+    MENU_FLAMES **state = (MENU_FLAMES **)effect_state;
+    MENU_FLAMES_EFFECT_PARAM *flames_param = param;
+    MENU_FLAMES *flames;
+    int cell_count = flames_param->width * flames_param->height;
+    int i, k, source;
+
+    flames = malloc(sizeof(MENU_FLAMES));
+    if (flames == NULL)
+    {
+	return ENOMEM;
+    }
+    memset(flames, 0, sizeof(MENU_FLAMES));
+    flames->ref_count = 1;
+    flames->width = flames_param->width;
+    flames->height = flames_param->height;
+    flames->rng = flames_param->seed ? flames_param->seed : 1;
+    flames->step = -1;
+
+    for (i = 0; i < cell_count; i++)
+    {
+	if (flames_param->sources[i] != NULL)
+	{
+	    flames->source_count++;
+	}
+    }
+
+    flames->flames = malloc(sizeof(Sint16) * cell_count * 3);
+    flames->row = malloc(sizeof(Sint16) * flames->width * 3);
+    flames->source_cells = malloc(sizeof(int) * (flames->source_count + 1));
+    flames->source_colors = malloc(
+	sizeof(MENU_FLAME_SOURCE) * (flames->source_count + 1));
+    flames->source_drift = malloc(
+	sizeof(Sint16) * 4 * (flames->source_count + 1));
+    flames->corners = malloc(cell_count * 3);
+    if (flames->flames == NULL || flames->row == NULL 
+	|| flames->source_cells == NULL || flames->source_colors == NULL
+	|| flames->source_drift == NULL || flames->corners == NULL)
+    {
+	menuFlamesUnref(flames);
+	return ENOMEM;
+    }
+    memset(flames->flames, 0, sizeof(Sint16) * cell_count * 3);
+
+    source = 0;
+    for (i = 0; i < cell_count; i++)
+    {
+	if (flames_param->sources[i] != NULL)
+	{
+	    flames->source_cells[source] = i;
+	    flames->source_colors[source] = *flames_param->sources[i];
+	    for (k = 0; k < 4; k++)
+	    {
+		flames->source_drift[source][k] = 
+		    menuFlamesRandom(flames, 0, 1000);
+	    }
+	    source++;
+	}
+    }
+
+    for (i = 0; i < MENU_FLAME_WARMUP_STEPS; i++)
+    {
+	menuFlamesStep(flames);
+    }
+
+    menuFlamesUnref(*state);
+    *state = flames;
+
+    return 0;
+}
+
+/*  Convert each cell's flame intensity to an 8-bit color  */
+static void menuFlamesUpdateCorners(MENU_FLAMES *flames)
+{
+    int i, value;
+    int count = flames->width * flames->height * 3;
+
+    for (i = 0; i < count; i++)
+    {
+	value = flames->flames[i] * 255 / (100 * MENU_FLAME_PRECISION_FACTOR);
+	flames->corners[i] = value < 0 ? 0 : (value > 255 ? 255 : value);
+    }
+}
+
+/*  Catch the simulation up with the display's animation clock, and
+    draw it by bilinear interpolation between cell corners, directly
+    into the frame's pixels with fixed point arithmetic  */
+static int menuFlamesDeferredDraw(
+    BROGUE_DISPLAY *display, void *param, SDL_Surface *surface)
+{
+    MENU_FLAMES *flames = ((MENU_FLAMES_DRAW *)param)->flames;
+    SDL_PixelFormat *format = surface->format;
+    int font_width, font_height, columns, rows;
+    int target, i, j, k, px, py;
+
+    if (format->BytesPerPixel != 4)
+    {
+	return EINVAL;
+    }
+
+    target = display->anim_frame * FRAME_TIME / MENU_FLAME_UPDATE_DELAY;
+    if (flames->step < 0 || target < flames->step 
+	|| target - flames->step > MENU_FLAME_MAX_CATCHUP_STEPS)
+    {
+	flames->step = target - 1;
+    }
+    while (flames->step < target)
+    {
+	menuFlamesStep(flames);
+	flames->step++;
+    }
+    menuFlamesUpdateCorners(flames);
+
+    BrogueDisplay_getFontSize(display, &font_width, &font_height);
+    columns = surface->w / font_width;
+    rows = surface->h / font_height;
+    if (columns > flames->width)
+    {
+	columns = flames->width;
+    }
+    if (rows > flames->height - 1)
+    {
+	rows = flames->height - 1;
+    }
+
+    for (j = 0; j < rows; j++)
+    {
+	for (py = 0; py < font_height; py++)
+	{
+	    Uint32 *pix = (Uint32 *)((char *)surface->pixels 
+		+ (j * font_height + py) * surface->pitch);
+	    int wy = (py * 256 + 128) / font_height;
+
+	    for (i = 0; i < columns; i++)
+	    {
+		const unsigned char *ul, *ur, *bl, *br;
+		int left[3], step[3];
+
+		ul = flames->corners + (j * flames->width + i) * 3;
+		bl = ul + flames->width * 3;
+		ur = (i + 1 < flames->width) ? ul + 3 : ul;
+		br = (i + 1 < flames->width) ? bl + 3 : bl;
+
+		for (k = 0; k < 3; k++)
+		{
+		    int l = (ul[k] * (256 - wy) + bl[k] * wy) << 8;
+		    int r = (ur[k] * (256 - wy) + br[k] * wy) << 8;
+
+		    left[k] = l;
+		    step[k] = (r - l) / font_width;
+		}
+
+		for (px = 0; px < font_width; px++)
+		{
+		    *pix++ = (Uint32)(left[0] >> 16) << format->Rshift
+			| (Uint32)(left[1] >> 16) << format->Gshift
+			| (Uint32)(left[2] >> 16) << format->Bshift;
+
+		    left[0] += step[0];
+		    left[1] += step[1];
+		    left[2] += step[2];
+		}
+	    }
+	}
+    }
+
+    return 0;
+}
+
+/*  Release the deferred draw's reference to the simulation  */
+static void menuFlamesDeferredFree(void *param)
+{
+    MENU_FLAMES_DRAW *draw = (MENU_FLAMES_DRAW *)param;
+
+    menuFlamesUnref(draw->flames);
+    free(draw);
+}
+
+/*  Generate an animated deferred draw of the flames, covering the
+    window from the draw position  */
+static BROGUE_DEFERRED_DRAW *menuFlamesDraw(
+    BROGUE_WINDOW *window, const BROGUE_DRAW_CONTEXT_STATE *context_state, 
+    void *effect_state, int x, int y, const wchar_t *str)
+{
+    MENU_FLAMES *flames = *(MENU_FLAMES **)effect_state;
+    MENU_FLAMES_DRAW *flames_draw;
+    BROGUE_DEFERRED_DRAW *draw;
+
+    if (flames == NULL)
+    {
+	return NULL;
+    }
+
+    flames_draw = BrogueDisplay_allocate(
+	window->display, sizeof(MENU_FLAMES_DRAW));
+    if (flames_draw == NULL)
+    {
 	return NULL;
     }
+    flames->ref_count++;
+    flames_draw->flames = flames;
+
+    draw = BrogueDeferredDraw_create(
+	window, menuFlamesDeferredDraw, menuFlamesDeferredFree,
+	flames_draw, x, y, window->width - x, window->height - y);
+    if (draw == NULL)
+    {
+	menuFlamesDeferredFree(flames_draw);
+	return NULL;
+    }
+    draw->is_animated = 1;
 
     return draw;
 }
@@ -696,4 +1462,8 @@ void BrogueEffects_registerAll(BROGUE_DISPLAY *display)
 	display, BUTTON_EFFECT_NAME,
 	buttonNew, buttonDestroy,
 	buttonSetParam, buttonDraw);
+    BrogueDisplay_registerEffectClass(
+	display, MENU_FLAMES_EFFECT_NAME,
+	menuFlamesNew, menuFlamesDestroy,
+	menuFlamesSetParam, menuFlamesDraw);
 }
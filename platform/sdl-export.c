@@ -0,0 +1,359 @@
+/*
+ *  sdl-export.c
+ *
+ *  Created by Matt Kimball.
+ *  Copyright 2013. All rights reserved.
+ *
+ *  This file is part of Brogue.
+ *
+ *  Brogue is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Brogue is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Brogue.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "sdl-display.h"
+
+/*  Frames waiting to be encoded.  Rendering stalls when the encoder
+    falls this far behind.  */
+#define EXPORT_QUEUE_DEPTH 4
+
+typedef struct BROGUE_EXPORT_FRAME BROGUE_EXPORT_FRAME;
+typedef struct BROGUE_EXPORT BROGUE_EXPORT;
+
+/*  A copy of the screen, as 0x00RRGGBB pixels, waiting to be encoded  */
+struct BROGUE_EXPORT_FRAME
+{
+    unsigned number;
+    int width, height;
+    Uint32 *pixels;
+    size_t capacity;
+};
+
+/*  The state of a frame export.  There is only one, as there is only
+    one screen to export.  */
+struct BROGUE_EXPORT
+{
+    int active;
+    char *directory;
+    int interval;
+    int format;
+
+    unsigned offered_count;
+    unsigned written_count;
+
+    /*  A ring of frames, filled by the main thread and drained by the
+	encoder thread  */
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    BROGUE_EXPORT_FRAME queue[EXPORT_QUEUE_DEPTH];
+    int head, count;
+    int quit;
+    int error;
+};
+
+static BROGUE_EXPORT exporter;
+
+/*  Write a frame as a binary PPM  */
+static int BrogueExport_writePpm(BROGUE_EXPORT_FRAME *frame, const char *path)
+{
+    unsigned char *row;
+    FILE *file;
+    int x, y, err = 0;
+
+    row = malloc(frame->width * 3);
+    if (row == NULL)
+    {
+	return ENOMEM;
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL)
+    {
+	free(row);
+	return errno;
+    }
+
+    fprintf(file, "P6\n%d %d\n255\n", frame->width, frame->height);
+    for (y = 0; y < frame->height && !err; y++)
+    {
+	Uint32 *pix = frame->pixels + y * frame->width;
+
+	for (x = 0; x < frame->width; x++)
+	{
+	    row[x * 3] = (pix[x] >> 16) & 0xFF;
+	    row[x * 3 + 1] = (pix[x] >> 8) & 0xFF;
+	    row[x * 3 + 2] = pix[x] & 0xFF;
+	}
+	if (fwrite(row, 3, frame->width, file) != frame->width)
+	{
+	    err = errno ? errno : EIO;
+	}
+    }
+
+    if (fclose(file) && !err)
+    {
+	err = errno;
+    }
+    free(row);
+
+    return err;
+}
+
+/*  Write a frame as a PNG, through cairo  */
+static int BrogueExport_writePng(BROGUE_EXPORT_FRAME *frame, const char *path)
+{
+    cairo_surface_t *surface;
+    cairo_status_t status;
+
+    surface = cairo_image_surface_create_for_data(
+	(unsigned char *)frame->pixels, CAIRO_FORMAT_RGB24,
+	frame->width, frame->height, frame->width * 4);
+    if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
+    {
+	cairo_surface_destroy(surface);
+	return ENOMEM;
+    }
+
+    status = cairo_surface_write_to_png(surface, path);
+    cairo_surface_destroy(surface);
+
+    return status == CAIRO_STATUS_SUCCESS ? 0 : EIO;
+}
+
+/*  Encode a frame to a numbered file in the export directory  */
+static int BrogueExport_encode(BROGUE_EXPORT_FRAME *frame)
+{
+    char *path;
+    int err;
+
+    path = g_strdup_printf(
+	"%s/frame%06u.%s", exporter.directory, frame->number,
+	exporter.format == BROGUE_EXPORT_PPM ? "ppm" : "png");
+    if (path == NULL)
+    {
+	return ENOMEM;
+    }
+
+    if (exporter.format == BROGUE_EXPORT_PPM)
+    {
+	err = BrogueExport_writePpm(frame, path);
+    }
+    else
+    {
+	err = BrogueExport_writePng(frame, path);
+    }
+    g_free(path);
+
+    return err;
+}
+
+/*  The encoder thread, which encodes frames in the order they were
+    queued until told to quit with the queue empty  */
+static int BrogueExport_encoderThread(void *data)
+{
+    BROGUE_EXPORT_FRAME *frame;
+    int err;
+
+    SDL_LockMutex(exporter.mutex);
+    for (;;)
+    {
+	while (exporter.count == 0 && !exporter.quit)
+	{
+	    SDL_CondWait(exporter.cond, exporter.mutex);
+	}
+	if (exporter.count == 0)
+	{
+	    break;
+	}
+
+	frame = &exporter.queue[exporter.head];
+	SDL_UnlockMutex(exporter.mutex);
+
+	err = BrogueExport_encode(frame);
+
+	SDL_LockMutex(exporter.mutex);
+	if (err && !exporter.error)
+	{
+	    exporter.error = err;
+	}
+	exporter.head = (exporter.head + 1) % EXPORT_QUEUE_DEPTH;
+	exporter.count--;
+	SDL_CondBroadcast(exporter.cond);
+    }
+    SDL_UnlockMutex(exporter.mutex);
+
+    return 0;
+}
+
+/*  Start exporting every interval'th frame to a directory, creating
+    the directory if needed  */
+int BrogueExport_open(const char *directory, int interval, int format)
+{
+    if (exporter.active)
+    {
+	return EINVAL;
+    }
+
+    if (g_mkdir_with_parents(directory, 0755))
+    {
+	return errno;
+    }
+
+    memset(&exporter, 0, sizeof(BROGUE_EXPORT));
+    exporter.interval = interval > 0 ? interval : 1;
+    exporter.format = format;
+    exporter.directory = g_strdup(directory);
+    exporter.mutex = SDL_CreateMutex();
+    exporter.cond = SDL_CreateCond();
+    if (exporter.directory == NULL || exporter.mutex == NULL
+	|| exporter.cond == NULL)
+    {
+	BrogueExport_close();
+	return ENOMEM;
+    }
+
+    exporter.thread = SDL_CreateThread(BrogueExport_encoderThread, NULL);
+    if (exporter.thread == NULL)
+    {
+	BrogueExport_close();
+	return ENOMEM;
+    }
+    exporter.active = 1;
+
+    return 0;
+}
+
+/*  Offer a rendered frame for export.  The screen is copied into the
+    queue, so that rendering can continue while the encoder writes it.
+    Returns an error if the encoder has failed to write a frame.  */
+int BrogueExport_frame(SDL_Surface *screen)
+{
+    SDL_PixelFormat *format = screen->format;
+    BROGUE_EXPORT_FRAME *frame;
+    size_t size;
+    int x, y, slot, err;
+
+    if (!exporter.active)
+    {
+	return 0;
+    }
+    if (exporter.offered_count++ % exporter.interval != 0)
+    {
+	return 0;
+    }
+    if (format->BytesPerPixel != 4)
+    {
+	return EINVAL;
+    }
+
+    SDL_LockMutex(exporter.mutex);
+    while (exporter.count == EXPORT_QUEUE_DEPTH && !exporter.error)
+    {
+	SDL_CondWait(exporter.cond, exporter.mutex);
+    }
+    err = exporter.error;
+    slot = (exporter.head + exporter.count) % EXPORT_QUEUE_DEPTH;
+    SDL_UnlockMutex(exporter.mutex);
+    if (err)
+    {
+	return err;
+    }
+
+    /*  The slot after the queued frames isn't touched by the encoder
+	until it is counted  */
+    frame = &exporter.queue[slot];
+    size = (size_t)screen->w * screen->h;
+    if (frame->capacity < size)
+    {
+	Uint32 *pixels = realloc(frame->pixels, size * sizeof(Uint32));
+
+	if (pixels == NULL)
+	{
+	    return ENOMEM;
+	}
+	frame->pixels = pixels;
+	frame->capacity = size;
+    }
+    frame->number = exporter.written_count++;
+    frame->width = screen->w;
+    frame->height = screen->h;
+
+    for (y = 0; y < screen->h; y++)
+    {
+	Uint32 *src = (Uint32 *)((Uint8 *)screen->pixels + y * screen->pitch);
+	Uint32 *dst = frame->pixels + y * screen->w;
+
+	for (x = 0; x < screen->w; x++)
+	{
+	    Uint32 p = src[x];
+
+	    dst[x] = ((p & format->Rmask) >> format->Rshift) << 16
+		| ((p & format->Gmask) >> format->Gshift) << 8
+		| ((p & format->Bmask) >> format->Bshift);
+	}
+    }
+
+    SDL_LockMutex(exporter.mutex);
+    exporter.count++;
+    SDL_CondBroadcast(exporter.cond);
+    SDL_UnlockMutex(exporter.mutex);
+
+    return 0;
+}
+
+/*  Finish encoding the queued frames and stop exporting.  Returns an
+    error if any frame failed to be written.  */
+int BrogueExport_close(void)
+{
+    int i, err;
+
+    if (exporter.thread != NULL)
+    {
+	SDL_LockMutex(exporter.mutex);
+	exporter.quit = 1;
+	SDL_CondBroadcast(exporter.cond);
+	SDL_UnlockMutex(exporter.mutex);
+
+	SDL_WaitThread(exporter.thread, NULL);
+    }
+    err = exporter.error;
+
+    if (exporter.cond != NULL)
+    {
+	SDL_DestroyCond(exporter.cond);
+    }
+    if (exporter.mutex != NULL)
+    {
+	SDL_DestroyMutex(exporter.mutex);
+    }
+    for (i = 0; i < EXPORT_QUEUE_DEPTH; i++)
+    {
+	free(exporter.queue[i].pixels);
+    }
+    g_free(exporter.directory);
+    memset(&exporter, 0, sizeof(BROGUE_EXPORT));
+
+    return err;
+}
+
+/*  The number of frames queued for export so far  */
+unsigned BrogueExport_getFrameCount(void)
+{
+    return exporter.written_count;
+}
@@ -25,6 +25,8 @@
 #include <unistd.h>
 #include <locale.h>
 #include <iconv.h>
+#include <time.h>
+#include <glib/gstdio.h>
 
 #include "platform.h"
 #include "IncludeGlobals.h"
@@ -43,8 +45,44 @@
 #define MIN_FONT_SIZE 4
 #define MAX_FONT_SIZE 128
 
+/*  Font metrics measured by earlier runs are kept in the save directory  */
+#define FONT_METRICS_CACHE_FILENAME "font-metrics.cache"
+#define FONT_METRICS_CACHE_MAGIC "BRGFNTM"
+#define FONT_METRICS_CACHE_VERSION 2
+
+/*  How often to check for animation while idle, in milliseconds  */
+#define IDLE_WAIT_TIME 250
+
+/*  The most CPU a parked game may use in a headless idle check, as a 
+    percentage of one core  */
+#define IDLE_CPU_LIMIT 5.0
+
+/*  The seeds whose first levels are drawn by the headless lighting 
+    check, and how deep into each it goes  */
+#define LIGHTING_CHECK_SEEDS { 1, 2, 3, 42, 1000, 31337, 65535, 123456 }
+#define LIGHTING_CHECK_DEPTHS 3
+
+/*  The font size used for headless replay, unless one is given  */
+#define HEADLESS_FONT_SIZE 14
+
+/*  The number of cell sizes whose fonts and glyphs are kept loaded  */
+#define RECENT_FONTSET_COUNT 3
+
+/*  The frame time overlay, with a line for each profiled stage  */
+#define FRAME_TIME_WINDOW_WIDTH 28
+#define FRAME_TIME_WINDOW_HEIGHT (5 + BROGUE_PROFILE_STAGE_COUNT)
+#define PROFILE_BAR_WIDTH 26
+
 extern playerCharacter rogue;
 extern short brogueFontSize;
+extern int brogueTextCacheKilobytes;
+extern int brogueRasterThreads;
+extern char *brogueProfileCsvPath;
+extern char *brogueExportDirectory;
+extern int brogueExportInterval;
+extern int brogueExportFormat;
+extern int brogueIdleCheckSeconds;
+extern int brogueCheckLighting;
 
 /*  We store characters drawn to the console so that we can redraw them
     when scaling the font or switching to full-screen.  */
@@ -67,6 +105,29 @@ struct SDL_CONSOLE_FONT_METRICS
 };
 typedef struct SDL_CONSOLE_FONT_METRICS SDL_CONSOLE_FONT_METRICS;
 
+/*  The header of the font metrics cache file, which is followed by 
+    the metrics of each size measured  */
+struct FONT_METRICS_CACHE_HEADER
+{
+    char magic[8];
+    guint32 version;
+    guint32 entry_count;
+    guint64 font_hash;
+};
+typedef struct FONT_METRICS_CACHE_HEADER FONT_METRICS_CACHE_HEADER;
+
+/*  The fonts and glyphs loaded for one cell size, which are kept for a
+    while after switching to another size so that switching back, as 
+    when toggling fullscreen, needn't load them again.  */
+struct SDL_CONSOLE_FONTSET
+{
+    SDL_CONSOLE_FONT_METRICS metrics;
+    TTF_Font *mono_font;
+    TTF_Font *sans_font;
+    SDL_SVGSET *svgset;
+};
+typedef struct SDL_CONSOLE_FONTSET SDL_CONSOLE_FONTSET;
+
 /*  We store important information about the state of the console in 
     an instance of SDL_CONSOLE.  */
 struct SDL_CONSOLE
@@ -93,18 +154,41 @@ struct SDL_CONSOLE
     SDL_CONSOLE_FONT_METRICS metrics;
     SDL_SVGSET *svgset;
 
+    /*  Recently used fontsets, the one in use first  */
+    SDL_CONSOLE_FONTSET *fontsets[RECENT_FONTSET_COUNT];
+    int fontset_count;
+
     int mouse_x, mouse_y;
     SDL_KEYMAP *keymap;
 
     int screen_dirty;
+
+    /*  Metrics for each font size, measured as they are needed.  Sizes
+	not yet measured have a point size of zero.  */
     SDL_CONSOLE_FONT_METRICS *all_metrics;
+    guint64 font_hash;
+    int metrics_dirty;
 
     unsigned last_frame_timestamp;
+    unsigned frame_deadline;
     int enable_frame_time_display;
     BROGUE_WINDOW *frame_time_window;
     BROGUE_DRAW_CONTEXT *frame_time_context;
     unsigned frame_count;
     unsigned accumulated_frame_time;
+    unsigned last_alloc_count;
+
+    /*  Headless replay renders offscreen by a virtual clock, hashing
+	each frame which changes so that runs can be compared  */
+    int headless;
+    int headless_playback_seen;
+    int lighting_check_seed;
+    int lighting_check_active;
+    int lighting_check_failed;
+    Uint32 virtual_time;
+    unsigned headless_frame_count;
+    unsigned headless_frame_capacity;
+    double *headless_frame_times;
 };
 typedef struct SDL_CONSOLE SDL_CONSOLE;
 
@@ -164,31 +248,287 @@ char *SdlConsole_getResourcePath(const char *file)
     return ret;
 }
 
+/*  Return the directory used for saved games, creating it if needed.
+    This matches initializeBrogueSaveLocation, but is needed before
+    the game has changed to that directory.  */
+char *SdlConsole_getSaveDirectory(void)
+{
+    char *path = g_build_filename(g_get_user_data_dir(), "Brogue", NULL);
+
+    if (path != NULL)
+    {
+	g_mkdir_with_parents(path, 0755);
+    }
+
+    return path;
+}
+
+/*  Measure the cell size for the monospace font at a point size.  */
+static void SdlConsole_measureFont(int size, SDL_CONSOLE_FONT_METRICS *metrics)
+{
+    char *font_path;
+    TTF_Font *font;
+    double aspect_ratio;
+
+    font_path = SdlConsole_getResourcePath(MONO_FONT_FILENAME);
+    font = TTF_OpenFont(font_path, size);
+    free(font_path);
+    if (font == NULL)
+    {
+	printf("%s\n", TTF_GetError());
+	exit(1);
+    }
+
+    metrics->point_size = size;
+    metrics->height = TTF_FontAscent(font) - TTF_FontDescent(font) + 1;
+    metrics->descent = TTF_FontDescent(font);
+    if (TTF_SizeText(font, "M", &metrics->width, NULL))
+    {
+	printf("%s\n", TTF_GetError());
+	exit(1);
+    }
+
+    TTF_CloseFont(font);
+
+    /*  We'll target the aspect ratio of the SVG tile set, extending
+	the dimensions of the font as necessary to match.  */
+    aspect_ratio = (double)metrics->width / (double)metrics->height;
+    if (aspect_ratio < TARGET_ASPECT_RATIO)
+    {
+	metrics->width = (int)(TARGET_ASPECT_RATIO * metrics->height);
+    }
+    else
+    {
+	metrics->height = (int)(metrics->width / TARGET_ASPECT_RATIO);
+    }
+}
+
+/*  Get the metrics for a font size, measuring them if this is the first
+    time the size has been needed.  */
+SDL_CONSOLE_FONT_METRICS SdlConsole_getFontMetrics(int size)
+{
+    SDL_CONSOLE_FONT_METRICS *metrics;
+
+    if (size < MIN_FONT_SIZE)
+    {
+	size = MIN_FONT_SIZE;
+    }
+    if (size > MAX_FONT_SIZE)
+    {
+	size = MAX_FONT_SIZE;
+    }
+
+    metrics = &console.all_metrics[size - MIN_FONT_SIZE];
+    if (metrics->point_size == 0)
+    {
+	SdlConsole_measureFont(size, metrics);
+	console.metrics_dirty = 1;
+    }
+
+    return *metrics;
+}
+
+/*  Hash the path, size and modification time of the monospace font, 
+    so that cached metrics are discarded if the font changes, without 
+    reading the whole font.  Returns zero if the font can't be found.  */
+static guint64 SdlConsole_hashFontFile(void)
+{
+    char *font_path;
+    GStatBuf info;
+    guint64 values[2];
+    unsigned char *bytes;
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    int i;
+
+    font_path = SdlConsole_getResourcePath(MONO_FONT_FILENAME);
+    if (font_path == NULL)
+    {
+	return 0;
+    }
+    if (g_stat(font_path, &info) != 0)
+    {
+	free(font_path);
+	return 0;
+    }
+
+    for (i = 0; font_path[i] != 0; i++)
+    {
+	hash = (hash ^ (unsigned char)font_path[i]) 
+	    * G_GUINT64_CONSTANT(1099511628211);
+    }
+    free(font_path);
+
+    values[0] = (guint64)info.st_size;
+    values[1] = (guint64)info.st_mtime;
+    bytes = (unsigned char *)values;
+    for (i = 0; i < (int)sizeof(values); i++)
+    {
+	hash = (hash ^ bytes[i]) * G_GUINT64_CONSTANT(1099511628211);
+    }
+
+    return hash;
+}
+
+/*  Return the path of the font metrics cache, to be freed with g_free.  */
+static char *SdlConsole_getFontMetricsCachePath(void)
+{
+    char *save_path;
+    char *cache_path;
+
+    save_path = SdlConsole_getSaveDirectory();
+    if (save_path == NULL)
+    {
+	return NULL;
+    }
+
+    cache_path = g_build_filename(
+	save_path, FONT_METRICS_CACHE_FILENAME, NULL);
+    g_free(save_path);
+
+    return cache_path;
+}
+
+/*  Load the metrics measured by earlier runs with the same font.  */
+void SdlConsole_loadFontMetrics(void)
+{
+    FONT_METRICS_CACHE_HEADER *header;
+    SDL_CONSOLE_FONT_METRICS *entries;
+    char *cache_path;
+    gchar *contents;
+    gsize length;
+    unsigned i;
+
+    console.font_hash = SdlConsole_hashFontFile();
+    if (console.font_hash == 0)
+    {
+	return;
+    }
+
+    cache_path = SdlConsole_getFontMetricsCachePath();
+    if (cache_path == NULL)
+    {
+	return;
+    }
+    if (!g_file_get_contents(cache_path, &contents, &length, NULL))
+    {
+	g_free(cache_path);
+	return;
+    }
+    g_free(cache_path);
+
+    header = (FONT_METRICS_CACHE_HEADER *)contents;
+    entries = (SDL_CONSOLE_FONT_METRICS *)(header + 1);
+    if (length < sizeof(FONT_METRICS_CACHE_HEADER)
+	|| memcmp(header->magic, FONT_METRICS_CACHE_MAGIC, 8)
+	|| header->version != FONT_METRICS_CACHE_VERSION
+	|| header->font_hash != console.font_hash
+	|| header->entry_count > MAX_FONT_SIZE - MIN_FONT_SIZE + 1
+	|| length != sizeof(FONT_METRICS_CACHE_HEADER) 
+	    + header->entry_count * sizeof(SDL_CONSOLE_FONT_METRICS))
+    {
+	g_free(contents);
+	return;
+    }
+
+    for (i = 0; i < header->entry_count; i++)
+    {
+	int size = entries[i].point_size;
+
+	if (size >= MIN_FONT_SIZE && size <= MAX_FONT_SIZE)
+	{
+	    console.all_metrics[size - MIN_FONT_SIZE] = entries[i];
+	}
+    }
+
+    g_free(contents);
+}
+
+/*  Save the metrics measured so far, if any are new.  */
+void SdlConsole_saveFontMetrics(void)
+{
+    FONT_METRICS_CACHE_HEADER *header;
+    SDL_CONSOLE_FONT_METRICS *entries;
+    char *cache_path;
+    gchar *contents;
+    gsize length;
+    int size, count;
+
+    if (!console.metrics_dirty || console.font_hash == 0)
+    {
+	return;
+    }
+
+    length = sizeof(FONT_METRICS_CACHE_HEADER) 
+	+ (MAX_FONT_SIZE - MIN_FONT_SIZE + 1) 
+	* sizeof(SDL_CONSOLE_FONT_METRICS);
+    contents = malloc(length);
+    if (contents == NULL)
+    {
+	return;
+    }
+    memset(contents, 0, length);
+    header = (FONT_METRICS_CACHE_HEADER *)contents;
+    entries = (SDL_CONSOLE_FONT_METRICS *)(header + 1);
+
+    count = 0;
+    for (size = MIN_FONT_SIZE; size <= MAX_FONT_SIZE; size++)
+    {
+	if (console.all_metrics[size - MIN_FONT_SIZE].point_size != 0)
+	{
+	    entries[count++] = console.all_metrics[size - MIN_FONT_SIZE];
+	}
+    }
+
+    memcpy(header->magic, FONT_METRICS_CACHE_MAGIC, 8);
+    header->version = FONT_METRICS_CACHE_VERSION;
+    header->entry_count = count;
+    header->font_hash = console.font_hash;
+    length = sizeof(FONT_METRICS_CACHE_HEADER) 
+	+ count * sizeof(SDL_CONSOLE_FONT_METRICS);
+
+    cache_path = SdlConsole_getFontMetricsCachePath();
+    if (cache_path != NULL)
+    {
+	g_file_set_contents(cache_path, contents, length, NULL);
+	g_free(cache_path);
+    }
+    free(contents);
+
+    console.metrics_dirty = 0;
+}
+
+/*  Find the largest font size which fits the whole console in a window.
+    We binary search, measuring only the sizes probed, which assumes
+    that a larger point size never has a smaller cell.  That holds for
+    the fonts we ship, but a font whose metrics dip as it grows could
+    have us settle on a size a little smaller than the best fit.  */
 SDL_CONSOLE_FONT_METRICS SdlConsole_getFontSizeForWindow(
     int target_width, int target_height)
 {
     SDL_CONSOLE_FONT_METRICS metrics;
-    int size;
+    int low, high, mid;
 
-    size = MIN_FONT_SIZE;
-    while (size < MAX_FONT_SIZE)
+    low = MIN_FONT_SIZE;
+    high = MAX_FONT_SIZE;
+    while (low < high)
     {
-	SDL_CONSOLE_FONT_METRICS *next_metrics = 
-	    &console.all_metrics[size + 1 - MIN_FONT_SIZE];
-	
-	if (next_metrics->width * SCREEN_WIDTH > target_width)
+	SDL_CONSOLE_FONT_METRICS mid_metrics;
+
+	mid = (low + high + 1) / 2;
+	mid_metrics = SdlConsole_getFontMetrics(mid);
+
+	if (mid_metrics.width * SCREEN_WIDTH > target_width
+	    || mid_metrics.height * SCREEN_HEIGHT > target_height)
 	{
-	    break;
+	    high = mid - 1;
 	}
-	if (next_metrics->height * SCREEN_HEIGHT > target_height)
+	else
 	{
-	    break;
+	    low = mid;
 	}
-	
-	size++;
     }
 
-    metrics = console.all_metrics[size - MIN_FONT_SIZE];
+    metrics = SdlConsole_getFontMetrics(low);
     while ((metrics.width + 1) * SCREEN_WIDTH <= target_width)
     {
 	metrics.width++;
@@ -214,50 +554,16 @@ SDL_CONSOLE_FONT_METRICS SdlConsole_getFontSizeForScreen(void)
     return SdlConsole_getFontSizeForWindow(target_width, target_height);
 }
 
-/*  Extract metric information for all font sizes we might use to display.  */
+/*  Choose the initial font size.  Metrics are measured only for the
+    sizes considered, unless an earlier run has already measured them.  */
 void SdlConsole_generateFontMetrics(void)
 {
     int size;
 
-    for (size = MIN_FONT_SIZE; size <= MAX_FONT_SIZE; size++)
+    /*  Headless replay leaves the user's cache alone  */
+    if (!console.headless)
     {
-	char *font_path;
-	TTF_Font *font;
-	SDL_CONSOLE_FONT_METRICS *metrics = 
-	    &console.all_metrics[size - MIN_FONT_SIZE];
-	double aspect_ratio;
-
-	font_path = SdlConsole_getResourcePath(MONO_FONT_FILENAME);
-	font = TTF_OpenFont(font_path, size);
-	free(font_path);
-	if (font == NULL)
-	{
-	    printf("%s\n", TTF_GetError());
-	    exit(1);
-	}
-
-	metrics->point_size = size;
-	metrics->height = TTF_FontAscent(font) - TTF_FontDescent(font) + 1;
-	metrics->descent = TTF_FontDescent(font);
-	if (TTF_SizeText(font, "M", &metrics->width, NULL))
-	{
-	    printf("%s\n", TTF_GetError());
-	    exit(1);
-	}
-
-	TTF_CloseFont(font);
-
-	/*  We'll target the aspect ratio of the SVG tile set, extending
-	    the dimensions of the font as necessary to match.  */
-	aspect_ratio = (double)metrics->width / (double)metrics->height;
-	if (aspect_ratio < TARGET_ASPECT_RATIO)
-	{
-	    metrics->width = (int)(TARGET_ASPECT_RATIO * metrics->height);
-	}
-	else
-	{
-	    metrics->height = (int)(metrics->width / TARGET_ASPECT_RATIO);
-	}
+	SdlConsole_loadFontMetrics();
     }
 
     size = brogueFontSize;
@@ -266,13 +572,18 @@ void SdlConsole_generateFontMetrics(void)
 	size = -1;
     }
 
+    if (size == -1 && console.headless)
+    {
+	size = HEADLESS_FONT_SIZE;
+    }
+
     if (size == -1)
     {
 	console.metrics = SdlConsole_getFontSizeForScreen();
     }
     else
     {
-	console.metrics = console.all_metrics[size - MIN_FONT_SIZE];
+	console.metrics = SdlConsole_getFontMetrics(size);
     }
 }
 
@@ -310,65 +621,176 @@ void SdlConsole_setFullscreenMode(void) {
     }
 }
 
-/*  We need to reload the font and adjust the video mode when changing
-    font size.  The fullscreen enable/disable path goes through here, too.  */
-void SdlConsole_scaleFont(boolean set_dimensions)
+/*  Load the fonts and glyphs for a cell size.  While the glyphs are
+    rasterized in the background, those of 'previous' stand in, scaled
+    to the new size.  */
+SDL_CONSOLE_FONTSET *SdlConsole_loadFontset(
+    SDL_CONSOLE_FONT_METRICS *metrics, SDL_CONSOLE_FONTSET *previous)
 {
+    SDL_CONSOLE_FONTSET *fontset;
     char *font_path;
     char *svg_path;
+    char *save_path;
 
-    BrogueDisplay_setScreen(console.display, NULL);
-    BrogueDisplay_setFonts(console.display, NULL, NULL, 0, 0);
-    BrogueDisplay_setSvgset(console.display, NULL);
-
-    if (console.mono_font != NULL)
-    {
-	TTF_CloseFont(console.mono_font);
-    }
-    if (console.sans_font != NULL)
+    fontset = malloc(sizeof(SDL_CONSOLE_FONTSET));
+    if (fontset == NULL)
     {
-	TTF_CloseFont(console.sans_font);
-    }
-    if (console.svgset != NULL)
-    {
-	SdlSvgset_free(console.svgset);
+	printf("Failed to allocate fonts\n");
+	exit(1);
     }
+    memset(fontset, 0, sizeof(SDL_CONSOLE_FONTSET));
+    fontset->metrics = *metrics;
 
-    console.screen = NULL;
-    if (console.fullscreen && set_dimensions)
-    {
-	SdlConsole_setFullscreenMode();
-    }
-    
     font_path = SdlConsole_getResourcePath(MONO_FONT_FILENAME);
-    console.mono_font = TTF_OpenFont(font_path, console.metrics.point_size);
+    fontset->mono_font = TTF_OpenFont(font_path, metrics->point_size);
     free(font_path);
-    if (console.mono_font == NULL)
+    if (fontset->mono_font == NULL)
     {
 	printf("%s\n", TTF_GetError());
 	exit(1);
     }
 
     font_path = SdlConsole_getResourcePath(SANS_FONT_FILENAME);
-    console.sans_font = TTF_OpenFont(font_path, console.metrics.point_size);
+    fontset->sans_font = TTF_OpenFont(font_path, metrics->point_size);
     free(font_path);
-    if (console.sans_font == NULL)
+    if (fontset->sans_font == NULL)
     {
 	printf("%s\n", TTF_GetError());
 	exit(1);
     }
 
     svg_path = SdlConsole_getResourcePath(SVG_PATH);
-    console.svgset = SdlSvgset_alloc(svg_path, 
-				     console.metrics.width,
-				     console.metrics.height);
+    fontset->svgset = SdlSvgset_alloc(svg_path, 
+				      metrics->width, metrics->height);
     free(svg_path);
-    if (console.svgset == NULL)
+    if (fontset->svgset == NULL)
     {
 	printf("Failure to load SVG set\n");
 	exit(1);
     }
 
+    /*  Glyphs rasterized at this cell size by an earlier run are cached
+	on disk.  Otherwise, they are rasterized as they are first drawn,
+	but we can get a head start on the rest in the background.  
+	Headless replay leaves the user's cache alone.  */
+    if (!console.headless)
+    {
+	save_path = SdlConsole_getSaveDirectory();
+	if (save_path != NULL)
+	{
+	    SdlSvgset_useCache(fontset->svgset, save_path);
+	    g_free(save_path);
+	}
+	if (SdlSvgset_warm(fontset->svgset) && previous != NULL)
+	{
+	    SdlSvgset_setFallback(fontset->svgset, previous->svgset);
+	}
+    }
+
+    return fontset;
+}
+
+/*  Free a fontset, and the glyphs the display rendered from its fonts
+    unless another fontset shares its point size.  */
+void SdlConsole_freeFontset(SDL_CONSOLE_FONTSET *fontset)
+{
+    int i, shared = 0;
+
+    for (i = 0; i < console.fontset_count; i++)
+    {
+	SDL_SVGSET *svgset = console.fontsets[i]->svgset;
+
+	if (SdlSvgset_getFallback(svgset) == fontset->svgset)
+	{
+	    SdlSvgset_setFallback(svgset, NULL);
+	}
+	if (console.fontsets[i]->metrics.point_size 
+	    == fontset->metrics.point_size)
+	{
+	    shared = 1;
+	}
+    }
+
+    if (!shared && console.display != NULL)
+    {
+	BrogueDisplay_discardGlyphPointSize(
+	    console.display, fontset->metrics.point_size);
+    }
+
+    TTF_CloseFont(fontset->mono_font);
+    TTF_CloseFont(fontset->sans_font);
+    SdlSvgset_free(fontset->svgset);
+    free(fontset);
+}
+
+/*  Make the fontset for the current metrics the one in use, loading it
+    if it isn't one of those recently used.  */
+void SdlConsole_useFontset(void)
+{
+    SDL_CONSOLE_FONTSET *fontset = NULL;
+    SDL_CONSOLE_FONT_METRICS *metrics = &console.metrics;
+    int i;
+
+    for (i = 0; i < console.fontset_count; i++)
+    {
+	SDL_CONSOLE_FONTSET *recent = console.fontsets[i];
+
+	if (recent->metrics.point_size == metrics->point_size
+	    && recent->metrics.width == metrics->width
+	    && recent->metrics.height == metrics->height)
+	{
+	    fontset = recent;
+	    memmove(&console.fontsets[1], &console.fontsets[0],
+		    sizeof(SDL_CONSOLE_FONTSET *) * i);
+	    break;
+	}
+    }
+
+    if (fontset == NULL)
+    {
+	fontset = SdlConsole_loadFontset(
+	    metrics, console.fontset_count > 0 ? console.fontsets[0] : NULL);
+
+	if (console.fontset_count == RECENT_FONTSET_COUNT)
+	{
+	    SDL_CONSOLE_FONTSET *oldest = 
+		console.fontsets[RECENT_FONTSET_COUNT - 1];
+
+	    console.fontset_count--;
+	    SdlConsole_freeFontset(oldest);
+	}
+
+	memmove(&console.fontsets[1], &console.fontsets[0],
+		sizeof(SDL_CONSOLE_FONTSET *) * console.fontset_count);
+	console.fontset_count++;
+    }
+    console.fontsets[0] = fontset;
+
+    console.mono_font = fontset->mono_font;
+    console.sans_font = fontset->sans_font;
+    console.svgset = fontset->svgset;
+}
+
+/*  We need to switch fonts and adjust the video mode when changing font
+    size.  The fullscreen enable/disable path goes through here, too.  */
+void SdlConsole_scaleFont(boolean set_dimensions)
+{
+    BrogueDisplay_setScreen(console.display, NULL);
+    BrogueDisplay_setFonts(console.display, NULL, NULL, 0, 0);
+    BrogueDisplay_setSvgset(console.display, NULL);
+
+    if (console.headless && console.screen != NULL)
+    {
+	SDL_FreeSurface(console.screen);
+    }
+    console.screen = NULL;
+    if (console.fullscreen && set_dimensions)
+    {
+	SdlConsole_setFullscreenMode();
+    }
+
+    SdlConsole_useFontset();
+
     /*  If fullscreen fails or isn't set, we'll fall back to windowed.  */
     if (console.screen == NULL)
     {
@@ -381,9 +803,18 @@ void SdlConsole_scaleFont(boolean set_dimensions)
 	    console.margin_y = 0;
 	}
 
-	console.screen = SDL_SetVideoMode(console.width, console.height, 32,
-					  SDL_SWSURFACE | SDL_ANYFORMAT |
-					  SDL_RESIZABLE);
+	if (console.headless)
+	{
+	    console.screen = SDL_CreateRGBSurface(
+		0, console.width, console.height, 32, 
+		0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	}
+	else
+	{
+	    console.screen = SDL_SetVideoMode(
+		console.width, console.height, 32,
+		SDL_SWSURFACE | SDL_ANYFORMAT | SDL_RESIZABLE);
+	}
     }
     
     if (console.screen == NULL)
@@ -393,17 +824,32 @@ void SdlConsole_scaleFont(boolean set_dimensions)
     }
 
     BrogueDisplay_setScreen(console.display, console.screen);
+    BrogueDisplay_setGlyphPointSize(console.display, 
+				    console.metrics.point_size);
     BrogueDisplay_setFonts(console.display, 
 			   console.mono_font, console.sans_font,
 			   console.metrics.width, console.metrics.height);
     BrogueDisplay_setSvgset(console.display, console.svgset);
+
+    if (!console.headless)
+    {
+	SdlConsole_saveFontMetrics();
+    }
 }
 
-/*  Flip the screen buffer if anything has been drawn since the last flip.  */
+/*  Push the regions of the screen which have changed since the last 
+    refresh.  */
 void SdlConsole_refresh(void)
 {
+    /*  Once the glyphs for a new cell size are all rasterized, redraw
+	everything drawn with the scaled glyphs standing in for them  */
+    if (console.svgset != NULL && SdlSvgset_dropProvisional(console.svgset))
+    {
+	BrogueDisplay_damageAll(console.display);
+    }
+
     BrogueDisplay_prepareFrame(console.display);
-    SDL_Flip(console.screen);
+    BrogueDisplay_presentFrame(console.display);
 }
 
 /*  
@@ -411,13 +857,103 @@ void SdlConsole_refresh(void)
     corner of the display, so that we can measure performance while
     developing.  
 */
-void SdlConsole_displayFrameTime(char *str)
+void SdlConsole_displayFrameTime(int line, char *str)
 {
     if (console.frame_time_window != NULL)
     {
 	BrogueDrawContext_drawAsciiString(
-	    console.frame_time_context, 1, 0, str);
+	    console.frame_time_context, 1, line, str);
+    }
+}
+
+/*  Draw the last frame's profile as a bar stacked by stage.  The full
+    width of the bar is one frame interval, so a full bar means the 
+    frame took too long.  */
+void SdlConsole_displayProfileBar(int line)
+{
+    BROGUE_PROFILE_FRAME frame;
+    BROGUE_DRAW_COLOR empty = { 0.15, 0.15, 0.15, 1.0 };
+    float edge, mid;
+    int x, stage;
+
+    if (console.frame_time_window == NULL
+	|| BrogueProfile_getLastFrame(&frame))
+    {
+	return;
+    }
+
+    BrogueDrawContext_push(console.frame_time_context);
+
+    /*  Each cell takes the color of the stage covering its middle  */
+    stage = 0;
+    edge = frame.stage[0];
+    for (x = 0; x < PROFILE_BAR_WIDTH; x++)
+    {
+	mid = (x + 0.5f) * FRAME_TIME / PROFILE_BAR_WIDTH;
+	while (stage < BROGUE_PROFILE_STAGE_COUNT && mid >= edge)
+	{
+	    stage++;
+	    if (stage < BROGUE_PROFILE_STAGE_COUNT)
+	    {
+		edge += frame.stage[stage];
+	    }
+	}
+
+	if (stage < BROGUE_PROFILE_STAGE_COUNT)
+	{
+	    BrogueDrawContext_setBackground(
+		console.frame_time_context, 
+		BrogueProfile_getStageColor(stage));
+	}
+	else
+	{
+	    BrogueDrawContext_setBackground(console.frame_time_context, empty);
+	}
+	BrogueDrawContext_drawChar(console.frame_time_context, 
+				   1 + x, line, ' ');
+    }
+
+    BrogueDrawContext_pop(console.frame_time_context);
+}
+
+/*  Display the median, 95th and 99th percentile times of each stage
+    over the recent frames, starting at the given line  */
+void SdlConsole_displayProfilePercentiles(int line)
+{
+    char str[32];
+    float p50, p95, p99;
+    int stage;
+
+    if (console.frame_time_window == NULL)
+    {
+	return;
+    }
+
+    BrogueDrawContext_push(console.frame_time_context);
+    BrogueDrawContext_enableProportionalFont(console.frame_time_context, 0);
+
+    BrogueDrawContext_drawAsciiString(
+	console.frame_time_context, 2, line, "ms        p50   p95   p99");
+    for (stage = 0; stage <= BROGUE_PROFILE_STAGE_COUNT; stage++)
+    {
+	BrogueProfile_getPercentiles(stage, &p50, &p95, &p99);
+	snprintf(str, sizeof(str), "%-7s%6.2f%6.2f%6.2f", 
+		 stage < BROGUE_PROFILE_STAGE_COUNT 
+		 ? BrogueProfile_getStageName(stage) : "total", 
+		 p50, p95, p99);
+	BrogueDrawContext_drawAsciiString(
+	    console.frame_time_context, 2, line + 1 + stage, str);
+    }
+
+    for (stage = 0; stage < BROGUE_PROFILE_STAGE_COUNT; stage++)
+    {
+	BrogueDrawContext_setBackground(console.frame_time_context, 
+					BrogueProfile_getStageColor(stage));
+	BrogueDrawContext_drawChar(console.frame_time_context, 
+				   0, line + 1 + stage, ' ');
     }
+
+    BrogueDrawContext_pop(console.frame_time_context);
 }
 
 /*
@@ -437,10 +973,13 @@ void SdlConsole_waitForNextFrame(int wait_time)
     }
 
     frame_time = now - console.last_frame_timestamp;
+    BrogueProfile_endFrame();
     if (console.enable_frame_time_display)
     {
-	double average_frame_time;
+	double average_frame_time, average_allocs;
+	unsigned alloc_count;
 	char frame_time_str[32];
+	SDL_SVGSET_TINT_STATS tint_stats;
 
 	console.accumulated_frame_time += frame_time;
 	if (console.frame_count % 30 == 0)
@@ -448,18 +987,56 @@ void SdlConsole_waitForNextFrame(int wait_time)
 	    average_frame_time = 
 		(double)console.accumulated_frame_time / 30.0;
 
+	    /*  Steady-state drawing should make no heap allocations  */
+	    alloc_count = BrogueDisplay_getAllocationCount(console.display);
+	    average_allocs = 
+		(double)(alloc_count - console.last_alloc_count) / 30.0;
+
 	    snprintf(frame_time_str, sizeof(frame_time_str), 
-		     "%6.2f ms", average_frame_time);
-	    SdlConsole_displayFrameTime(frame_time_str);
+		     "%6.2f ms %6.1f alloc", 
+		     average_frame_time, average_allocs);
+	    SdlConsole_displayFrameTime(0, frame_time_str);
+
+	    /*  Evictions climbing steadily mean the tint cache is too 
+		small for what is on screen  */
+	    if (console.svgset != NULL)
+	    {
+		SdlSvgset_getTintStats(console.svgset, &tint_stats);
+		snprintf(frame_time_str, sizeof(frame_time_str),
+			 "tint %3u/%u %5u ev",
+			 tint_stats.count, tint_stats.capacity,
+			 tint_stats.evictions);
+		SdlConsole_displayFrameTime(1, frame_time_str);
+	    }
+
+	    SdlConsole_displayProfilePercentiles(3);
+
+	    /*  Don't count the overlay's own text against the next frames  */
+	    console.last_alloc_count = 
+		BrogueDisplay_getAllocationCount(console.display);
 	    
 	    console.accumulated_frame_time = 0;
 	}
+
+	SdlConsole_displayProfileBar(2);
     }
 
-    delay = wait_time - frame_time;
+    /*  Frames are paced against a deadline advanced by a fixed step, 
+	so that time spent generating frames doesn't accumulate as drift.
+	If we've fallen more than a frame behind, or been idle, we start
+	over from now rather than rushing to catch up.  */
+    if (console.frame_deadline == 0
+	|| (int)(now - console.frame_deadline) > wait_time
+	|| (int)(console.frame_deadline - now) > wait_time)
+    {
+	console.frame_deadline = now;
+    }
+    console.frame_deadline += wait_time;
+
+    delay = console.frame_deadline - now;
     if (delay > 0)
     {
-	SDL_Delay(wait_time); 
+	SDL_Delay(delay); 
     }
 
     console.last_frame_timestamp = SDL_GetTicks();
@@ -503,15 +1080,14 @@ void SdlConsole_increaseFont(void)
     int size = console.metrics.point_size;
     while (size < MAX_FONT_SIZE)
     {
-	if (console.all_metrics[size - MIN_FONT_SIZE].width
-	    != console.metrics.width)
+	if (SdlConsole_getFontMetrics(size).width != console.metrics.width)
 	{
 	    break;
 	}
 	
 	size++;
     }
-    console.metrics = console.all_metrics[size - MIN_FONT_SIZE];
+    console.metrics = SdlConsole_getFontMetrics(size);
 
     console.fullscreen = 0;
     SdlConsole_scaleFont(true);
@@ -523,15 +1099,14 @@ void SdlConsole_decreaseFont(void)
     int size = console.metrics.point_size;
     while (size > MIN_FONT_SIZE)
     {
-	if (console.all_metrics[size - MIN_FONT_SIZE].width
-	    != console.metrics.width)
+	if (SdlConsole_getFontMetrics(size).width != console.metrics.width)
 	{
 	    break;
 	}
 	
 	size--;
     }
-    console.metrics = console.all_metrics[size - MIN_FONT_SIZE];
+    console.metrics = SdlConsole_getFontMetrics(size);
 
     console.fullscreen = 0;
     SdlConsole_scaleFont(true);
@@ -615,15 +1190,20 @@ int SdlConsole_processKey(SDL_KeyboardEvent *keyboardEvent, boolean textInput)
 	    BROGUE_WINDOW *root = BrogueDisplay_getRootWindow(console.display);
 
 	    console.frame_time_window = BrogueWindow_open(
-		root, COLS - 10, 0, 10, 1);
+		root, COLS - FRAME_TIME_WINDOW_WIDTH, 0, 
+		FRAME_TIME_WINDOW_WIDTH, FRAME_TIME_WINDOW_HEIGHT);
+	    console.last_alloc_count = 
+		BrogueDisplay_getAllocationCount(console.display);
 	    BrogueWindow_setColor(console.frame_time_window, windowColor);
 	    console.frame_time_context = BrogueDrawContext_open(
 		console.frame_time_window);
 	    BrogueDrawContext_enableProportionalFont(
 		console.frame_time_context, 1);
+	    BrogueProfile_enableOverlay(1);
 	}
 	else
 	{
+	    BrogueProfile_enableOverlay(0);
 	    BrogueWindow_close(console.frame_time_window);
 	    console.frame_time_window = NULL;
 	    console.frame_time_context = NULL;
@@ -667,18 +1247,116 @@ int SdlConsole_processKey(SDL_KeyboardEvent *keyboardEvent, boolean textInput)
     }
     if (key == SDLK_KP9)
     {
-	keyboardEvent->keysym.unicode = UPRIGHT_KEY;
+	keyboardEvent->keysym.unicode = UPRIGHT_KEY;
+    }
+    if (key == SDLK_KP1)
+    {
+	keyboardEvent->keysym.unicode = DOWNLEFT_KEY;
+    }
+    if (key == SDLK_KP3)
+    {
+	keyboardEvent->keysym.unicode = DOWNRIGHT_KEY;
+    }
+
+    return 0;
+}
+
+/*  Wake a blocked SDL_WaitEvent by pushing a user event  */
+static Uint32 SdlConsole_wakeTimer(Uint32 interval, void *param)
+{
+    SDL_Event event;
+
+    memset(&event, 0, sizeof(SDL_Event));
+    event.type = SDL_USEREVENT;
+    SDL_PushEvent(&event);
+
+    return 0;
+}
+
+/*  Block until the next SDL event, or until the timeout expires, in
+    which case false is returned.  */
+int SdlConsole_waitEventTimeout(SDL_Event *event, int timeout)
+{
+    SDL_TimerID timer;
+    SDL_Event stale;
+    int success;
+
+    timer = SDL_AddTimer(timeout, SdlConsole_wakeTimer, NULL);
+    success = SDL_WaitEvent(event);
+    if (timer != NULL)
+    {
+	SDL_RemoveTimer(timer);
+    }
+
+    /*  If the timer fired just as a real event arrived, its wake event
+	is still queued, and would end the next wait early.  No callback
+	is running once the timer is removed, so drain them now.  */
+    while (SDL_PeepEvents(&stale, 1, SDL_GETEVENT,
+			  SDL_EVENTMASK(SDL_USEREVENT)) > 0)
+    {
+    }
+
+    if (success && event->type == SDL_USEREVENT)
+    {
+	return 0;
+    }
+
+    return success;
+}
+
+/*  Return true if anything on screen changes as time passes  */
+int SdlConsole_isAnimating(void)
+{
+    return dungeonIsAnimating() 
+	|| BrogueDisplay_isAnimating(console.display);
+}
+
+/*  Wait for the next event from SDL, drawing frames as they are due.
+    Returns false if we woke without one.  */
+static int SdlConsole_waitSdlEvent(SDL_Event *event, int wait_time)
+{
+    int success;
+
+    if (wait_time == -1 && console.svgset != NULL
+	&& SdlSvgset_hasProvisional(console.svgset))
+    {
+	/*  Wake to redraw when the glyphs are ready  */
+	SdlConsole_refresh();
+	success = SdlConsole_waitEventTimeout(event, IDLE_WAIT_TIME);
     }
-    if (key == SDLK_KP1)
+    else if (wait_time == -1)
     {
-	keyboardEvent->keysym.unicode = DOWNLEFT_KEY;
+	SdlConsole_refresh();
+	success = SDL_WaitEvent(event);
+
+	if (!success)
+	{
+	    printf("%s\n", SDL_GetError());
+	}
     }
-    if (key == SDLK_KP3)
+    else
     {
-	keyboardEvent->keysym.unicode = DOWNRIGHT_KEY;
+	success = SDL_PollEvent(event);
+	if (!success && SdlConsole_isAnimating())
+	{
+	    shuffleTerrainColors(3, true);
+	    SdlConsole_refresh();
+
+	    SdlConsole_waitForNextFrame(wait_time);
+		    
+	    success = SDL_PollEvent(event);
+	}
+	else if (!success)
+	{
+	    /*  Nothing is moving, so there is no need to draw 
+		frames until something happens.  We wake now and
+		then in case animation starts without input.  */
+	    SdlConsole_refresh();
+	    success = SdlConsole_waitEventTimeout(event, IDLE_WAIT_TIME);
+	}
     }
 
-    return 0;
+    return success;
 }
 
 /*  Return the queued SDL event, if we have one.  Otherwise, return
@@ -692,33 +1370,8 @@ void SdlConsole_nextSdlEvent(SDL_Event *event, int wait_time)
     }
     else
     {
-	int success = 0;
-
-	while (!success)
+	while (!SdlConsole_waitSdlEvent(event, wait_time))
 	{
-	    if (wait_time == -1)
-	    {
-		SdlConsole_refresh();
-		success = SDL_WaitEvent(event);
-
-		if (!success)
-		{
-		    printf("%s\n", SDL_GetError());
-		}
-	    }
-	    else
-	    {
-		success = SDL_PollEvent(event);
-		if (!success)
-		{
-		    shuffleTerrainColors(3, true);
-		    SdlConsole_refresh();
-
-		    SdlConsole_waitForNextFrame(wait_time);
-		    
-		    success = SDL_PollEvent(event);
-		}
-	    }
 	}
     }
 }
@@ -1046,23 +1699,64 @@ void SdlConsole_free(void)
     SdlKeymap_free(console.keymap);
     console.keymap = NULL;
 
-    if (console.svgset != NULL)
+    while (console.fontset_count > 0)
+    {
+	console.fontset_count--;
+	SdlConsole_freeFontset(console.fontsets[console.fontset_count]);
+    }
+    console.svgset = NULL;
+    console.mono_font = NULL;
+    console.sans_font = NULL;
+}
+
+/*  Open the display with the options given on the command line.  */
+void SdlConsole_openDisplay(void)
+{
+    brogue_display = BrogueDisplay_open(COLS, ROWS);
+    console.display = brogue_display;
+    if (brogueTextCacheKilobytes >= 0)
+    {
+	BrogueDisplay_setTextCacheBudget(
+	    brogue_display, (size_t)brogueTextCacheKilobytes * 1024);
+    }
+    if (brogueRasterThreads > 0)
+    {
+	if (brogueRasterThreads > MAX_RASTER_THREADS)
+	{
+	    brogueRasterThreads = MAX_RASTER_THREADS;
+	}
+	BrogueDisplay_setRasterThreads(brogue_display, brogueRasterThreads);
+    }
+}
+
+/*  Write the frame profile recorded during the run, at exit.  */
+static void SdlConsole_writeProfile(void)
+{
+    int err;
+
+    err = BrogueProfile_writeCsv(brogueProfileCsvPath);
+    if (err)
     {
-	SdlSvgset_free(console.svgset);
-	console.svgset = NULL;
+	fprintf(stderr, "Failed to write profile to %s: %s\n", 
+		brogueProfileCsvPath, strerror(err));
     }
+}
 
-    if (console.mono_font != NULL)
+/*  Record the time spent in each stage of every frame, if requested on
+    the command line.  */
+void SdlConsole_startProfile(void)
+{
+    if (brogueProfileCsvPath == NULL)
     {
-	TTF_CloseFont(console.mono_font);
-	console.mono_font = NULL;
+	return;
     }
 
-    if (console.sans_font != NULL)
+    if (BrogueProfile_enableRecording(1))
     {
-	TTF_CloseFont(console.sans_font);
-	console.sans_font = NULL;
+	printf("Failed to allocate frame profile\n");
+	exit(1);
     }
+    atexit(SdlConsole_writeProfile);
 }
 
 /*  The main entry point to the SDL-specific code.  */
@@ -1072,7 +1766,7 @@ void SdlConsole_gameLoop(void)
 
     SdlConsole_allocate();
 
-    err = SDL_Init(SDL_INIT_VIDEO);
+    err = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER);
     if (err)
     {
 	printf("Failed to initialize SDL\n");
@@ -1087,8 +1781,8 @@ void SdlConsole_gameLoop(void)
 	exit(1);
     }
 
-    brogue_display = BrogueDisplay_open(COLS, ROWS);
-    console.display = brogue_display;
+    SdlConsole_openDisplay();
+    SdlConsole_startProfile();
 
     SdlConsole_setIcon();
     SdlConsole_generateFontMetrics();
@@ -1112,3 +1806,443 @@ struct brogueConsole sdlConsole = {
     SdlConsole_modifierHeld,
     SdlConsole_getTicks,
 };
+
+/*  Hash the visible pixels of the screen, using FNV-1a over 32-bit 
+    pixel values, so that frames rendered by different runs can be 
+    compared.  */
+static guint64 SdlConsole_hashScreen(void)
+{
+    SDL_Surface *screen = console.screen;
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    int x, y;
+
+    for (y = 0; y < screen->h; y++)
+    {
+	Uint32 *row = (Uint32 *)((Uint8 *)screen->pixels + y * screen->pitch);
+
+	for (x = 0; x < screen->w; x++)
+	{
+	    hash ^= row[x] & 0x00FFFFFF;
+	    hash *= G_GUINT64_CONSTANT(1099511628211);
+	}
+    }
+
+    return hash;
+}
+
+static void SdlConsole_finishHeadless(int status);
+
+/*  Render a frame at the current virtual time, printing its hash if
+    anything changed, and then advance the clock.  */
+static void SdlConsole_headlessFrame(int advance)
+{
+    gint64 start;
+    double elapsed;
+
+    BrogueDisplay_setVirtualTime(console.display, console.virtual_time);
+
+    start = g_get_monotonic_time();
+    BrogueDisplay_prepareFrame(console.display);
+    elapsed = (g_get_monotonic_time() - start) / 1000.0;
+
+    if (BrogueDisplay_isFrameChanged(console.display))
+    {
+	if (console.headless_frame_count == console.headless_frame_capacity)
+	{
+	    unsigned capacity = console.headless_frame_capacity * 2 + 1024;
+	    double *times = realloc(console.headless_frame_times, 
+				    capacity * sizeof(double));
+
+	    if (times != NULL)
+	    {
+		console.headless_frame_times = times;
+		console.headless_frame_capacity = capacity;
+	    }
+	}
+	if (console.headless_frame_count < console.headless_frame_capacity)
+	{
+	    console.headless_frame_times[console.headless_frame_count] = 
+		elapsed;
+	}
+	console.headless_frame_count++;
+
+	printf("frame %6u %9u %016llx\n",
+	       console.headless_frame_count, (unsigned)console.virtual_time, 
+	       (unsigned long long)SdlConsole_hashScreen());
+    }
+
+    /*  Exported frames are taken at every step of the clock, changed
+	or not, so that the sequence keeps the replay's timing  */
+    if (brogueExportDirectory != NULL)
+    {
+	int err = BrogueExport_frame(console.screen);
+
+	if (err)
+	{
+	    fprintf(stderr, "Failed to export frame: %s\n", strerror(err));
+	    SdlConsole_finishHeadless(1);
+	}
+    }
+    BrogueDisplay_presentFrame(console.display);
+    BrogueProfile_endFrame();
+
+    console.virtual_time += advance;
+}
+
+static int compareFrameTimes(const void *a, const void *b)
+{
+    double ta = *(const double *)a;
+    double tb = *(const double *)b;
+
+    return (ta > tb) - (ta < tb);
+}
+
+/*  Report the time taken to render frames, and exit.  Timing goes to
+    stderr, so that the frame hashes on stdout can be compared between
+    runs as they are.  */
+static void SdlConsole_finishHeadless(int status)
+{
+    unsigned count = console.headless_frame_count;
+    double *times = console.headless_frame_times;
+    double total = 0.0;
+    unsigned i;
+    int err;
+
+    if (brogueExportDirectory != NULL)
+    {
+	err = BrogueExport_close();
+	if (err)
+	{
+	    fprintf(stderr, "Failed to export frames to %s: %s\n",
+		    brogueExportDirectory, strerror(err));
+	    status = 1;
+	}
+	fprintf(stderr, "%u frames exported to %s\n",
+		BrogueExport_getFrameCount(), brogueExportDirectory);
+	brogueExportDirectory = NULL;
+    }
+
+    if (count > console.headless_frame_capacity)
+    {
+	count = console.headless_frame_capacity;
+    }
+
+    fflush(stdout);
+    if (count > 0)
+    {
+	qsort(times, count, sizeof(double), compareFrameTimes);
+	for (i = 0; i < count; i++)
+	{
+	    total += times[i];
+	}
+
+	fprintf(stderr, 
+		"%u frames: mean %.3f ms, median %.3f ms, "
+		"95th %.3f ms, 99th %.3f ms, max %.3f ms\n",
+		count, total / count, times[(count - 1) / 2],
+		times[(count - 1) * 95 / 100], times[(count - 1) * 99 / 100], 
+		times[count - 1]);
+    }
+
+    free(console.headless_frame_times);
+    console.headless_frame_times = NULL;
+    SdlConsole_free();
+
+    exit(status);
+}
+
+/*  Exit once the replay has diverged or finished.  The game returns to
+    the title menu after playback, which is when we see the playback
+    mode cleared while pausing.  */
+static void SdlConsole_checkHeadlessDone(int pausing)
+{
+    if (rogue.playbackOOS)
+    {
+	fprintf(stderr, "Playback diverged from the recording\n");
+	SdlConsole_finishHeadless(1);
+    }
+
+    if (rogue.playbackMode)
+    {
+	console.headless_playback_seen = 1;
+    }
+    else if (pausing && console.headless_playback_seen)
+    {
+	if (brogueIdleCheckSeconds > 0)
+	{
+	    fprintf(stderr, "The replay finished without waiting for input\n");
+	    SdlConsole_finishHeadless(1);
+	}
+	SdlConsole_finishHeadless(0);
+    }
+}
+
+/*  Park the game where the replay first waits for input, and measure 
+    the CPU used over some seconds of real time by the same wait which 
+    an interactive game uses.  A parked game should cost next to 
+    nothing, so this exits with failure if it uses more than 
+    IDLE_CPU_LIMIT.  */
+static void SdlConsole_headlessIdleCheck(void)
+{
+    SDL_Event event;
+    Uint32 start_ticks, elapsed_ticks;
+    clock_t start_clock;
+    double percent;
+    int err;
+
+    /*  SDL only runs its event queue alongside a video driver, so use 
+	the one which has no device  */
+    SDL_putenv("SDL_VIDEODRIVER=dummy");
+    err = SDL_InitSubSystem(SDL_INIT_VIDEO);
+    if (err)
+    {
+	fprintf(stderr, "Failed to initialize SDL video: %s\n", 
+		SDL_GetError());
+	SdlConsole_finishHeadless(1);
+    }
+
+    BrogueDisplay_setRealTime(console.display);
+    console.last_frame_timestamp = 0;
+
+    start_ticks = SDL_GetTicks();
+    start_clock = clock();
+    do
+    {
+	SdlConsole_waitSdlEvent(&event, FRAME_TIME);
+	elapsed_ticks = SDL_GetTicks() - start_ticks;
+    } while (elapsed_ticks < (Uint32)brogueIdleCheckSeconds * 1000);
+
+    percent = 100.0 * (double)(clock() - start_clock) / CLOCKS_PER_SEC
+	/ (elapsed_ticks / 1000.0);
+    fprintf(stderr, "Idle for %.1f s using %.1f%% CPU\n", 
+	    elapsed_ticks / 1000.0, percent);
+    if (percent > IDLE_CPU_LIMIT)
+    {
+	fprintf(stderr, "Idle CPU is over the limit of %.1f%%\n", 
+		IDLE_CPU_LIMIT);
+	SdlConsole_finishHeadless(1);
+    }
+
+    SdlConsole_finishHeadless(0);
+}
+
+/*  Pause for virtual time, rendering a frame for each frame interval.
+    A paused replay is interrupted so that it asks for the key which 
+    resumes it.  */
+boolean SdlConsole_headlessPauseForMilliseconds(short milliseconds)
+{
+    int remaining = milliseconds;
+    int advance;
+
+    SdlConsole_checkHeadlessDone(1);
+    if (rogue.playbackMode && rogue.playbackPaused)
+    {
+	return true;
+    }
+
+    do
+    {
+	advance = remaining;
+	if (advance > FRAME_TIME)
+	{
+	    advance = FRAME_TIME;
+	}
+	if (advance < 0)
+	{
+	    advance = 0;
+	}
+
+	SdlConsole_headlessFrame(advance);
+	remaining -= advance;
+    } while (remaining > 0);
+
+    return false;
+}
+
+static const unsigned long lightingCheckSeeds[] = LIGHTING_CHECK_SEEDS;
+
+/*  Draw the level with each light conversion in turn, and compare the
+    frames' hashes.  Both hashes are printed, so that the runs of two
+    builds can be compared as well.  */
+static void SdlConsole_compareLighting(void)
+{
+    guint64 planar, reference;
+
+    BrogueDisplay_setVirtualTime(console.display, console.virtual_time);
+
+    setReferenceLighting(false);
+    BrogueDisplay_prepareFrame(console.display);
+    planar = SdlConsole_hashScreen();
+    BrogueDisplay_presentFrame(console.display);
+
+    setReferenceLighting(true);
+    BrogueDisplay_prepareFrame(console.display);
+    reference = SdlConsole_hashScreen();
+    BrogueDisplay_presentFrame(console.display);
+
+    setReferenceLighting(false);
+
+    printf("seed %6lu depth %2d %016llx %016llx\n", 
+	   rogue.seed, rogue.depthLevel, 
+	   (unsigned long long)planar, (unsigned long long)reference);
+    if (planar != reference)
+    {
+	fprintf(stderr, "Seed %lu depth %d: planar lighting differs from "
+		"the per-corner conversion\n", rogue.seed, rogue.depthLevel);
+	console.lighting_check_failed = 1;
+    }
+}
+
+/*  At the first prompt of each game, compare the lighting on its first
+    few levels, descending directly, and then end the game to start the
+    next seed.  Prompts shown while descending are acknowledged.  */
+static void SdlConsole_headlessCheckLighting(void)
+{
+    int seed_count = 
+	sizeof(lightingCheckSeeds) / sizeof(lightingCheckSeeds[0]);
+    int depth;
+
+    if (console.lighting_check_active)
+    {
+	return;
+    }
+    console.lighting_check_active = 1;
+
+    for (depth = 1; depth <= LIGHTING_CHECK_DEPTHS; depth++)
+    {
+	if (depth > 1)
+	{
+	    rogue.depthLevel++;
+	    startLevel(rogue.depthLevel - 1, 1);
+	}
+	SdlConsole_compareLighting();
+    }
+
+    console.lighting_check_active = 0;
+    console.lighting_check_seed++;
+    if (console.lighting_check_seed >= seed_count)
+    {
+	SdlConsole_finishHeadless(console.lighting_check_failed);
+    }
+
+    rogue.nextGame = NG_NEW_GAME_WITH_SEED;
+    rogue.nextGameSeed = lightingCheckSeeds[console.lighting_check_seed];
+    rogue.gameHasEnded = true;
+}
+
+/*  There is no one to provide input, so acknowledge every prompt, which
+    also resumes a paused replay.  */
+void SdlConsole_headlessNextKeyOrMouseEvent(rogueEvent *returnEvent, 
+					    boolean textInput, 
+					    boolean colorsDance)
+{
+    SdlConsole_checkHeadlessDone(0);
+    SdlConsole_headlessFrame(FRAME_TIME);
+    if (brogueIdleCheckSeconds > 0 && rogue.playbackMode)
+    {
+	SdlConsole_headlessIdleCheck();
+    }
+    if (brogueCheckLighting && !rogue.playbackMode)
+    {
+	SdlConsole_headlessCheckLighting();
+    }
+
+    memset(returnEvent, 0, sizeof(rogueEvent));
+    returnEvent->eventType = KEYSTROKE;
+    returnEvent->param1 = ACKNOWLEDGE_KEY;
+}
+
+/*  No modifiers are held during headless replay.  */
+boolean SdlConsole_headlessModifierHeld(int modifier)
+{
+    return false;
+}
+
+/*  Time passes only as the replay pauses.  */
+int SdlConsole_headlessGetTicks(void)
+{
+    return console.virtual_time;
+}
+
+/*  The entry point for replaying a recording without a video device,
+    printing a hash of each rendered frame to stdout.  */
+void SdlConsole_headlessGameLoop(void)
+{
+    FILE *recording;
+    int err;
+
+    if (brogueCheckLighting)
+    {
+	rogue.nextGame = NG_NEW_GAME_WITH_SEED;
+	rogue.nextGameSeed = lightingCheckSeeds[0];
+    }
+    else
+    {
+	recording = fopen(rogue.nextGamePath, "rb");
+	if (recording == NULL)
+	{
+	    printf("Failed to open recording %s\n", rogue.nextGamePath);
+	    exit(1);
+	}
+	fclose(recording);
+    }
+
+    console.headless = 1;
+    SdlConsole_allocate();
+
+    err = SDL_Init(SDL_INIT_TIMER);
+    if (err)
+    {
+	printf("Failed to initialize SDL\n");
+	exit(1);
+    }
+    atexit(SDL_Quit);
+
+    err = TTF_Init();
+    if (err)
+    {
+	printf("Failed to initialize SDL_TTF\n");
+	exit(1);
+    }
+
+    if (brogueExportDirectory != NULL)
+    {
+	err = BrogueExport_open(brogueExportDirectory, brogueExportInterval,
+				brogueExportFormat);
+	if (err)
+	{
+	    fprintf(stderr, "Failed to export frames to %s: %s\n",
+		    brogueExportDirectory, strerror(err));
+	    exit(1);
+	}
+    }
+
+    SdlConsole_openDisplay();
+    SdlConsole_startProfile();
+    BrogueDisplay_setOffscreen(brogue_display, 1);
+    BrogueDisplay_setVirtualTime(brogue_display, 0);
+
+    SdlConsole_generateFontMetrics();
+    SdlConsole_scaleFont(true);
+
+    if (BrogueDisplay_checkTextMeasure(brogue_display))
+    {
+	fprintf(stderr, "Text layout doesn't match SDL_ttf\n");
+	SdlConsole_finishHeadless(1);
+    }
+
+    rogueMain();
+
+    SdlConsole_finishHeadless(0);
+}
+
+/*  The function table used to replay recordings headless.  */
+struct brogueConsole sdlHeadlessConsole = {
+    SdlConsole_headlessGameLoop,
+    SdlConsole_headlessPauseForMilliseconds,
+    SdlConsole_headlessNextKeyOrMouseEvent,
+    NULL,
+    SdlConsole_remap,
+    SdlConsole_headlessModifierHeld,
+    SdlConsole_headlessGetTicks,
+};
@@ -0,0 +1,328 @@
+/*
+ *  sdl-profile.c
+ *
+ *  Created by Matt Kimball.
+ *  Copyright 2013. All rights reserved.
+ *
+ *  This file is part of Brogue.
+ *
+ *  Brogue is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Brogue is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Brogue.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "sdl-display.h"
+
+#define PROFILE_MAX_DEPTH 32
+
+/*  The state of the frame profiler.  There is only one, as the game
+    code timing its stages has no display at hand.  */
+struct BROGUE_PROFILE
+{
+    int overlay_enabled;
+    int record_enabled;
+    int active;
+    Uint32 thread_id;
+
+    /*  The stages currently being timed, innermost last.  Time is
+	charged only to the innermost stage, so that nested stages
+	aren't counted twice.  */
+    int depth;
+    int stack[PROFILE_MAX_DEPTH];
+    gint64 segment_start;
+
+    /*  Microseconds spent in each stage so far this frame  */
+    gint64 current[BROGUE_PROFILE_STAGE_COUNT];
+
+    /*  The most recent frames, for rolling percentiles  */
+    BROGUE_PROFILE_FRAME history[BROGUE_PROFILE_HISTORY];
+    int history_count, history_next;
+
+    /*  Every frame since recording was enabled, for writing as CSV  */
+    GArray *frames;
+};
+typedef struct BROGUE_PROFILE BROGUE_PROFILE;
+
+static BROGUE_PROFILE profile;
+
+static const char *stageNames[BROGUE_PROFILE_STAGE_COUNT] = {
+    "level", "cell", "light", "vision", "sidebar",
+    "prepare", "window", "char", "string", "blur", "flip"
+};
+
+static const BROGUE_DRAW_COLOR stageColors[BROGUE_PROFILE_STAGE_COUNT] = {
+    { 0.9, 0.3, 0.3, 1.0 },
+    { 1.0, 0.6, 0.2, 1.0 },
+    { 1.0, 0.9, 0.3, 1.0 },
+    { 0.6, 0.9, 0.3, 1.0 },
+    { 0.3, 0.8, 0.6, 1.0 },
+    { 0.3, 0.7, 1.0, 1.0 },
+    { 0.3, 0.4, 0.9, 1.0 },
+    { 0.6, 0.4, 1.0, 1.0 },
+    { 0.9, 0.4, 0.9, 1.0 },
+    { 0.7, 0.7, 0.7, 1.0 },
+    { 1.0, 1.0, 1.0, 1.0 }
+};
+
+/*  Only the main thread is profiled.  Stages run by raster worker
+    threads are counted in the time the main thread waits for them.  */
+static int BrogueProfile_isProfiledThread(void)
+{
+    return profile.active && SDL_ThreadID() == profile.thread_id;
+}
+
+/*  Charge the time since the last change of stage to the innermost
+    stage being timed  */
+static void BrogueProfile_charge(gint64 now)
+{
+    if (profile.depth > 0 && profile.depth <= PROFILE_MAX_DEPTH)
+    {
+	profile.current[profile.stack[profile.depth - 1]] +=
+	    now - profile.segment_start;
+    }
+    profile.segment_start = now;
+}
+
+/*  Start timing a stage of frame generation  */
+void BrogueProfile_begin(int stage)
+{
+    if (!BrogueProfile_isProfiledThread())
+    {
+	return;
+    }
+
+    if (profile.depth < PROFILE_MAX_DEPTH)
+    {
+	BrogueProfile_charge(g_get_monotonic_time());
+	profile.stack[profile.depth] = stage;
+    }
+    profile.depth++;
+}
+
+/*  Stop timing the innermost stage  */
+void BrogueProfile_end(int stage)
+{
+    if (!BrogueProfile_isProfiledThread() || profile.depth == 0)
+    {
+	return;
+    }
+
+    if (profile.depth <= PROFILE_MAX_DEPTH)
+    {
+	BrogueProfile_charge(g_get_monotonic_time());
+    }
+    profile.depth--;
+}
+
+/*  Start or stop profiling when either the overlay or the CSV recording
+    needs it  */
+static void BrogueProfile_updateActive(void)
+{
+    int active = profile.overlay_enabled || profile.record_enabled;
+
+    if (active && !profile.active)
+    {
+	profile.thread_id = SDL_ThreadID();
+	profile.depth = 0;
+	profile.segment_start = g_get_monotonic_time();
+	memset(profile.current, 0, sizeof(profile.current));
+    }
+    profile.active = active;
+}
+
+/*  Enable profiling for the on-screen overlay  */
+void BrogueProfile_enableOverlay(int enable)
+{
+    profile.overlay_enabled = enable;
+    profile.history_count = 0;
+    profile.history_next = 0;
+    BrogueProfile_updateActive();
+}
+
+/*  Enable keeping every frame's profile, for writing as CSV at exit  */
+int BrogueProfile_enableRecording(int enable)
+{
+    if (enable && profile.frames == NULL)
+    {
+	profile.frames = g_array_new(FALSE, FALSE,
+				     sizeof(BROGUE_PROFILE_FRAME));
+	if (profile.frames == NULL)
+	{
+	    return ENOMEM;
+	}
+    }
+
+    profile.record_enabled = enable;
+    BrogueProfile_updateActive();
+
+    return 0;
+}
+
+/*  Close the profile of the current frame, adding it to the history  */
+void BrogueProfile_endFrame(void)
+{
+    BROGUE_PROFILE_FRAME *frame;
+    int i;
+
+    if (!BrogueProfile_isProfiledThread())
+    {
+	return;
+    }
+
+    BrogueProfile_charge(g_get_monotonic_time());
+
+    frame = &profile.history[profile.history_next];
+    frame->total = 0.0f;
+    for (i = 0; i < BROGUE_PROFILE_STAGE_COUNT; i++)
+    {
+	frame->stage[i] = profile.current[i] / 1000.0f;
+	frame->total += frame->stage[i];
+    }
+    memset(profile.current, 0, sizeof(profile.current));
+
+    profile.history_next =
+	(profile.history_next + 1) % BROGUE_PROFILE_HISTORY;
+    if (profile.history_count < BROGUE_PROFILE_HISTORY)
+    {
+	profile.history_count++;
+    }
+
+    if (profile.record_enabled)
+    {
+	g_array_append_val(profile.frames, *frame);
+    }
+}
+
+/*  Get the profile of the most recently ended frame.  Returns EINVAL
+    if no frame has been profiled.  */
+int BrogueProfile_getLastFrame(BROGUE_PROFILE_FRAME *frame)
+{
+    int last;
+
+    if (profile.history_count == 0)
+    {
+	return EINVAL;
+    }
+
+    last = (profile.history_next + BROGUE_PROFILE_HISTORY - 1)
+	% BROGUE_PROFILE_HISTORY;
+    *frame = profile.history[last];
+
+    return 0;
+}
+
+static int compareFloat(const void *a, const void *b)
+{
+    float fa = *(const float *)a;
+    float fb = *(const float *)b;
+
+    return (fa > fb) - (fa < fb);
+}
+
+/*  Get percentiles of the time spent in a stage over the recent
+    frames, in milliseconds.  BROGUE_PROFILE_STAGE_COUNT as the stage
+    gives the percentiles of the total of all stages.  */
+void BrogueProfile_getPercentiles(
+    int stage, float *p50, float *p95, float *p99)
+{
+    float times[BROGUE_PROFILE_HISTORY];
+    int count = profile.history_count;
+    int i;
+
+    if (count == 0)
+    {
+	*p50 = *p95 = *p99 = 0.0f;
+	return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+	if (stage == BROGUE_PROFILE_STAGE_COUNT)
+	{
+	    times[i] = profile.history[i].total;
+	}
+	else
+	{
+	    times[i] = profile.history[i].stage[stage];
+	}
+    }
+    qsort(times, count, sizeof(float), compareFloat);
+
+    *p50 = times[(count - 1) * 50 / 100];
+    *p95 = times[(count - 1) * 95 / 100];
+    *p99 = times[(count - 1) * 99 / 100];
+}
+
+/*  The short name of a stage, as used in the overlay and CSV header  */
+const char *BrogueProfile_getStageName(int stage)
+{
+    return stageNames[stage];
+}
+
+/*  The color used for a stage in the overlay's stacked bar  */
+BROGUE_DRAW_COLOR BrogueProfile_getStageColor(int stage)
+{
+    return stageColors[stage];
+}
+
+/*  Write every recorded frame to a CSV file, one row per frame with a
+    column of milliseconds for each stage  */
+int BrogueProfile_writeCsv(const char *path)
+{
+    FILE *file;
+    unsigned i;
+    int j;
+
+    if (profile.frames == NULL)
+    {
+	return EINVAL;
+    }
+
+    file = fopen(path, "w");
+    if (file == NULL)
+    {
+	return errno;
+    }
+
+    fprintf(file, "frame");
+    for (j = 0; j < BROGUE_PROFILE_STAGE_COUNT; j++)
+    {
+	fprintf(file, ",%s", stageNames[j]);
+    }
+    fprintf(file, ",total\n");
+
+    for (i = 0; i < profile.frames->len; i++)
+    {
+	BROGUE_PROFILE_FRAME *frame =
+	    &g_array_index(profile.frames, BROGUE_PROFILE_FRAME, i);
+
+	fprintf(file, "%u", i);
+	for (j = 0; j < BROGUE_PROFILE_STAGE_COUNT; j++)
+	{
+	    fprintf(file, ",%.3f", frame->stage[j]);
+	}
+	fprintf(file, ",%.3f\n", frame->total);
+    }
+
+    if (fclose(file))
+    {
+	return errno;
+    }
+
+    return 0;
+}
@@ -21,6 +21,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #ifdef __APPLE__
 #include <cairo.h>
 #else
@@ -28,6 +29,7 @@
 #endif
 #include <librsvg/rsvg.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #if defined(__MMX__)
 #include <mmintrin.h>
@@ -37,13 +39,30 @@
 
 #define MAX_FRAME_COUNT 30
 
-typedef struct SDL_SVGANIM SDL_SVGANIM;
+/*  Bump the version when the cache layout or the rasterization changes  */
+#define SVG_CACHE_MAGIC "BRGSVGC"
+#define SVG_CACHE_VERSION 1
+#define SVG_CACHE_ALIGN 16
+
+/*  The number of color-applied glyphs kept for SdlSvgset_render  */
+#define TINT_CACHE_SIZE 256
 
-/*  A set of frames for a glyph.  */
+typedef struct SDL_SVGANIM SDL_SVGANIM;
+typedef struct SDL_SVGTINT SDL_SVGTINT;
+typedef struct SVG_CACHE_HEADER SVG_CACHE_HEADER;
+typedef struct SVG_CACHE_ENTRY SVG_CACHE_ENTRY;
+
+/*  A set of frames for a glyph.  Frames are rasterized from the SVG 
+    file at 'path' the first time they are requested, after which the
+    path is freed, whether or not rasterization succeeded.  Until then,
+    a frame may be stood in for by a 'scaled' copy of the frame from 
+    the set's fallback.  */
 struct SDL_SVGANIM
 {
     int frame_count;
     SDL_Surface **frame;
+    SDL_Surface **scaled;
+    char **path;
 };
 
 /*  A set of SVG animation sequences at a particular size  */
@@ -54,8 +73,76 @@ struct SDL_SVGSET
 
     int count;
     SDL_SVGANIM **anim;
+
+    /*  Rasterization is serialized by the lock, so that a background
+	thread can rasterize frames which haven't yet been requested  */
+    SDL_mutex *lock;
+    SDL_Thread *warm_thread;
+    int warm_quit;
+    int warm_done;
+
+    /*  A set at another cell size, whose frames are scaled to stand in
+	for frames not yet rasterized by the warming thread, so that a
+	change of size needn't wait for rasterization  */
+    SDL_SVGSET *fallback;
+    int provisional_count;
+
+    /*  Rasterized frames are kept in a cache file, keyed by the cell 
+	size and a hash of the SVG files' names, sizes and mtimes.
+	When the cache is valid, frames use the mapped file as pixel
+	storage.  Otherwise, 'cache_path' is set, and the cache is 
+	written once the set is fully rasterized.  */
+    guint64 set_hash;
+    GMappedFile *cache;
+    char *cache_path;
+
+    /*  Glyphs with a color applied, keyed by glyph, frame and color, 
+	with the most recently used at the head of the queue.  Guarded
+	by the lock, since rendering may happen on worker threads.  */
+    GHashTable *tints;
+    GQueue tint_lru;
+    SDL_SVGSET_TINT_STATS tint_stats;
+};
+
+/*  A color-applied glyph in the tint cache  */
+struct SDL_SVGTINT
+{
+    guint64 key;
+    SDL_Surface *surface;
+    GList *link;
+};
+
+/*  The header of a cache file, followed by an entry for each frame slot
+    of each glyph, in order, and then the pixel data.  */
+struct SVG_CACHE_HEADER
+{
+    char magic[8];
+    guint32 version;
+    guint32 width;
+    guint32 height;
+    guint32 entry_count;
+    guint64 set_hash;
 };
 
+/*  A frame in the cache file.  A zero offset marks a frame which
+    couldn't be rasterized.  */
+struct SVG_CACHE_ENTRY
+{
+    guint32 glyph;
+    guint32 frame;
+    guint64 offset;
+};
+
+/*  Free a glyph stored in the svgset's tint cache.  Surfaces still in 
+    use by a renderer are reference counted, and freed on release.  */
+static void SdlSvgset_freeTint(gpointer data)
+{
+    SDL_SVGTINT *tint = (SDL_SVGTINT *)data;
+
+    SDL_FreeSurface(tint->surface);
+    free(tint);
+}
+
 /*  Allocate a new animation set  */
 SDL_SVGANIM *SdlSvgset_allocAnim(int frame_count)
 {
@@ -70,12 +157,19 @@ SDL_SVGANIM *SdlSvgset_allocAnim(int frame_count)
 
     anim->frame_count = frame_count;
     anim->frame = malloc(sizeof(SDL_Surface *) * anim->frame_count);
-    if (anim->frame == NULL)
+    anim->scaled = malloc(sizeof(SDL_Surface *) * anim->frame_count);
+    anim->path = malloc(sizeof(char *) * anim->frame_count);
+    if (anim->frame == NULL || anim->scaled == NULL || anim->path == NULL)
     {
+	free(anim->frame);
+	free(anim->scaled);
+	free(anim->path);
 	free(anim);
 	return NULL;
     }
     memset(anim->frame, 0, sizeof(SDL_Surface *) * anim->frame_count);
+    memset(anim->scaled, 0, sizeof(SDL_Surface *) * anim->frame_count);
+    memset(anim->path, 0, sizeof(char *) * anim->frame_count);
 
     return anim;
 }
@@ -92,9 +186,17 @@ void SdlSvgset_freeAnim(SDL_SVGANIM *anim)
 	    SDL_FreeSurface(anim->frame[i]);
 	    anim->frame[i] = NULL;
 	}
+	if (anim->scaled[i] != NULL)
+	{
+	    SDL_FreeSurface(anim->scaled[i]);
+	    anim->scaled[i] = NULL;
+	}
+	free(anim->path[i]);
     }
 
     free(anim->frame);
+    free(anim->scaled);
+    free(anim->path);
     free(anim);
 }
 
@@ -105,19 +207,36 @@ int SdlSvgset_extendAnim(SDL_SVGANIM *anim, int new_count)
     if (new_count > anim->frame_count)
     {
 	SDL_Surface **new_frame;
+	SDL_Surface **new_scaled;
+	char **new_path;
 
 	new_frame = malloc(sizeof(SDL_Surface *) * new_count);
-	if (new_frame == NULL)
+	new_scaled = malloc(sizeof(SDL_Surface *) * new_count);
+	new_path = malloc(sizeof(char *) * new_count);
+	if (new_frame == NULL || new_scaled == NULL || new_path == NULL)
 	{
+	    free(new_frame);
+	    free(new_scaled);
+	    free(new_path);
 	    return 0;
 	}
 	memset(new_frame, 0, sizeof(SDL_Surface *) * new_count);
 	memcpy(new_frame, anim->frame, 
 	       sizeof(SDL_Surface *) * anim->frame_count);
+	memset(new_scaled, 0, sizeof(SDL_Surface *) * new_count);
+	memcpy(new_scaled, anim->scaled, 
+	       sizeof(SDL_Surface *) * anim->frame_count);
+	memset(new_path, 0, sizeof(char *) * new_count);
+	memcpy(new_path, anim->path, 
+	       sizeof(char *) * anim->frame_count);
 	free(anim->frame);
+	free(anim->scaled);
+	free(anim->path);
 
 	anim->frame_count = new_count;
 	anim->frame = new_frame;
+	anim->scaled = new_scaled;
+	anim->path = new_path;
     }
 
     return 1;
@@ -244,12 +363,13 @@ SDL_Surface *SdlSvgset_convertSvgToGlyph(SDL_SVGSET *svgset,
     return surface;
 }
 
-/*  Load a particular SVG file into the set  */
-void SdlSvgset_loadGlyph(SDL_SVGSET *svgset, char *path, const gchar *filename)
+/*  Note the location of a particular SVG file in the set, to be 
+    rasterized when first needed  */
+void SdlSvgset_indexGlyph(
+    SDL_SVGSET *svgset, char *path, const gchar *filename)
 {
     int glyph, frame;
     char *svgpath;
-    RsvgHandle *svg;
     SDL_SVGANIM *anim;
 
     if (!SdlSvgset_getGlyphNumberFromFilename(filename, &glyph, &frame))
@@ -295,7 +415,26 @@ void SdlSvgset_loadGlyph(SDL_SVGSET *svgset, char *path, const gchar *filename)
     }
 
     sprintf(svgpath, "%s/%s", path, filename);
-		
+
+    free(anim->path[frame]);
+    anim->path[frame] = svgpath;
+}
+
+/*  Rasterize a frame which has been indexed but not yet loaded.  
+    Must be called with the svgset's lock held.  */
+static void SdlSvgset_loadFrame(SDL_SVGSET *svgset, SDL_SVGANIM *anim, 
+				int frame)
+{
+    RsvgHandle *svg;
+    SDL_Surface *surface;
+    char *svgpath = anim->path[frame];
+
+    if (svgpath == NULL)
+    {
+	return;
+    }
+    anim->path[frame] = NULL;
+
     svg = rsvg_handle_new_from_file(svgpath, NULL);
     free(svgpath);
 
@@ -304,9 +443,308 @@ void SdlSvgset_loadGlyph(SDL_SVGSET *svgset, char *path, const gchar *filename)
 	return;
     }
 
-    svgset->anim[glyph]->frame[frame] = 
-	SdlSvgset_convertSvgToGlyph(svgset, svg);
+    surface = SdlSvgset_convertSvgToGlyph(svgset, svg);
     g_object_unref(svg);		
+
+    /*  Published atomically, as frames are read without the lock, and
+	the pixels must be visible before the pointer to them is  */
+    g_atomic_pointer_set(&anim->frame[frame], surface);
+}
+
+/*  Hash the names, sizes and modification times of the indexed SVG 
+    files, so that a change to any of them invalidates the cache.
+    Must be called before any frames are rasterized.  */
+static guint64 SdlSvgset_hashFiles(SDL_SVGSET *svgset)
+{
+    guint64 hash = G_GUINT64_CONSTANT(14695981039346656037);
+    guint64 values[4];
+    unsigned char *bytes;
+    SDL_SVGANIM *anim;
+    GStatBuf info;
+    int glyph, frame, i;
+
+    for (glyph = 0; glyph < svgset->count; glyph++)
+    {
+	anim = svgset->anim[glyph];
+	if (anim == NULL)
+	{
+	    continue;
+	}
+
+	for (frame = 0; frame < anim->frame_count; frame++)
+	{
+	    if (anim->path[frame] == NULL)
+	    {
+		continue;
+	    }
+
+	    memset(&info, 0, sizeof(GStatBuf));
+	    g_stat(anim->path[frame], &info);
+
+	    values[0] = glyph;
+	    values[1] = frame;
+	    values[2] = (guint64)info.st_size;
+	    values[3] = (guint64)info.st_mtime;
+
+	    bytes = (unsigned char *)values;
+	    for (i = 0; i < (int)sizeof(values); i++)
+	    {
+		hash = (hash ^ bytes[i]) * G_GUINT64_CONSTANT(1099511628211);
+	    }
+	}
+    }
+
+    return hash;
+}
+
+/*  Count the frame slots of all glyphs in the set  */
+static int SdlSvgset_countFrames(SDL_SVGSET *svgset)
+{
+    int glyph, count = 0;
+
+    for (glyph = 0; glyph < svgset->count; glyph++)
+    {
+	if (svgset->anim[glyph] != NULL)
+	{
+	    count += svgset->anim[glyph]->frame_count;
+	}
+    }
+
+    return count;
+}
+
+/*  Use the frames from a mapped cache file, if it matches the set.
+    Returns false if the cache doesn't match.  */
+static int SdlSvgset_mapCache(SDL_SVGSET *svgset, GMappedFile *cache)
+{
+    char *contents = g_mapped_file_get_contents(cache);
+    gsize length = g_mapped_file_get_length(cache);
+    SVG_CACHE_HEADER *header = (SVG_CACHE_HEADER *)contents;
+    SVG_CACHE_ENTRY *entry;
+    SDL_SVGANIM *anim;
+    gsize frame_size = (gsize)svgset->width * svgset->height * 4;
+    guint32 i;
+
+    if (length < sizeof(SVG_CACHE_HEADER)
+	|| memcmp(header->magic, SVG_CACHE_MAGIC, 8) != 0
+	|| header->version != SVG_CACHE_VERSION
+	|| header->width != svgset->width
+	|| header->height != svgset->height
+	|| header->set_hash != svgset->set_hash
+	|| header->entry_count != SdlSvgset_countFrames(svgset)
+	|| length < sizeof(SVG_CACHE_HEADER) 
+	    + header->entry_count * sizeof(SVG_CACHE_ENTRY))
+    {
+	return 0;
+    }
+
+    /*  Validate all entries before using any of them  */
+    entry = (SVG_CACHE_ENTRY *)(header + 1);
+    for (i = 0; i < header->entry_count; i++)
+    {
+	if (entry[i].glyph >= svgset->count
+	    || svgset->anim[entry[i].glyph] == NULL
+	    || entry[i].frame >= svgset->anim[entry[i].glyph]->frame_count
+	    || entry[i].offset > length
+	    || (entry[i].offset != 0 
+		&& length - entry[i].offset < frame_size))
+	{
+	    return 0;
+	}
+    }
+
+    for (i = 0; i < header->entry_count; i++)
+    {
+	anim = svgset->anim[entry[i].glyph];
+
+	free(anim->path[entry[i].frame]);
+	anim->path[entry[i].frame] = NULL;
+
+	if (entry[i].offset != 0)
+	{
+	    anim->frame[entry[i].frame] = SDL_CreateRGBSurfaceFrom(
+		contents + entry[i].offset, svgset->width, svgset->height, 
+		32, svgset->width * 4,
+		0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+	}
+    }
+
+    return 1;
+}
+
+/*  Write the fully rasterized set to the cache file  */
+static int SdlSvgset_writeCache(SDL_SVGSET *svgset)
+{
+    SVG_CACHE_HEADER *header;
+    SVG_CACHE_ENTRY *entry;
+    SDL_SVGANIM *anim;
+    SDL_Surface *surface;
+    gsize frame_size = (gsize)svgset->width * svgset->height * 4;
+    gsize data_offset, length, offset;
+    int entry_count = SdlSvgset_countFrames(svgset);
+    int glyph, frame, y, i;
+    char *contents;
+    int ret;
+
+    data_offset = sizeof(SVG_CACHE_HEADER) 
+	+ entry_count * sizeof(SVG_CACHE_ENTRY);
+    data_offset = (data_offset + SVG_CACHE_ALIGN - 1) 
+	& ~(gsize)(SVG_CACHE_ALIGN - 1);
+    length = data_offset + entry_count * frame_size;
+
+    contents = malloc(length);
+    if (contents == NULL)
+    {
+	return ENOMEM;
+    }
+    memset(contents, 0, length);
+
+    header = (SVG_CACHE_HEADER *)contents;
+    memcpy(header->magic, SVG_CACHE_MAGIC, 8);
+    header->version = SVG_CACHE_VERSION;
+    header->width = svgset->width;
+    header->height = svgset->height;
+    header->entry_count = entry_count;
+    header->set_hash = svgset->set_hash;
+
+    entry = (SVG_CACHE_ENTRY *)(header + 1);
+    offset = data_offset;
+    i = 0;
+    for (glyph = 0; glyph < svgset->count; glyph++)
+    {
+	anim = svgset->anim[glyph];
+	if (anim == NULL)
+	{
+	    continue;
+	}
+
+	for (frame = 0; frame < anim->frame_count; frame++)
+	{
+	    surface = anim->frame[frame];
+
+	    entry[i].glyph = glyph;
+	    entry[i].frame = frame;
+	    entry[i].offset = 0;
+
+	    if (surface != NULL)
+	    {
+		entry[i].offset = offset;
+		for (y = 0; y < surface->h; y++)
+		{
+		    memcpy(contents + offset + y * surface->w * 4,
+			   (char *)surface->pixels + y * surface->pitch,
+			   surface->w * 4);
+		}
+		offset += frame_size;
+	    }
+
+	    i++;
+	}
+    }
+
+    /*  Written to a temporary file and renamed, so a partially written
+	cache is never seen  */
+    ret = 0;
+    if (!g_file_set_contents(svgset->cache_path, contents, offset, NULL))
+    {
+	ret = EIO;
+    }
+    free(contents);
+
+    return ret;
+}
+
+/*  Rasterize all frames of the set which haven't yet been requested, 
+    in the background, so that they are ready when first drawn  */
+static int SdlSvgset_warmThread(void *data)
+{
+    SDL_SVGSET *svgset = (SDL_SVGSET *)data;
+    SDL_SVGANIM *anim;
+    int glyph, frame;
+
+    for (glyph = 0; glyph < svgset->count; glyph++)
+    {
+	anim = svgset->anim[glyph];
+	if (anim == NULL)
+	{
+	    continue;
+	}
+
+	for (frame = 0; frame < anim->frame_count; frame++)
+	{
+	    SDL_LockMutex(svgset->lock);
+	    if (svgset->warm_quit)
+	    {
+		SDL_UnlockMutex(svgset->lock);
+		return 0;
+	    }
+	    SdlSvgset_loadFrame(svgset, anim, frame);
+	    SDL_UnlockMutex(svgset->lock);
+	}
+    }
+
+    if (svgset->cache_path != NULL)
+    {
+	SdlSvgset_writeCache(svgset);
+    }
+
+    SDL_LockMutex(svgset->lock);
+    svgset->warm_done = 1;
+    SDL_UnlockMutex(svgset->lock);
+
+    return 0;
+}
+
+/*  Use the rasterized frames cached in 'cache_dir' if they are still
+    valid for this set.  Otherwise, the cache is rebuilt once the set 
+    has been warmed.  Must be called before any glyphs are requested.  */
+int SdlSvgset_useCache(SDL_SVGSET *svgset, const char *cache_dir)
+{
+    char filename[64];
+    GMappedFile *cache;
+
+    svgset->set_hash = SdlSvgset_hashFiles(svgset);
+
+    sprintf(filename, "svg-glyphs-%dx%d.cache", 
+	    svgset->width, svgset->height);
+
+    g_free(svgset->cache_path);
+    svgset->cache_path = g_build_filename(cache_dir, filename, NULL);
+    if (svgset->cache_path == NULL)
+    {
+	return ENOMEM;
+    }
+
+    /*  Mapped writable so that the pages are private copies, in case
+	any pixels are ever written  */
+    cache = g_mapped_file_new(svgset->cache_path, TRUE, NULL);
+    if (cache != NULL)
+    {
+	if (SdlSvgset_mapCache(svgset, cache))
+	{
+	    svgset->cache = cache;
+	    g_free(svgset->cache_path);
+	    svgset->cache_path = NULL;
+	    return 0;
+	}
+
+	g_mapped_file_unref(cache);
+    }
+
+    return 0;
+}
+
+/*  Start rasterizing the rest of the set on a background thread  */
+int SdlSvgset_warm(SDL_SVGSET *svgset)
+{
+    if (svgset->warm_thread != NULL)
+    {
+	return 1;
+    }
+
+    svgset->warm_thread = SDL_CreateThread(SdlSvgset_warmThread, svgset);
+
+    return svgset->warm_thread != NULL;
 }
 
 #pragma GCC diagnostic ignored "-Wdeprecated-declarations"
@@ -328,10 +766,30 @@ SDL_SVGSET *SdlSvgset_alloc(char *path, int width, int height)
 
     svgset->width = width;
     svgset->height = height;
+
+    svgset->lock = SDL_CreateMutex();
+    if (svgset->lock == NULL)
+    {
+	free(svgset);
+	return NULL;
+    }
+
+    svgset->tints = g_hash_table_new_full(
+	g_int64_hash, g_int64_equal, NULL, SdlSvgset_freeTint);
+    g_queue_init(&svgset->tint_lru);
+    svgset->tint_stats.capacity = TINT_CACHE_SIZE;
+    if (svgset->tints == NULL)
+    {
+	SDL_DestroyMutex(svgset->lock);
+	free(svgset);
+	return NULL;
+    }
     
     svgdir = g_dir_open(path, 0, NULL);
     if (svgdir == NULL)
     {
+	g_hash_table_destroy(svgset->tints);
+	SDL_DestroyMutex(svgset->lock);
 	free(svgset);
 	return NULL;
     }
@@ -356,16 +814,20 @@ SDL_SVGSET *SdlSvgset_alloc(char *path, int width, int height)
     svgset->anim = malloc(sizeof(SDL_SVGANIM *) * svgset->count);
     if (svgset->anim == NULL)
     {
+	g_dir_close(svgdir);
+	g_hash_table_destroy(svgset->tints);
+	SDL_DestroyMutex(svgset->lock);
 	free(svgset);
 	return NULL;
     }
     memset(svgset->anim, 0, sizeof(SDL_Surface *) * svgset->count);
 
+    /*  Only index the files now.  Frames are rasterized on demand.  */
     g_dir_rewind(svgdir);
     filename = g_dir_read_name(svgdir);
     while (filename != NULL)
     {
-	SdlSvgset_loadGlyph(svgset, path, filename);
+	SdlSvgset_indexGlyph(svgset, path, filename);
 
 	filename = g_dir_read_name(svgdir);
     }
@@ -380,6 +842,19 @@ void SdlSvgset_free(SDL_SVGSET *svgset)
 {
     int i;
 
+    if (svgset->warm_thread != NULL)
+    {
+	SDL_LockMutex(svgset->lock);
+	svgset->warm_quit = 1;
+	SDL_UnlockMutex(svgset->lock);
+
+	SDL_WaitThread(svgset->warm_thread, NULL);
+    }
+    SDL_DestroyMutex(svgset->lock);
+
+    g_queue_clear(&svgset->tint_lru);
+    g_hash_table_destroy(svgset->tints);
+
     for (i = 0; i < svgset->count; i++)
     {
 	if (svgset->anim[i] != NULL)
@@ -389,6 +864,14 @@ void SdlSvgset_free(SDL_SVGSET *svgset)
 	}
     }
 
+    /*  Surfaces from the cache don't own their pixels, so the mapping
+	is released only after they have been freed  */
+    if (svgset->cache != NULL)
+    {
+	g_mapped_file_unref(svgset->cache);
+    }
+    g_free(svgset->cache_path);
+
     free(svgset->anim);
     free(svgset);
 }
@@ -489,43 +972,240 @@ int SdlSvgset_applyColor(SDL_Surface *surface, SDL_Color color)
     return 1;
 }
 
-SDL_Surface *SdlSvgset_getGlyph(SDL_SVGSET *svgset, 
-				unsigned glyph, int frame)
+/*  Return true if the glyph has more than one frame of animation, and so
+    will need to be redrawn as time passes  */
+int SdlSvgset_isAnimated(SDL_SVGSET *svgset, unsigned glyph)
+{
+    if (glyph >= svgset->count || svgset->anim[glyph] == NULL)
+    {
+	return 0;
+    }
+
+    return svgset->anim[glyph]->frame_count > 1;
+}
+
+/*  Scale a frame rasterized for another cell size to the size of this
+    set, using the nearest pixel  */
+static SDL_Surface *SdlSvgset_scaleFrame(SDL_SVGSET *svgset, 
+					 SDL_Surface *source)
+{
+    SDL_Surface *surface;
+    Uint32 *src, *dst;
+    int x, y;
+
+    surface = SDL_CreateRGBSurface(0, svgset->width, svgset->height, 32,
+				   0x00FF0000, 0x0000FF00, 0x000000FF, 
+				   0xFF000000);
+    if (surface == NULL)
+    {
+	return NULL;
+    }
+
+    for (y = 0; y < surface->h; y++)
+    {
+	src = (Uint32 *)((Uint8 *)source->pixels 
+			 + (y * source->h / surface->h) * source->pitch);
+	dst = (Uint32 *)((Uint8 *)surface->pixels + y * surface->pitch);
+
+	for (x = 0; x < surface->w; x++)
+	{
+	    dst[x] = src[x * source->w / surface->w];
+	}
+    }
+
+    return surface;
+}
+
+/*  Stand in for a frame not yet rasterized with a scaled copy of the
+    fallback's frame, if it has one.  Returns true if a stand-in is
+    available.  Must be called with the lock held.  */
+static int SdlSvgset_scaleFallbackFrame(SDL_SVGSET *svgset, 
+					unsigned glyph, int frame_index)
+{
+    SDL_SVGANIM *anim = svgset->anim[glyph];
+    SDL_SVGANIM *fallback_anim;
+    SDL_Surface *source, *scaled;
+
+    if (anim->scaled[frame_index] != NULL)
+    {
+	return 1;
+    }
+
+    if (svgset->fallback == NULL || svgset->warm_thread == NULL
+	|| anim->path[frame_index] == NULL
+	|| glyph >= svgset->fallback->count)
+    {
+	return 0;
+    }
+
+    /*  Only frames the fallback has already rasterized will do.  The
+	fallback's own warm thread may still be storing frames, so its
+	lock is held too, always taken after this set's.  */
+    SDL_LockMutex(svgset->fallback->lock);
+    fallback_anim = svgset->fallback->anim[glyph];
+    if (fallback_anim == NULL || frame_index >= fallback_anim->frame_count)
+    {
+	SDL_UnlockMutex(svgset->fallback->lock);
+	return 0;
+    }
+    source = fallback_anim->frame[frame_index];
+    if (source == NULL)
+    {
+	SDL_UnlockMutex(svgset->fallback->lock);
+	return 0;
+    }
+
+    scaled = SdlSvgset_scaleFrame(svgset, source);
+    SDL_UnlockMutex(svgset->fallback->lock);
+    if (scaled == NULL)
+    {
+	return 0;
+    }
+    g_atomic_pointer_set(&anim->scaled[frame_index], scaled);
+    svgset->provisional_count++;
+
+    return 1;
+}
+
+/*  Find the frame of a glyph to use for a particular animation frame, 
+    rasterizing it if this is the first time it has been requested, or
+    standing in for it if the set is still being warmed.
+    Returns -1 if the glyph isn't in the set.  */
+static int SdlSvgset_getFrameIndex(SDL_SVGSET *svgset, 
+				   unsigned glyph, int frame)
 {
     SDL_SVGANIM *anim;
     int frame_index;
 
     if (glyph >= svgset->count)
     {
-	return NULL;
+	return -1;
     }
 
     anim = svgset->anim[glyph];
     if (anim == NULL || anim->frame_count == 0)
     {
-	return NULL;
+	return -1;
     }
 
     frame_index = (frame % MAX_FRAME_COUNT) 
 	* anim->frame_count / MAX_FRAME_COUNT;
-    return anim->frame[frame_index];
+
+    /*  Frames, once rasterized, are never modified, so only a frame
+	which hasn't been rasterized needs the lock.  The pointer is read
+	atomically, pairing with its publication, so that a frame found
+	here has its pixels visible.  Rasterization worker threads only
+	request frames prepared on the main thread.  */
+    if (g_atomic_pointer_get(&anim->frame[frame_index]) == NULL)
+    {
+	SDL_LockMutex(svgset->lock);
+	if (!SdlSvgset_scaleFallbackFrame(svgset, glyph, frame_index))
+	{
+	    SdlSvgset_loadFrame(svgset, anim, frame_index);
+	}
+	SDL_UnlockMutex(svgset->lock);
+    }
+
+    return frame_index;
+}
+
+/*  The surface for a frame, which may be a stand-in until the frame is
+    rasterized  */
+static SDL_Surface *SdlSvgset_getFrameSurface(
+    SDL_SVGSET *svgset, unsigned glyph, int frame_index, int *provisional)
+{
+    SDL_SVGANIM *anim = svgset->anim[glyph];
+    SDL_Surface *surface = g_atomic_pointer_get(&anim->frame[frame_index]);
+
+    *provisional = 0;
+    if (surface == NULL)
+    {
+	surface = g_atomic_pointer_get(&anim->scaled[frame_index]);
+	*provisional = (surface != NULL);
+    }
+
+    return surface;
+}
+
+SDL_Surface *SdlSvgset_getGlyph(SDL_SVGSET *svgset, 
+				unsigned glyph, int frame)
+{
+    int frame_index = SdlSvgset_getFrameIndex(svgset, glyph, frame);
+    int provisional;
+
+    if (frame_index < 0)
+    {
+	return NULL;
+    }
+
+    return SdlSvgset_getFrameSurface(
+	svgset, glyph, frame_index, &provisional);
+}
+
+/*  Evict the least recently used tinted glyphs until the cache is within
+    its capacity.  Must be called with the lock held.  */
+static void SdlSvgset_trimTints(SDL_SVGSET *svgset)
+{
+    while (svgset->tint_lru.length > svgset->tint_stats.capacity)
+    {
+	GList *link = g_queue_peek_tail_link(&svgset->tint_lru);
+	SDL_SVGTINT *tint = (SDL_SVGTINT *)link->data;
+
+	g_queue_unlink(&svgset->tint_lru, link);
+	g_list_free(link);
+	g_hash_table_remove(svgset->tints, &tint->key);
+	svgset->tint_stats.evictions++;
+    }
 }
 
 /*  
     Render one of the glyphs in the svgset at the target dimensions
-    and with a particular color.
+    and with a particular color.  The surface is shared with the svgset's
+    tint cache, and must be returned with SdlSvgset_releaseGlyph.
 */
 SDL_Surface *SdlSvgset_render(SDL_SVGSET *svgset, 
 			      unsigned glyph, int frame, SDL_Color color)
 {
     SDL_Surface *source, *surface;
+    SDL_SVGTINT *tint;
+    guint64 key;
+    int frame_index, provisional;
 
-    source = SdlSvgset_getGlyph(svgset, glyph, frame);
+    frame_index = SdlSvgset_getFrameIndex(svgset, glyph, frame);
+    if (frame_index < 0)
+    {
+	return NULL;
+    }
+    source = SdlSvgset_getFrameSurface(
+	svgset, glyph, frame_index, &provisional);
     if (source == NULL)
     {
 	return NULL;
     }
 
+    key = ((guint64)glyph << 32) | ((guint64)frame_index << 24) 
+	| (color.r << 16) | (color.g << 8) | color.b;
+
+    SDL_LockMutex(svgset->lock);
+    tint = g_hash_table_lookup(svgset->tints, &key);
+    if (tint != NULL)
+    {
+	svgset->tint_stats.hits++;
+
+	g_queue_unlink(&svgset->tint_lru, tint->link);
+	g_queue_push_head_link(&svgset->tint_lru, tint->link);
+
+	surface = tint->surface;
+	surface->refcount++;
+	SDL_UnlockMutex(svgset->lock);
+
+	return surface;
+    }
+    svgset->tint_stats.misses++;
+    SDL_UnlockMutex(svgset->lock);
+
+    /*  Apply the color without holding the lock, so that other threads
+	may use the cache meanwhile  */
     surface = SDL_CreateRGBSurface(
 	0, source->w, source->h, 32,
 	0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
@@ -541,5 +1221,115 @@ SDL_Surface *SdlSvgset_render(SDL_SVGSET *svgset,
 	return NULL;
     } 
 
+    /*  Stand-ins aren't cached, as the real frame will replace them  */
+    if (provisional)
+    {
+	return surface;
+    }
+
+    tint = malloc(sizeof(SDL_SVGTINT));
+    if (tint == NULL)
+    {
+	return surface;
+    }
+    tint->key = key;
+    tint->surface = surface;
+
+    SDL_LockMutex(svgset->lock);
+    if (g_hash_table_lookup(svgset->tints, &key) == NULL)
+    {
+	tint->link = g_list_prepend(NULL, tint);
+	g_queue_push_head_link(&svgset->tint_lru, tint->link);
+	g_hash_table_insert(svgset->tints, &tint->key, tint);
+	surface->refcount++;
+
+	SdlSvgset_trimTints(svgset);
+    }
+    else
+    {
+	/*  Another thread applied the same color first.  Ours is used
+	    once and then freed on release.  */
+	free(tint);
+    }
+    SDL_UnlockMutex(svgset->lock);
+
     return surface;
 }
+
+/*  Use the frames of another set, at a different cell size, to stand in
+    for frames of this set while it is being warmed.  The fallback must
+    stay allocated until it is replaced or cleared.  */
+void SdlSvgset_setFallback(SDL_SVGSET *svgset, SDL_SVGSET *fallback)
+{
+    SDL_LockMutex(svgset->lock);
+    svgset->fallback = fallback;
+    SDL_UnlockMutex(svgset->lock);
+}
+
+SDL_SVGSET *SdlSvgset_getFallback(SDL_SVGSET *svgset)
+{
+    return svgset->fallback;
+}
+
+/*  Return true if stand-ins for frames are waiting to be replaced  */
+int SdlSvgset_hasProvisional(SDL_SVGSET *svgset)
+{
+    return svgset->provisional_count > 0;
+}
+
+/*  Once the set has been warmed, free the stand-ins and return true,
+    as everything drawn with them needs to be redrawn.  Must not be 
+    called while glyphs are being rasterized.  */
+int SdlSvgset_dropProvisional(SDL_SVGSET *svgset)
+{
+    SDL_SVGANIM *anim;
+    int glyph, frame;
+
+    SDL_LockMutex(svgset->lock);
+    if (svgset->provisional_count == 0 || !svgset->warm_done)
+    {
+	SDL_UnlockMutex(svgset->lock);
+	return 0;
+    }
+
+    for (glyph = 0; glyph < svgset->count; glyph++)
+    {
+	anim = svgset->anim[glyph];
+	if (anim == NULL)
+	{
+	    continue;
+	}
+
+	for (frame = 0; frame < anim->frame_count; frame++)
+	{
+	    if (anim->scaled[frame] != NULL)
+	    {
+		SDL_FreeSurface(anim->scaled[frame]);
+		anim->scaled[frame] = NULL;
+	    }
+	}
+    }
+    svgset->provisional_count = 0;
+    svgset->fallback = NULL;
+    SDL_UnlockMutex(svgset->lock);
+
+    return 1;
+}
+
+/*  Release a glyph returned by SdlSvgset_render  */
+void SdlSvgset_releaseGlyph(SDL_SVGSET *svgset, SDL_Surface *surface)
+{
+    SDL_LockMutex(svgset->lock);
+    SDL_FreeSurface(surface);
+    SDL_UnlockMutex(svgset->lock);
+}
+
+/*  Get the usage statistics of the tint cache  */
+void SdlSvgset_getTintStats(SDL_SVGSET *svgset, 
+			    SDL_SVGSET_TINT_STATS *stats)
+{
+    SDL_LockMutex(svgset->lock);
+    *stats = svgset->tint_stats;
+    stats->count = svgset->tint_lru.length;
+    SDL_UnlockMutex(svgset->lock);
+}
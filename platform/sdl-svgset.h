@@ -26,12 +26,33 @@
 #include <SDL/SDL.h>
 
 typedef struct SDL_SVGSET SDL_SVGSET;
+typedef struct SDL_SVGSET_TINT_STATS SDL_SVGSET_TINT_STATS;
+
+/*  Usage of the cache of color-applied glyphs  */
+struct SDL_SVGSET_TINT_STATS
+{
+    unsigned count;
+    unsigned capacity;
+    unsigned hits;
+    unsigned misses;
+    unsigned evictions;
+};
 
 SDL_SVGSET *SdlSvgset_alloc(char *path, int width, int height);
 void SdlSvgset_free(SDL_SVGSET *svgset);
+int SdlSvgset_useCache(SDL_SVGSET *svgset, const char *cache_dir);
+int SdlSvgset_warm(SDL_SVGSET *svgset);
+void SdlSvgset_setFallback(SDL_SVGSET *svgset, SDL_SVGSET *fallback);
+SDL_SVGSET *SdlSvgset_getFallback(SDL_SVGSET *svgset);
+int SdlSvgset_hasProvisional(SDL_SVGSET *svgset);
+int SdlSvgset_dropProvisional(SDL_SVGSET *svgset);
 
+int SdlSvgset_isAnimated(SDL_SVGSET *svgset, unsigned glyph);
 SDL_Surface *SdlSvgset_getGlyph(SDL_SVGSET *svgset, unsigned glyph, int frame);
 SDL_Surface *SdlSvgset_render(SDL_SVGSET *svgset, 
 			      unsigned glyph, int frame, SDL_Color color);
+void SdlSvgset_releaseGlyph(SDL_SVGSET *svgset, SDL_Surface *surface);
+void SdlSvgset_getTintStats(SDL_SVGSET *svgset, 
+			    SDL_SVGSET_TINT_STATS *stats);
 
 #endif